@@ -0,0 +1,113 @@
+#include "main.h"
+#include <ESPAsyncWebServer.h>
+#include "wifi_credentials.h"
+
+// Authentication and rate limiting of the requests which change the state: /set and the OTA upload
+//
+// A request is authenticated by the API key, sent either as the "Authorization: Bearer <key>" header or as the
+// "key=<key>" argument. The key is held in NV ("api_key"); until it is set, MY_API_KEY from wifi_credentials.h
+// is used, and if that is not defined either, the authentication is off.
+// /set is also rate limited per client IP address by a token bucket, so that a misbehaving script can not wear
+// out the flash with NV writes. Read-only endpoints are not checked at all.
+
+#ifndef MY_API_KEY
+#define MY_API_KEY ""
+#endif
+
+#define AUTH_CLIENTS        8 // Number of client addresses tracked by the rate limiter
+#define AUTH_BURST          5 // Requests a client can make at once
+#define AUTH_REFILL_MS   1000 // A client earns one more request every this many milliseconds
+
+struct TokenBucket
+{
+    uint32_t ip;          // Client address, 0 if the slot is free
+    uint32_t tokens;      // Requests the client can make right now
+    uint32_t refill_at;   // millis() when the next token is added
+    uint32_t last_ms;     // millis() of the last request, to recycle the least recently used slot
+};
+
+static TokenBucket buckets[AUTH_CLIENTS];
+static portMUX_TYPE buckets_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Compares in a time which does not depend on where the strings differ
+static bool key_equal(const char *a, const char *b)
+{
+    size_t len_a = strlen(a), len_b = max(strlen(b), size_t(1));
+    uint8_t diff = len_a != strlen(b);
+    for (size_t i = 0; i < len_a; i++)
+        diff |= a[i] ^ b[i % len_b];
+    return diff == 0;
+}
+
+// Returns true if the request carries the API key, without sending any response
+bool auth_check(AsyncWebServerRequest *request)
+{
+    const char *key = wdata.api_key[0] ? wdata.api_key : MY_API_KEY;
+    if (!key[0])
+        return true;
+    const char *value = request_header(request, "Authorization");
+    if (value)
+        return !strncmp(value, "Bearer ", 7) && key_equal(value + 7, key);
+    return key_equal(request_arg(request, "key"), key);
+}
+
+// Takes a token from the bucket of the client, returns false if it has none left
+static bool rate_allowed(uint32_t ip)
+{
+    uint32_t now = millis();
+    bool allowed = false;
+    portENTER_CRITICAL(&buckets_mux);
+    TokenBucket *b = &buckets[0];
+    for (int i = 0; i < AUTH_CLIENTS; i++)
+    {
+        if (buckets[i].ip == ip)
+        {
+            b = &buckets[i];
+            break;
+        }
+        if (int32_t(buckets[i].last_ms - b->last_ms) < 0) // Remember the least recently used slot
+            b = &buckets[i];
+    }
+    if (b->ip != ip)
+    {
+        b->ip = ip;
+        b->tokens = AUTH_BURST;
+        b->refill_at = now + AUTH_REFILL_MS;
+    }
+    while ((b->tokens < AUTH_BURST) && (int32_t(now - b->refill_at) >= 0))
+    {
+        b->tokens++;
+        b->refill_at += AUTH_REFILL_MS;
+    }
+    if (b->tokens == AUTH_BURST)
+        b->refill_at = now + AUTH_REFILL_MS; // A full bucket does not save up the refills
+    if (b->tokens)
+    {
+        b->tokens--;
+        allowed = true;
+    }
+    b->last_ms = now;
+    portEXIT_CRITICAL(&buckets_mux);
+    return allowed;
+}
+
+// Checks a request to a mutating handler. If it is rejected, a 401 or 429 response is sent and it returns false.
+// Rate limiting is optional, so that the chunks of an already authenticated upload are not throttled.
+bool auth_request(AsyncWebServerRequest *request, bool limit)
+{
+    uint32_t start = esp_timer_get_time();
+    bool ok = auth_check(request);
+    if (!ok)
+    {
+        wdata.auth_rejected++;
+        request->send(401, "text/html", "Unauthorized");
+    }
+    else if (limit && !rate_allowed(uint32_t(request->client()->remoteIP())))
+    {
+        ok = false;
+        wdata.auth_throttled++;
+        request->send(429, "text/html", "Too many requests");
+    }
+    prof_auth.add(uint32_t(esp_timer_get_time()) - start);
+    return ok;
+}
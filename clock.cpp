@@ -0,0 +1,233 @@
+#include "main.h"
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <sys/time.h>
+#include <lwip/dns.h>
+
+// Wall clock, disciplined by SNTP
+//
+// The time is kept by the system clock (gettimeofday), which runs from the RTC timer and keeps counting across
+// a software reset, a watchdog and an OTA reboot; only a power-on reset clears it. A small SNTP client measures
+// the offset of the system clock against the NTP server. Small offsets are slewed away with adjtime(), so the
+// clock never jumps and never goes backwards; only a clock which was never set, or one which is off by more than
+// CLOCK_STEP_MS, is stepped. The server is set in NV ("ntp_server") as a host name or an address, optionally with
+// a port ("host:port"), so a local NTP server on an unprivileged port can stand in for tests. A host name is looked
+// up at the start of every synchronization with the asynchronous lwIP resolver, and its address is kept for that
+// synchronization only, so the client never waits on DNS and follows a server which moved by the next one.
+
+#define NTP_PORT            123
+#define NTP_PACKET_SIZE      48
+#define NTP_UNIX_OFFSET  2208988800UL // Seconds from 1900 (NTP era 0) to 1970 (unix epoch)
+#define NTP_SYNC_MS     (3600 * 1000) // Interval between synchronizations
+#define NTP_RETRY_MS      (30 * 1000) // Retry interval after a failed synchronization
+#define NTP_TIMEOUT_MS          2000  // Give up waiting on a reply after this time
+#define NTP_DNS_TIMEOUT_MS     10000  // Give up waiting on the address of the server after this time
+#define CLOCK_STEP_MS           1000  // Offsets larger than this are stepped, smaller ones are slewed
+#define CLOCK_VALID_MIN   1577836800  // Times before 2020-01-01 mean the clock was never set
+
+static WiFiUDP udp;
+static uint8_t ntp_packet[NTP_PACKET_SIZE];
+static bool ntp_waiting = false;      // Request was sent, waiting on the reply
+static bool ntp_resolving = false;    // The server name is being looked up, waiting on its address
+static uint32_t ntp_sent_ms = 0;      // millis() when the request, or the lookup, was sent
+static IPAddress ntp_ip;              // Address of the server for the current synchronization
+static uint16_t ntp_port = NTP_PORT;
+static uint8_t ntp_dns_seq = 0;       // Number of the current lookup, an answer to an older one is ignored
+static volatile bool ntp_dns_done = false;   // Set by the resolver once it answered the current lookup
+static volatile uint32_t ntp_dns_addr = 0;   // The address it found, 0 if it found none
+static uint32_t ntp_next_ms = 0;      // millis() of the next synchronization
+static int64_t ntp_t1 = 0;            // Local time of the request, in microseconds
+
+static int64_t clock_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return int64_t(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+static int64_t ntp_to_us(const uint8_t *p)
+{
+    uint32_t sec = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    uint32_t frac = (p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+    return (int64_t(sec) - NTP_UNIX_OFFSET) * 1000000 + ((uint64_t(frac) * 1000000) >> 32);
+}
+
+// Returns the unix time in seconds, or 0 if the clock has not been set
+uint32_t clock_now()
+{
+    time_t now = time(nullptr);
+    return (now >= CLOCK_VALID_MIN) ? now : 0;
+}
+
+// Corrects the clock by the given offset: slews small offsets, steps the large ones
+static void clock_correct(int64_t offset_us)
+{
+    if (!clock_now() || (llabs(offset_us) > CLOCK_STEP_MS * 1000LL))
+    {
+        int64_t us = clock_us() + offset_us;
+        struct timeval tv { time_t(us / 1000000), suseconds_t(us % 1000000) };
+        settimeofday(&tv, nullptr);
+        wdata.clock_steps++;
+        log_write(LOG_INFO, LOG_CLOCK, "Clock stepped by %d ms", int32_t(offset_us / 1000));
+    }
+    else
+    {
+        struct timeval delta { time_t(offset_us / 1000000), suseconds_t(offset_us % 1000000) };
+        adjtime(&delta, nullptr);
+    }
+    wdata.clock_offset_ms = offset_us / 1000;
+}
+
+// Sets the clock from a unix time given by a client, used when there is no NTP server
+void clock_set(uint32_t timestamp)
+{
+    clock_correct(int64_t(timestamp) * 1000000 - clock_us());
+}
+
+static void ntp_failed(const char *why)
+{
+    wdata.clock_fails++;
+    log_write(LOG_WARN, LOG_CLOCK, why);
+    ntp_next_ms = millis() + NTP_RETRY_MS;
+}
+
+static void ntp_send()
+{
+    // Client mode request (LI 0, version 4, mode 3); the transmit timestamp is echoed back by the server
+    // as the originate timestamp, which ties the reply to this request
+    memset(ntp_packet, 0, sizeof(ntp_packet));
+    ntp_packet[0] = 0x23;
+    ntp_t1 = clock_us();
+    uint64_t t1 = uint64_t(ntp_t1 + NTP_UNIX_OFFSET * 1000000LL);
+    uint32_t sec = t1 / 1000000;
+    uint32_t frac = ((t1 % 1000000) << 32) / 1000000;
+    for (int i = 0; i < 4; i++)
+    {
+        ntp_packet[40 + i] = sec >> (24 - i * 8);
+        ntp_packet[44 + i] = frac >> (24 - i * 8);
+    }
+
+    udp.begin(0);
+    if (udp.beginPacket(ntp_ip, ntp_port) && (udp.write(ntp_packet, NTP_PACKET_SIZE) == NTP_PACKET_SIZE) && udp.endPacket())
+    {
+        ntp_waiting = true;
+        ntp_sent_ms = millis();
+    }
+    else
+    {
+        udp.stop();
+        ntp_next_ms = millis() + NTP_RETRY_MS;
+    }
+}
+
+// Called by the resolver, in the lwIP task
+static void ntp_dns_found(const char *name, const ip_addr_t *ipaddr, void *arg)
+{
+    if (uint8_t(uintptr_t(arg)) != ntp_dns_seq)
+        return;
+    ntp_dns_addr = ipaddr ? ipaddr->u_addr.ip4.addr : 0;
+    ntp_dns_done = true;
+}
+
+// Starts a synchronization: an address is used as is, a host name is looked up first
+static void ntp_resolve()
+{
+    char server[sizeof(wdata.ntp_server)];
+    strcpy(server, wdata.ntp_server);
+    char *colon = strchr(server, ':');
+    ntp_port = NTP_PORT;
+    if (colon)
+    {
+        *colon = 0;
+        ntp_port = atoi(colon + 1);
+    }
+    if (ntp_ip.fromString(server))
+    {
+        ntp_send();
+        return;
+    }
+
+    ip_addr_t addr;
+    ntp_dns_seq++; // Before the flag is cleared, so that a late answer to an older lookup cannot set it again
+    ntp_dns_done = false;
+    err_t err = dns_gethostbyname(server, &addr, ntp_dns_found, (void *)uintptr_t(ntp_dns_seq));
+    if (err == ERR_OK) // Found in the cache of the resolver
+    {
+        ntp_ip = IPAddress(addr.u_addr.ip4.addr);
+        ntp_send();
+    }
+    else if (err == ERR_INPROGRESS)
+    {
+        ntp_resolving = true;
+        ntp_sent_ms = millis();
+    }
+    else
+        ntp_failed("NTP server name not resolved");
+}
+
+static void ntp_resolved()
+{
+    if (ntp_dns_done)
+    {
+        ntp_resolving = false;
+        if (ntp_dns_addr)
+        {
+            ntp_ip = IPAddress(ntp_dns_addr);
+            ntp_send();
+        }
+        else
+            ntp_failed("NTP server name not resolved");
+    }
+    else if (millis() - ntp_sent_ms >= NTP_DNS_TIMEOUT_MS)
+    {
+        ntp_resolving = false;
+        ntp_dns_seq++; // The answer is too late for this synchronization
+        ntp_failed("NTP server name not resolved");
+    }
+}
+
+static void ntp_receive()
+{
+    uint8_t reply[NTP_PACKET_SIZE];
+    if ((udp.parsePacket() < NTP_PACKET_SIZE) || (udp.read(reply, NTP_PACKET_SIZE) != NTP_PACKET_SIZE))
+    {
+        if (millis() - ntp_sent_ms < NTP_TIMEOUT_MS)
+            return; // Keep waiting
+        ntp_waiting = false;
+        udp.stop();
+        ntp_failed("NTP server did not reply");
+        return;
+    }
+    int64_t t4 = clock_us();
+    ntp_waiting = false;
+    udp.stop();
+
+    // Accept only a server mode reply from a synchronized server, to the request we sent
+    uint8_t mode = reply[0] & 7, stratum = reply[1];
+    if ((mode != 4) || (stratum == 0) || (stratum > 15) || memcmp(reply + 24, ntp_packet + 40, 8))
+    {
+        wdata.clock_fails++;
+        log_write(LOG_WARN, LOG_CLOCK, "NTP reply rejected, mode %d, stratum %d", mode, stratum);
+        ntp_next_ms = millis() + NTP_RETRY_MS;
+        return;
+    }
+    int64_t t2 = ntp_to_us(reply + 32); // Server received the request
+    int64_t t3 = ntp_to_us(reply + 40); // Server sent the reply
+    int64_t offset = ((t2 - ntp_t1) + (t3 - t4)) / 2;
+    wdata.clock_rtt_ms = ((t4 - ntp_t1) - (t3 - t2)) / 1000;
+    clock_correct(offset);
+    wdata.clock_syncs++;
+    wdata.clock_sync_at = clock_now();
+    ntp_next_ms = millis() + NTP_SYNC_MS;
+}
+
+// Called from the network task, never blocks
+void clock_loop()
+{
+    if (ntp_waiting)
+        ntp_receive();
+    else if (ntp_resolving)
+        ntp_resolved();
+    else if (wdata.ntp_server[0] && (WiFi.status() == WL_CONNECTED) && (int32_t(millis() - ntp_next_ms) >= 0))
+        ntp_resolve();
+}
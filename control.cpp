@@ -1,17 +1,61 @@
-#include "control.h"
 #include "main.h"
+#include "control.h"
+#include "rom/crc.h"
+
+// Controller state kept in the RTC slow memory which survives a software reset, watchdog and OTA reboot
+// It is not initialized by the boot code, so the magic value and checksum tell whether it is valid
+#define RTC_STATE_MAGIC 0x54485235 // Change it whenever the layout of the structure below changes
+struct ControlRtcState
+{
+    uint32_t magic;
+    uint8_t m_relays;     // Cached state of the relay control byte
+    uint8_t relays;       // Effective state of the relays as written to the PCF8574
+    uint8_t fan_mode;
+    uint8_t ac_mode;
+    uint8_t call;
+    uint8_t stage;
+    temp_t stage_temp;
+    uint32_t stage_sec;
+    uint32_t fan_counter;
+    uint32_t ac_counter;
+    uint32_t fan_sec;
+    temp_t temp;
+    bool temp_valid;
+    uint16_t sensor_health[2]; // Sensor fusion, so that a restart does not throw the effective temperature back
+    uint16_t ext_weight;
+    bool ext_preferred;
+    bool int_offset_set;
+    int32_t int_offset;
+    uint32_t filter_sec;  // Accounting counters which may not have been committed to NV yet
+    uint32_t cool_sec;
+    uint32_t heat_sec;
+    uint32_t filter_wear;
+    uint32_t crc;         // Checksum of all the fields above
+};
+static RTC_NOINIT_ATTR ControlRtcState rtc_state;
+
+static uint32_t rtc_state_crc()
+{
+    return crc32_le(0, (const uint8_t *)&rtc_state, offsetof(ControlRtcState, crc));
+}
 
 static void vTask_control(void *p)
 {
     // Make this task sleep and awake once a second
     const TickType_t xTimePeriod = 1 * 1000 / portTICK_PERIOD_MS;
     TickType_t xLastWakeTime = xTaskGetTickCount();
+    WakeProfile wake { 0, 1000000 };
 
     while(true)
     {
         // Once a second call the control class' tick method
         vTaskDelayUntil(&xLastWakeTime, xTimePeriod);
+        prof_wake(wake, prof_control);
+        task_alive(TASK_CONTROL);
+        if ((wdata.control_ticks % TRACE_CHECKPOINT_TICKS) == 0)
+            static_cast<CControl *>(p)->checkpoint();
         static_cast<CControl *>(p)->tick();
+        wdata.control_ticks++;
 
         wdata.task_control = uxTaskGetStackHighWaterMark(nullptr);
     }
@@ -19,20 +63,23 @@ static void vTask_control(void *p)
 
 CControl::CControl()
 {
-    xTaskCreatePinnedToCore(
+    supervise(
+        TASK_CONTROL,        // Supervisor index of the task
         vTask_control,       // Task function
         "task_control",      // Name of the task
-        1024,                // Stack size in bytes
+        2048,                // Stack size in bytes, watch task_control in stack_watermarks when the tick grows
         this,                // Parameter passed as input to the task
-        tskIDLE_PRIORITY + 2,// Priority of the task
-        nullptr,             // Task handle
-        APP_CPU);            // Core where the task should run (user program core)
+        PRIO_CONTROL,        // Priority of the task
+        CONTROL_CPU,         // Core where the task should run
+        nullptr);            // Periodic task, no input queue
 }
 
 void CControl::tick()
 {
     uint8_t relays = m_relays;
 
+    sensor_fusion();
+
     if (m_fan_counter)
     {
         m_fan_counter--;
@@ -66,60 +113,323 @@ void CControl::tick()
         }
     }
 
-    if (m_ac_counter && wdata.temp_valid) // Control A/C only when the temperature readings are valid
+    if (m_ac_counter && wdata.get_temp_valid()) // Control A/C only when the temperature readings are valid
     {
         m_ac_counter--;
         if (m_ac_counter == 0)
         {
+            temp_t temp = wdata.get_temp();
+            uint8_t call = m_call;
+
             if (m_ac_mode == AC_MODE_OFF)
-                relays |= (PIN_COOL | PIN_HEAT);
+                call = CALL_NONE;
             else if (m_ac_mode == AC_MODE_COOL)
             {
-                bool is_cooling = ((relays & PIN_COOL) == 0);
+                if (call == CALL_HEAT)
+                    call = CALL_NONE;
 
-                if (is_cooling && (wdata.get_temp_f() < (float(wdata.cool_to) - wdata.hyst_release)))
-                    relays |= PIN_COOL;
+                if ((call == CALL_COOL) && (temp < m_cool_off))
+                    call = CALL_NONE;
 
-                if (!is_cooling && (wdata.get_temp_f() > (float(wdata.cool_to) + wdata.hyst_trigger)))
-                    relays &= ~PIN_COOL;
+                if ((call == CALL_NONE) && (temp > m_cool_on))
+                    call = CALL_COOL;
             }
             else if (m_ac_mode == AC_MODE_HEAT)
             {
-                bool is_heating = ((relays & PIN_HEAT) == 0);
+                if (call == CALL_COOL)
+                    call = CALL_NONE;
 
-                if (is_heating && (wdata.get_temp_f() > (float(wdata.heat_to) + wdata.hyst_release)))
-                    relays |= PIN_HEAT;
+                if ((call == CALL_HEAT) && (temp > m_heat_off))
+                    call = CALL_NONE;
 
-                if (!is_heating && (wdata.get_temp_f() <  (float(wdata.heat_to) - wdata.hyst_trigger)))
-                    relays &= ~PIN_HEAT;
+                if ((call == CALL_NONE) && (temp < m_heat_on))
+                    call = CALL_HEAT;
             }
 
-            // Re-evaluate temperature every 30 sec
-            m_ac_counter = 30;
+            if (call != m_call)
+            {
+                m_call = call;
+                m_call_sec = 0;
+                set_stage(1, temp);
+            }
+            else if (call != CALL_NONE)
+            {
+                m_call_sec += wdata.ac_eval_sec;
+                stage(temp);
+                check_delta();
+            }
+
+            // Re-evaluate temperature every ac_eval_sec (30 sec by default)
+            m_ac_counter = wdata.ac_eval_sec;
+
+            if (wdata.first_decision_ms == 0) // Measure how long it took from the boot to control the A/C
+                wdata.first_decision_ms = millis();
         }
     }
+    wdata.call = m_call;
+    wdata.stage = m_stage;
 
-    // Make sure both heating and cooling are not on at the same time
-    if ((relays & (PIN_COOL | PIN_HEAT)) == 0)
-        relays |= (PIN_COOL | PIN_HEAT); // Turn off both cooling and heating in that case
+    // Map the call onto the outputs of the configured equipment
+    relays = outputs(relays);
 
     if (relays != m_relays)
     {
         m_relays = relays;
 
-        // Make sure the fan is on for either heating or cooling
-        if ((relays & (PIN_COOL | PIN_HEAT)) != (PIN_COOL | PIN_HEAT))
-            relays &= ~PIN_FAN; // Turn on fan
+        xI2CMessage xMessage { I2C_SET_RELAYS, interlock(relays) };
+        trace(TRACE_RELAYS, 0, xMessage.bMessage);
+        xQueueSend(xI2CQueue, &xMessage, portMAX_DELAY);
+    }
+
+    if (m_restored)
+        save();
+}
+
+void CControl::set_stage(uint8_t stage, temp_t temp)
+{
+    m_stage = stage;
+    m_stage_sec = 0;
+    m_stage_temp = temp;
+}
+
+// Escalates to the second stage when the first one would take too long to reach the setpoint, and drops back to the
+// first stage when the setpoint is close. The time to the setpoint is projected from the progress since the stage
+// started, which is steadier than the change between two consecutive readings. Called every ac_eval_sec during a call.
+void CControl::stage(temp_t temp)
+{
+    m_stage_sec += wdata.ac_eval_sec;
+    if ((wdata.equipment == EQUIP_SINGLE) || (m_stage_sec < STAGE_MIN_SEC))
+        return;
+
+    // Distance left to the release point and the progress made so far, both positive in the direction of the call
+    bool cooling = (m_call == CALL_COOL);
+    int32_t left = cooling ? (temp - m_cool_off) : (m_heat_off - temp);
+    int32_t progress = cooling ? (m_stage_temp - temp) : (temp - m_stage_temp);
+
+    // Projected seconds to the setpoint, no progress counts as forever. The product of a distance and a long stage
+    // does not fit in 32 bits.
+    uint64_t eta = (progress > 0) ? uint64_t(max(left, 0)) * m_stage_sec / progress : UINT64_MAX;
+    if ((m_stage == 1) && (eta > STAGE_UP_SEC))
+        set_stage(2, temp);
+    else if ((m_stage == 2) && (eta < STAGE_DOWN_SEC))
+        set_stage(1, temp);
+}
+
+// Compares the supply air with the return air once the call ran long enough to settle
+void CControl::check_delta()
+{
+    if ((m_call_sec < DELTA_MIN_SEC) || !wdata.probe_valid[PROBE_SUPPLY] || !wdata.temp_valid)
+        return;
+    wdata.supply_delta = wdata.probe_temp[PROBE_SUPPLY] - wdata.temp;
+    temp_t delta = (m_call == CALL_COOL) ? -wdata.supply_delta : wdata.supply_delta;
+    if (delta < DELTA_MIN)
+        wdata.status |= STATUS_DELTA_LOW;
+    else
+        wdata.status &= ~STATUS_DELTA_LOW;
+}
+
+// Returns the relay control byte for the current call and stage on the configured equipment. Only the fan bit
+// is taken from the input, all the other outputs are derived here. Relays are active low.
+uint8_t CControl::outputs(uint8_t relays)
+{
+    bool heat_pump = (wdata.equipment == EQUIP_HP_O) || (wdata.equipment == EQUIP_HP_B);
+    relays |= PIN_COOL | PIN_HEAT | PIN_MASTER | PIN_COOL2 | PIN_HEAT2 | PIN_OB;
+
+    if (m_call == CALL_COOL)
+    {
+        relays &= ~PIN_COOL;
+        if (m_stage == 2)
+            relays &= ~PIN_COOL2;
+    }
+    else if (m_call == CALL_HEAT)
+    {
+        relays &= heat_pump ? ~PIN_COOL : ~PIN_HEAT; // A heat pump heats with its compressor
+        if (m_stage == 2)
+            relays &= ~PIN_HEAT2; // Second stage heat, or the aux heat of a heat pump
+    }
+
+    // The reversing valve stays in the position of the A/C mode, so it does not switch at every cycle
+    if (((wdata.equipment == EQUIP_HP_O) && (m_ac_mode == AC_MODE_COOL)) ||
+        ((wdata.equipment == EQUIP_HP_B) && (m_ac_mode == AC_MODE_HEAT)))
+        relays &= ~PIN_OB;
+
+    return relays;
+}
+
+// All the interlock rules between the relays, checked in one place on the final relay byte (active low)
+uint8_t CControl::interlock(uint8_t relays)
+{
+    uint8_t on = ~relays;
+    bool heat_pump = (wdata.equipment == EQUIP_HP_O) || (wdata.equipment == EQUIP_HP_B);
+
+    if (heat_pump)
+    {
+        on &= ~PIN_HEAT; // W1 is not used by a heat pump
+        // Never run the aux heat while the compressor is cooling
+        bool valve_cool = (wdata.equipment == EQUIP_HP_O) ? (on & PIN_OB) : !(on & PIN_OB);
+        if ((on & PIN_COOL) && valve_cool)
+            on &= ~PIN_HEAT2;
+    }
+    else
+    {
+        on &= ~PIN_OB; // No reversing valve without a heat pump
+        // Make sure both heating and cooling are not on at the same time, turn off both in that case
+        if ((on & (PIN_COOL | PIN_COOL2)) && (on & (PIN_HEAT | PIN_HEAT2)))
+            on &= ~(PIN_COOL | PIN_COOL2 | PIN_HEAT | PIN_HEAT2);
+        // Second heating stage only together with the first one
+        if (!(on & PIN_HEAT))
+            on &= ~PIN_HEAT2;
+    }
+    // Second compressor stage only together with the first one
+    if (!(on & PIN_COOL))
+        on &= ~PIN_COOL2;
+    // Single stage equipment does not have any second stage outputs wired
+    if (wdata.equipment == EQUIP_SINGLE)
+        on &= ~(PIN_COOL2 | PIN_HEAT2 | PIN_OB);
+
+    // Make sure the fan is on for either heating or cooling
+    if (on & (PIN_COOL | PIN_HEAT | PIN_COOL2 | PIN_HEAT2))
+        on |= PIN_FAN;
+
+    // Turn on master relay when any other is active, or turn it off otherwise
+    if (on & (PIN_FAN | PIN_COOL | PIN_HEAT | PIN_COOL2 | PIN_HEAT2))
+        on |= PIN_MASTER;
+    else
+        on &= ~PIN_MASTER;
+
+    return ~on;
+}
+
+// Stores the controller state in the RTC memory, called every second
+void CControl::save()
+{
+    rtc_state.magic = RTC_STATE_MAGIC;
+    rtc_state.m_relays = m_relays;
+    rtc_state.relays = wdata.relays;
+    rtc_state.fan_mode = m_fan_mode;
+    rtc_state.ac_mode = m_ac_mode;
+    rtc_state.call = m_call;
+    rtc_state.stage = m_stage;
+    rtc_state.stage_temp = m_stage_temp;
+    rtc_state.stage_sec = m_stage_sec;
+    rtc_state.fan_counter = m_fan_counter;
+    rtc_state.ac_counter = m_ac_counter;
+    rtc_state.fan_sec = wdata.fan_sec;
+    rtc_state.temp = wdata.temp;
+    rtc_state.temp_valid = wdata.temp_valid;
+    memcpy(rtc_state.sensor_health, wdata.sensor_health, sizeof(rtc_state.sensor_health));
+    rtc_state.ext_weight = wdata.ext_weight;
+    rtc_state.ext_preferred = wdata.ext_preferred;
+    rtc_state.int_offset_set = wdata.int_offset_set;
+    rtc_state.int_offset = wdata.int_offset;
+    rtc_state.filter_sec = wdata.filter_sec;
+    rtc_state.cool_sec = wdata.cool_sec;
+    rtc_state.heat_sec = wdata.heat_sec;
+    rtc_state.filter_wear = wdata.filter_wear;
+    rtc_state.crc = rtc_state_crc();
+}
 
-        // Turn on master relay when any other is active, or turn it off otherwise
-        if ((relays & (PIN_FAN | PIN_COOL | PIN_HEAT)) == (PIN_FAN | PIN_COOL | PIN_HEAT))
-            relays |= PIN_MASTER; // Turn off master if the other three relays are also off
-        else
-            relays &= ~PIN_MASTER; // Turn on master otherwise
+// On a warm restart (software reset, watchdog, panic), resume the controller from the state saved in the RTC memory
+// and immediately re-assert the relays. Returns false on a cold boot, or if the saved state is not valid, in which
+// case the caller should take the conservative path and let the controller decide after its usual delays.
+bool CControl::restore()
+{
+    m_restored = true;
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool cold = (reason == ESP_RST_POWERON) || (reason == ESP_RST_BROWNOUT) || (reason == ESP_RST_UNKNOWN);
 
-        xI2CMessage xMessage { I2C_SET_RELAYS, relays };
+    if (cold || (rtc_state.magic != RTC_STATE_MAGIC) || (rtc_state.crc != rtc_state_crc()))
+    {
+        rtc_state.magic = 0;
+        // Start from a known state with all relays off
+        xI2CMessage xMessage { I2C_SET_RELAYS, 0xFF };
         xQueueSend(xI2CQueue, &xMessage, portMAX_DELAY);
+        return false;
     }
+
+    wdata.fan_mode = rtc_state.fan_mode;
+    wdata.ac_mode = rtc_state.ac_mode;
+    wdata.fan_sec = rtc_state.fan_sec;
+    wdata.temp = rtc_state.temp;
+    wdata.temp_valid = rtc_state.temp_valid;
+    memcpy(wdata.sensor_health, rtc_state.sensor_health, sizeof(wdata.sensor_health));
+    wdata.ext_weight = rtc_state.ext_weight;
+    wdata.ext_preferred = rtc_state.ext_preferred;
+    wdata.int_offset_set = rtc_state.int_offset_set;
+    wdata.int_offset = rtc_state.int_offset;
+    // Accounting counters in the RTC memory are never older than the ones committed to NV
+    wdata.filter_sec = max(wdata.filter_sec, rtc_state.filter_sec);
+    wdata.cool_sec = max(wdata.cool_sec, rtc_state.cool_sec);
+    wdata.heat_sec = max(wdata.heat_sec, rtc_state.heat_sec);
+    wdata.filter_wear = max(wdata.filter_wear, rtc_state.filter_wear);
+
+    m_fan_mode = rtc_state.fan_mode;
+    m_ac_mode = rtc_state.ac_mode;
+    m_call = rtc_state.call;
+    m_stage = rtc_state.stage;
+    m_stage_temp = rtc_state.stage_temp;
+    m_stage_sec = rtc_state.stage_sec;
+    m_fan_counter = rtc_state.fan_counter;
+    m_ac_counter = rtc_state.ac_counter;
+    m_relays = rtc_state.m_relays;
+    update_thresholds();
+
+    xI2CMessage xMessage { I2C_SET_RELAYS, rtc_state.relays };
+    xQueueSend(xI2CQueue, &xMessage, portMAX_DELAY);
+    wdata.warm_boot = true;
+    checkpoint(); // The restored state is where a trace of this boot starts
+    return true;
+}
+
+// Records the whole controller state into the input trace, a replay of the trace starts from a checkpoint
+void CControl::checkpoint()
+{
+    const uint32_t state[][2]
+    {
+        { TRACE_F_FAN_MODE, m_fan_mode }, { TRACE_F_AC_MODE, m_ac_mode }, { TRACE_F_COOL_TO, uint16_t(wdata.cool_to) },
+        { TRACE_F_HEAT_TO, uint16_t(wdata.heat_to) }, { TRACE_F_HYST_TRIGGER, uint16_t(wdata.hyst_trigger) },
+        { TRACE_F_HYST_RELEASE, uint16_t(wdata.hyst_release) }, { TRACE_F_EQUIPMENT, wdata.equipment },
+        { TRACE_F_FAN_SEC, wdata.fan_sec }, { TRACE_F_RELAYS, m_relays }, { TRACE_F_CALL, m_call },
+        { TRACE_F_STAGE, m_stage }, { TRACE_F_STAGE_TEMP, uint16_t(m_stage_temp) }, { TRACE_F_STAGE_SEC, m_stage_sec },
+        { TRACE_F_CALL_SEC, m_call_sec }, { TRACE_F_FAN_COUNTER, m_fan_counter }, { TRACE_F_AC_COUNTER, m_ac_counter },
+        { TRACE_F_AC_EVAL_SEC, wdata.ac_eval_sec }, { TRACE_F_FUSION, wdata.fusion },
+        { TRACE_F_HEALTH_INT, wdata.sensor_health[SENSOR_INT] }, { TRACE_F_HEALTH_EXT, wdata.sensor_health[SENSOR_EXT] },
+        { TRACE_F_EXT_WEIGHT, wdata.ext_weight }, { TRACE_F_FUSION_FLAGS, uint32_t(wdata.ext_preferred | (wdata.int_offset_set << 1)) },
+        { TRACE_F_INT_OFFSET, uint32_t(wdata.int_offset) },
+    };
+    trace_checkpoint(state, sizeof(state) / sizeof(state[0]));
+}
+
+// Sets a field of the controller state from a trace checkpoint, used by the trace replay
+void CControl::set_state(uint8_t field, uint32_t value)
+{
+    switch (field)
+    {
+        case TRACE_F_FAN_MODE:     m_fan_mode = wdata.fan_mode = value; break;
+        case TRACE_F_AC_MODE:      m_ac_mode = wdata.ac_mode = value; break;
+        case TRACE_F_COOL_TO:      wdata.cool_to = value; break;
+        case TRACE_F_HEAT_TO:      wdata.heat_to = value; break;
+        case TRACE_F_HYST_TRIGGER: wdata.hyst_trigger = value; break;
+        case TRACE_F_HYST_RELEASE: wdata.hyst_release = value; break;
+        case TRACE_F_EQUIPMENT:    wdata.equipment = value; break;
+        case TRACE_F_FAN_SEC:      wdata.fan_sec = value; break;
+        case TRACE_F_RELAYS:       m_relays = value; break;
+        case TRACE_F_CALL:         m_call = value; break;
+        case TRACE_F_STAGE:        m_stage = value; break;
+        case TRACE_F_STAGE_TEMP:   m_stage_temp = value; break;
+        case TRACE_F_STAGE_SEC:    m_stage_sec = value; break;
+        case TRACE_F_CALL_SEC:     m_call_sec = value; break;
+        case TRACE_F_FAN_COUNTER:  m_fan_counter = value; break;
+        case TRACE_F_AC_COUNTER:   m_ac_counter = value; break;
+        case TRACE_F_AC_EVAL_SEC:  wdata.ac_eval_sec = value; break;
+        case TRACE_F_FUSION:       wdata.fusion = value; break;
+        case TRACE_F_HEALTH_INT:   wdata.sensor_health[SENSOR_INT] = value; break;
+        case TRACE_F_HEALTH_EXT:   wdata.sensor_health[SENSOR_EXT] = value; break;
+        case TRACE_F_EXT_WEIGHT:   wdata.ext_weight = value; break;
+        case TRACE_F_FUSION_FLAGS: wdata.ext_preferred = value & 1; wdata.int_offset_set = value & 2; break;
+        case TRACE_F_INT_OFFSET:   wdata.int_offset = value; break;
+    }
+    update_thresholds();
 }
 
 void CControl::set_fan_mode(uint8_t mode)
@@ -134,6 +444,8 @@ void CControl::set_fan_mode(uint8_t mode)
     // Set the new value into an NV variable
     pref_set("fan_mode", mode);
 
+    trace(TRACE_SET, TRACE_F_FAN_MODE, mode);
+
     // Initiate fan change
     m_fan_counter = 5; // 5 sec to fan change
     m_fan_mode = mode;
@@ -148,34 +460,67 @@ void CControl::set_ac_mode(uint8_t mode)
     // Set the new value into an NV variable
     pref_set("ac_mode", mode);
 
+    trace(TRACE_SET, TRACE_F_AC_MODE, mode);
+
     // Initiate A/C change
     m_ac_counter = 30; // 30 sec to A/C mode change
     m_ac_mode = mode;
     wdata.ac_mode = mode;
 }
 
-void CControl::set_cool_to(uint8_t temp)
+void CControl::set_cool_to(temp_t temp, bool commit)
 {
-    temp = constrain(temp, 60, 90);
+    temp = constrain(temp, SETPOINT_MIN, SETPOINT_MAX);
 
-    // Set the new value into an NV variable
-    pref_set("cool_to", temp);
+    // Set the new value into an NV variable, unless the caller will commit it later
+    if (commit)
+        pref_set("cool_to_t", temp);
+    trace(TRACE_SET, TRACE_F_COOL_TO, temp);
 
     // Initiate A/C change
     m_ac_counter = 30; // 30 sec to A/C mode change
     wdata.cool_to = temp;
+    update_thresholds();
 }
 
-void CControl::set_heat_to(uint8_t temp)
+void CControl::set_heat_to(temp_t temp, bool commit)
 {
-    temp = constrain(temp, 60, 90);
+    temp = constrain(temp, SETPOINT_MIN, SETPOINT_MAX);
 
-    // Set the new value into an NV variable
-    pref_set("heat_to", temp);
+    // Set the new value into an NV variable, unless the caller will commit it later
+    if (commit)
+        pref_set("heat_to_t", temp);
+    trace(TRACE_SET, TRACE_F_HEAT_TO, temp);
 
     // Initiate A/C change
     m_ac_counter = 30; // 30 sec to A/C mode change
     wdata.heat_to = temp;
+    update_thresholds();
+}
+
+void CControl::set_hysteresis(temp_t trigger, temp_t release, bool commit)
+{
+    trigger = constrain(trigger, 0, TEMP_DELTA_FROM_F(10));
+    release = constrain(release, 0, TEMP_DELTA_FROM_F(10));
+
+    if (commit)
+    {
+        pref_set("hyst_trig_t", trigger);
+        pref_set("hyst_rel_t", release);
+    }
+    trace(TRACE_SET, TRACE_F_HYST_TRIGGER, trigger);
+    trace(TRACE_SET, TRACE_F_HYST_RELEASE, release);
+    wdata.hyst_trigger = trigger;
+    wdata.hyst_release = release;
+    update_thresholds();
+}
+
+void CControl::update_thresholds()
+{
+    m_cool_on = wdata.cool_to + wdata.hyst_trigger;
+    m_cool_off = wdata.cool_to - wdata.hyst_release;
+    m_heat_on = wdata.heat_to - wdata.hyst_trigger;
+    m_heat_off = wdata.heat_to + wdata.hyst_release;
 }
 
 // Based on the effective relay configuration, add fan and A/C usage
@@ -186,29 +531,58 @@ bool CControl::accounting(uint8_t relays)
     if (~relays & PIN_MASTER) // Do accounting only if the master relay is on
     {
         if (~relays & PIN_FAN)
+        {
             wdata.filter_sec++, changed = true;
-        if (~relays & PIN_COOL)
+
+            // A filter wears faster with the higher airflow of heating and cooling, and the most with the second stage
+            uint32_t wear = (wdata.call == CALL_NONE) ? FILTER_WEAR_FAN : (wdata.stage == 2) ? FILTER_WEAR_STAGE2 : FILTER_WEAR_STAGE1;
+            m_filter_frac += wear;
+            wdata.filter_wear += m_filter_frac / 100;
+            m_filter_frac %= 100;
+        }
+        if (wdata.call == CALL_COOL)
             wdata.cool_sec++, changed = true;
-        if (~relays & PIN_HEAT)
+        if (wdata.call == CALL_HEAT)
             wdata.heat_sec++, changed = true;
     }
+    if (filter_pct() == 0)
+        wdata.status |= STATUS_FILTER_DUE;
     return changed;
 }
 
+// Starts counting the wear of a new filter
+void CControl::filter_reset()
+{
+    wdata.filter_wear = 0;
+    m_filter_frac = 0;
+    wdata.status &= ~STATUS_FILTER_DUE;
+    pref_set("filter_wear", wdata.filter_wear);
+}
+
+// Returns the remaining life of the filter in percent
+uint8_t CControl::filter_pct()
+{
+    uint32_t life = max(wdata.filter_life_h, 1U) * 3600;
+    if (wdata.filter_wear >= life)
+        return 0;
+    return 100 - uint64_t(wdata.filter_wear) * 100 / life;
+}
+
 // Implements a simple temperature model to test the thermostat
-// Called every 5 sec when USE_MODEL is 1
-float CControl::model_get_temperature()
+// Called every 30 sec when USE_MODEL is 1
+temp_t CControl::model_get_temperature()
 {
     // Room is naturally getting cooler or hotter
     m_tcurrent += m_tdambience;
 
-    if ((~wdata.relays & PIN_MASTER) && (~wdata.relays & PIN_HEAT))
+    // Each running stage adds the same amount of heating or cooling
+    if ((~wdata.relays & PIN_MASTER) && (wdata.call == CALL_HEAT))
     {
-        m_tcurrent += m_tdheating;
+        m_tcurrent += m_tdheating * wdata.stage;
     }
-    if ((~wdata.relays & PIN_MASTER) && (~wdata.relays & PIN_COOL))
+    if ((~wdata.relays & PIN_MASTER) && (wdata.call == CALL_COOL))
     {
-        m_tcurrent -= m_tdcooling;
+        m_tcurrent -= m_tdcooling * wdata.stage;
     }
-    return (m_tcurrent - 32.0) * (5.0/9.0); // Return temperature in C
+    return m_tcurrent;
 }
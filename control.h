@@ -1,10 +1,28 @@
 #include <Arduino.h>
 
 // Define function on the PCF8574 gpio pins
-#define PIN_FAN     (1 << 0)
-#define PIN_COOL    (1 << 1)
-#define PIN_HEAT    (1 << 2)
+#define PIN_FAN     (1 << 0)  // G
+#define PIN_COOL    (1 << 1)  // Y1, first stage cooling, or the heat pump compressor
+#define PIN_HEAT    (1 << 2)  // W1, first stage heating (not used with a heat pump)
 #define PIN_MASTER  (1 << 3)
+#define PIN_COOL2   (1 << 4)  // Y2, second stage cooling, or the heat pump compressor second stage
+#define PIN_HEAT2   (1 << 5)  // W2, second stage heating, or the heat pump aux heat
+#define PIN_OB      (1 << 6)  // O/B, heat pump reversing valve
+
+// Filter wear per second of the fan running, in percent of a nominal second, weighted by the airflow of the mode
+#define FILTER_WEAR_FAN     60 // Fan only, circulating
+#define FILTER_WEAR_STAGE1 100 // First stage heating or cooling
+#define FILTER_WEAR_STAGE2 140 // Second stage, the blower runs at its high speed
+
+// A heating or cooling call which ran this long should have moved the supply air at least this far from the
+// return air, a smaller difference points to a failing compressor or burner
+#define DELTA_MIN_SEC  (10 * 60)
+#define DELTA_MIN      TEMP_DELTA_FROM_F(8)
+
+// Stage escalation timing
+#define STAGE_MIN_SEC   (5 * 60)  // Run a stage at least this long before judging its progress
+#define STAGE_UP_SEC   (15 * 60)  // Escalate to the second stage if the setpoint is farther away than this
+#define STAGE_DOWN_SEC  (5 * 60)  // Drop back to the first stage once the setpoint is closer than this
 
 class CControl
 {
@@ -13,10 +31,25 @@ public:
     void tick();
     void set_fan_mode(uint8_t mode);
     void set_ac_mode(uint8_t mode);
-    void set_cool_to(uint8_t temp);
-    void set_heat_to(uint8_t temp);
+    void set_cool_to(temp_t temp, bool commit = true);
+    void set_heat_to(temp_t temp, bool commit = true);
+    void set_hysteresis(temp_t trigger, temp_t release, bool commit = true);
     bool accounting(uint8_t relays);
-    float model_get_temperature();
+    void filter_reset();
+    uint8_t filter_pct();
+    temp_t model_get_temperature();
+    bool restore();
+    void checkpoint();
+    void set_state(uint8_t field, uint32_t value);
+
+private:
+    void save();
+    void update_thresholds();
+    void set_stage(uint8_t stage, temp_t temp);
+    void stage(temp_t temp);
+    uint8_t outputs(uint8_t relays);
+    uint8_t interlock(uint8_t relays);
+    void check_delta();
 
 private:
     uint8_t m_relays {0xFF}; // Cached state of the relay control byte
@@ -25,12 +58,25 @@ private:
     uint8_t  m_fan_mode    {0};
     uint32_t m_ac_counter  {0};
     uint8_t  m_ac_mode     {0};
+    uint8_t  m_call        {0}; // Current call for heating or cooling (CALL_*)
+    uint8_t  m_stage       {1}; // Current stage of the call
+    uint32_t m_stage_sec   {0}; // Seconds the current stage has been running
+    uint32_t m_call_sec    {0}; // Seconds the current call has been running
+    temp_t   m_stage_temp  {0}; // Temperature when the current stage started
+    uint32_t m_filter_frac {0}; // Filter wear below one nominal second, in percent
+    bool     m_restored    {false}; // Set once restore() has run; the RTC state is not overwritten before that
+
+    // Temperature thresholds precomputed from the setpoints and the hysteresis, so the tick uses only integer compares
+    temp_t   m_cool_on     {0}; // Start cooling above this temperature
+    temp_t   m_cool_off    {0}; // Stop cooling below this temperature
+    temp_t   m_heat_on     {0}; // Start heating below this temperature
+    temp_t   m_heat_off    {0}; // Stop heating above this temperature
 private:
-    // Implements a simple temperature model to test the thermostat
-    float m_tcurrent         { 78.0 }; // Default starting temperature
-    const float m_tdambience { +0.1 }; // Ambience change of temperature
-    const float m_tdheating  {  0.3 }; // Heating efficiency
-    const float m_tdcooling  {  0.3 }; // Cooling efficiency
+    // Implements a simple temperature model to test the thermostat, in the same fixed-point as the sensor readings
+    temp_t m_tcurrent         { 2556 }; // Default starting temperature (78 F)
+    const temp_t m_tdambience {   +6 }; // Ambience change of temperature (+0.1 F)
+    const temp_t m_tdheating  {   17 }; // Heating efficiency (0.3 F)
+    const temp_t m_tdcooling  {   17 }; // Cooling efficiency (0.3 F)
 };
 
 extern CControl control;
@@ -0,0 +1,161 @@
+#include "main.h"
+#include "control.h"
+#include "rom/crc.h"
+
+// Energy and cost accounting
+//
+// Every second, the fan, cooling and heating run time is added into a bucket for the current hour and for the
+// current day, together with the number of started cooling and heating cycles and the energy used. The energy is
+// estimated from the relays which are on and the configured wattage of the equipment behind each one, and it is
+// split into the base and the peak tariff period, so that the cost is computed at the time of a report.
+//
+// Hours and days follow the local time once wdata.timestamp has been set: the Unix time moved by the UTC offset
+// (/set?utc_offset=<minutes>), so that the days start at the local midnight and the peak tariff hours are local
+// hours. The offset is fixed, it has to be set again when the daylight saving time starts and ends; the hour it
+// changes in is counted into the bucket of the new hour. Before the clock is set, they follow the uptime. The buckets
+// are kept in the RTC memory, so they survive a software reset, a watchdog and an OTA reboot.
+
+#define ENERGY_HOURS  24 // Number of hourly buckets
+#define ENERGY_DAYS    7 // Number of daily buckets
+#define ENERGY_MAGIC  0x454E5231 // Change it whenever the layout of the structures below changes
+
+struct EnergyBucket
+{
+    uint32_t start;       // Hour or day number this bucket is counting
+    uint32_t fan_sec;     // Fan run time
+    uint32_t cool_sec;    // Cooling call time
+    uint32_t heat_sec;    // Heating call time
+    uint16_t cool_cycles; // Number of cooling calls started
+    uint16_t heat_cycles; // Number of heating calls started
+    uint32_t base_ws;     // Energy used during the base tariff period, in watt-seconds
+    uint32_t peak_ws;     // Energy used during the peak tariff period, in watt-seconds
+};
+
+struct EnergyRtcState
+{
+    uint32_t magic;
+    EnergyBucket hours[ENERGY_HOURS]; // Circular buffers indexed by the hour and the day number
+    EnergyBucket days[ENERGY_DAYS];
+    uint32_t crc;         // Checksum of all the fields above
+};
+
+static RTC_NOINIT_ATTR EnergyRtcState energy;
+static uint8_t last_call = CALL_NONE;
+
+static uint32_t energy_crc()
+{
+    return crc32_le(0, (const uint8_t *)&energy, offsetof(EnergyRtcState, crc));
+}
+
+// Returns the bucket counting the given hour or day number, recycling the oldest one when it starts
+static EnergyBucket &energy_bucket(EnergyBucket *buckets, int count, uint32_t start)
+{
+    EnergyBucket &b = buckets[start % count];
+    if (b.start != start)
+    {
+        memset(&b, 0, sizeof(EnergyBucket));
+        b.start = start;
+    }
+    return b;
+}
+
+static void energy_add(EnergyBucket &b, bool fan, uint8_t call, bool started, bool peak, uint32_t watts)
+{
+    b.fan_sec += fan;
+    b.cool_sec += (call == CALL_COOL);
+    b.heat_sec += (call == CALL_HEAT);
+    b.cool_cycles += started && (call == CALL_COOL);
+    b.heat_cycles += started && (call == CALL_HEAT);
+    if (peak)
+        b.peak_ws += watts;
+    else
+        b.base_ws += watts;
+}
+
+static uint32_t energy_clock()
+{
+    return wdata.timestamp ? wdata.timestamp + int32_t(wdata.utc_offset_min) * 60 : wdata.seconds;
+}
+
+// Returns true if the hour of the day falls into the peak tariff period, which may wrap over midnight
+static bool energy_peak(uint32_t hour)
+{
+    hour %= 24;
+    if (wdata.peak_start <= wdata.peak_end)
+        return (hour >= wdata.peak_start) && (hour < wdata.peak_end);
+    return (hour >= wdata.peak_start) || (hour < wdata.peak_end);
+}
+
+void setup_energy()
+{
+    // Keep the buckets of the previous run only if they are intact, the RTC memory is random after a power-on
+    if ((energy.magic != ENERGY_MAGIC) || (energy.crc != energy_crc()))
+    {
+        memset(&energy, 0, sizeof(energy));
+        energy.magic = ENERGY_MAGIC;
+        energy.crc = energy_crc();
+    }
+}
+
+// Called every second with the effective relay control byte (active low)
+void energy_tick(uint8_t relays)
+{
+    uint8_t call = wdata.call;
+    bool on = ~relays & PIN_MASTER;
+    bool fan = on && (~relays & PIN_FAN);
+    bool started = (call != CALL_NONE) && (call != last_call);
+    last_call = call;
+    if (!on)
+        call = CALL_NONE;
+
+    uint32_t watts = 0;
+    if (on)
+    {
+        watts += (~relays & PIN_FAN) ? wdata.fan_w : 0;
+        watts += (~relays & PIN_COOL) ? wdata.cool_w : 0; // The compressor, also when a heat pump is heating
+        watts += (~relays & PIN_COOL2) ? wdata.cool2_w : 0;
+        watts += (~relays & PIN_HEAT) ? wdata.heat_w : 0;
+        watts += (~relays & PIN_HEAT2) ? wdata.heat2_w : 0;
+    }
+
+    uint32_t hour = energy_clock() / 3600;
+    bool peak = energy_peak(hour);
+    energy_add(energy_bucket(energy.hours, ENERGY_HOURS, hour), fan, call, started, peak, watts);
+    energy_add(energy_bucket(energy.days, ENERGY_DAYS, hour / 24), fan, call, started, peak, watts);
+    energy.crc = energy_crc();
+}
+
+// Prints the buckets from the oldest to the current one, each one as an array:
+// [ start, fan_sec, cool_sec, heat_sec, cool_cycles, heat_cycles, avg_cycle_sec, wh, cost ]
+static int print_buckets(char *p, const EnergyBucket *buckets, int count, uint32_t now)
+{
+    char *s = p;
+    bool first = true;
+    for (uint32_t start = now - min(now, uint32_t(count - 1)); start <= now; start++)
+    {
+        const EnergyBucket &b = buckets[start % count];
+        if (b.start != start)
+            continue;
+        uint32_t cycles = b.cool_cycles + b.heat_cycles;
+        uint32_t avg_cycle = cycles ? (b.cool_sec + b.heat_sec) / cycles : 0;
+        uint32_t wh = (b.base_ws + b.peak_ws) / 3600;
+        // Tariffs are in 1/1000 of the currency unit per kWh, cost is reported in 1/100 of the currency unit
+        uint32_t cost = (uint64_t(b.base_ws) * wdata.tariff_base + uint64_t(b.peak_ws) * wdata.tariff_peak) / 36000000;
+        p += sprintf(p, "%s[%d,%d,%d,%d,%d,%d,%d,%d,%d]", first ? "" : ",",
+            b.start, b.fan_sec, b.cool_sec, b.heat_sec, b.cool_cycles, b.heat_cycles, avg_cycle, wh, cost);
+        first = false;
+    }
+    return p - s;
+}
+
+// Prints the energy report as json into the given buffer
+void get_energy_json(char *p)
+{
+    uint32_t hour = energy_clock() / 3600;
+    p += sprintf(p, "{ \"clock\":\"%s\", \"utc_offset\":%d, \"hour\":%d, \"hours\":[", wdata.timestamp ? "local" : "uptime",
+        wdata.utc_offset_min, hour);
+    p += print_buckets(p, energy.hours, ENERGY_HOURS, hour);
+    p += sprintf(p, "], \"days\":[");
+    p += print_buckets(p, energy.days, ENERGY_DAYS, hour / 24);
+    p += sprintf(p, "] }");
+}
@@ -0,0 +1,152 @@
+#include "main.h"
+#include <ESPAsyncWebServer.h>
+
+// Diagnostic log, read from /log instead of the serial port
+//
+// A record is written into a ring in RAM as it is: the level, the subsystem tag, the esp_timer time, a pointer to
+// the format string and the raw arguments. Nothing is formatted and nothing is locked, so a record costs about as
+// much as a few stores: the writer reserves its slot with an atomic increment of the sequence number, fills it,
+// and publishes it by storing its sequence number last. It can be called from any task, on either core, and from
+// an ISR (the format string is not even read). A reader copies a record and checks that its sequence number was
+// the same before and after the copy, so a record which was being overwritten is skipped, never shown half old.
+// The records are formatted only when /log is read: "/log?since=<seq>&level=<0..3>" returns, as text, the records
+// from <seq> on (all of them by default) at or above the level, behind a header line with the next sequence number
+// to ask for. The ring keeps the newest LOG_RECORDS records; a record overwritten before any /log request returned
+// it is counted as dropped. The cost of the writes is measured with the CPU cycle counter and shown in /prof.
+
+#define LOG_RECORDS  256 // 10 KB
+#define LOG_ARGS       4
+#define LOG_LINE     160 // Longest line of the text output, longer messages are cut
+
+struct LogRecord
+{
+    uint32_t seq;         // Sequence number of the record + 1, 0 while it is being written
+    uint8_t level;        // LOG_DEBUG..LOG_ERROR
+    uint8_t tag;          // LOG_SYS..
+    const char *fmt;      // printf format string
+    int64_t us;           // esp_timer time when it was written
+    uintptr_t args[LOG_ARGS];
+};
+
+static LogRecord ring[LOG_RECORDS];
+static uint32_t log_next = 0;         // Sequence number of the next record, which goes to log_next % LOG_RECORDS
+static uint32_t log_read = 0;         // All the records before this one were returned by /log
+// Cost of the writes; updated without a lock, so a sample may be lost when two writes race
+static uint64_t log_cycles = 0;
+static uint32_t log_cycles_max = 0;
+
+static const char *const log_tags[] { "sys", "wifi", "mdns", "ext", "ota", "sv", "clock", "mqtt" };
+
+void IRAM_ATTR log_write(uint8_t level, uint8_t tag, const char *fmt, uintptr_t a0, uintptr_t a1, uintptr_t a2, uintptr_t a3)
+{
+    uint32_t start = ESP.getCycleCount();
+    uint32_t seq = __atomic_fetch_add(&log_next, 1, __ATOMIC_RELAXED);
+    LogRecord &r = ring[seq % LOG_RECORDS];
+    if (seq - __atomic_load_n(&log_read, __ATOMIC_RELAXED) >= LOG_RECORDS)
+        __atomic_fetch_add(&wdata.log_dropped, 1, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&r.seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // A reader sees the record as invalid before any field changes
+    r.level = level;
+    r.tag = tag;
+    r.fmt = fmt;
+    r.us = esp_timer_get_time();
+    r.args[0] = a0;
+    r.args[1] = a1;
+    r.args[2] = a2;
+    r.args[3] = a3;
+    __atomic_store_n(&r.seq, seq + 1, __ATOMIC_RELEASE);
+
+    uint32_t cycles = ESP.getCycleCount() - start;
+    log_cycles += cycles;
+    if (cycles > log_cycles_max)
+        log_cycles_max = cycles;
+}
+
+// Copies the record with the sequence number, returns false if it was overwritten or is being written
+static bool log_copy(uint32_t seq, LogRecord &copy)
+{
+    const LogRecord &r = ring[seq % LOG_RECORDS];
+    if (__atomic_load_n(&r.seq, __ATOMIC_ACQUIRE) != seq + 1)
+        return false;
+    memcpy(&copy, &r, sizeof(LogRecord));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&r.seq, __ATOMIC_RELAXED) == seq + 1;
+}
+
+// Formats a record as a line: sequence number, uptime in seconds, level, tag and the message
+static int log_render(char *p, const LogRecord &r)
+{
+    int n = sprintf(p, "%u %u.%03u %c %s ", r.seq - 1, uint32_t(r.us / 1000000), uint32_t(r.us / 1000 % 1000),
+        "DIWE"[r.level & 3], (r.tag < sizeof(log_tags) / sizeof(log_tags[0])) ? log_tags[r.tag] : "?");
+    n += snprintf(p + n, LOG_LINE - 1 - n, r.fmt, r.args[0], r.args[1], r.args[2], r.args[3]);
+    n = min(n, LOG_LINE - 2);
+    p[n++] = '\n';
+    p[n] = 0;
+    return n;
+}
+
+// Prints the cost of the log writes as json into the given space, returns the length snprintf does
+int get_log_prof_json(char *p, size_t size)
+{
+    uint32_t writes = log_next;
+    uint32_t mhz = max(wdata.cpu_mhz, 1U);
+    return snprintf(p, size, "\"log\":{\"writes\":%u, \"dropped\":%u, \"mean_ns\":%u, \"max_ns\":%u}", writes, wdata.log_dropped,
+        writes ? uint32_t(log_cycles * 1000 / mhz / writes) : 0, log_cycles_max * 1000 / mhz);
+}
+
+void handleLog(AsyncWebServerRequest *request)
+{
+    // State of the download, kept by each download in its own callback so that downloads at the same time do not
+    // disturb each other
+    uint32_t end = __atomic_load_n(&log_next, __ATOMIC_ACQUIRE);
+    uint32_t oldest = end - min(end, uint32_t(LOG_RECORDS));
+    uint32_t cursor = strtoul(request_arg(request, "since"), nullptr, 10);
+    if (int32_t(cursor - oldest) < 0)
+        cursor = oldest;
+    if (int32_t(end - cursor) < 0)
+        cursor = end;
+    uint8_t level = atoi(request_arg(request, "level"));
+    uint32_t lost = 0;
+
+    AsyncWebServerResponse *response = request->beginChunkedResponse("text/plain",
+        [cursor, end, lost, level](uint8_t *buf, size_t max_len, size_t index) mutable -> size_t
+    {
+        // Sends whole lines only, the response asks again for the rest
+        char line[LOG_LINE];
+        size_t n = 0;
+        if (index == 0)
+        {
+            int64_t now = esp_timer_get_time();
+            n = sprintf((char *)buf, "# next %u, dropped %u, uptime %u.%03u, time %u\n", end, wdata.log_dropped,
+                uint32_t(now / 1000000), uint32_t(now / 1000 % 1000), clock_now());
+        }
+        while (cursor != end)
+        {
+            LogRecord r;
+            if (!log_copy(cursor, r))
+                lost++;
+            else if (r.level >= level)
+            {
+                int len = log_render(line, r);
+                if (n + len > max_len)
+                    break;
+                memcpy(buf + n, line, len);
+                n += len;
+            }
+            cursor++;
+        }
+        if ((cursor == end) && (n < max_len))
+        {
+            if (lost && (n + 48 < max_len))
+            {
+                n += sprintf((char *)buf + n, "# %u records overwritten during the download\n", lost);
+                lost = 0;
+            }
+            if (int32_t(end - __atomic_load_n(&log_read, __ATOMIC_RELAXED)) > 0)
+                __atomic_store_n(&log_read, end, __ATOMIC_RELAXED);
+        }
+        return n;
+    });
+    request->send(response);
+}
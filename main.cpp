@@ -15,6 +15,96 @@ Preferences pref;
 OneWire oneWire(ONE_WIRE_BUS);
 // Pass oneWire reference to DallasTemperature library
 DallasTemperature sensors(&oneWire);
+
+// Probes are enumerated once at boot and then addressed by their ROM codes. One broadcast conversion runs on all
+// of them at once, and a second later they are read out one by one, so the I2C task never waits on a conversion.
+// Each role keeps its probe across boots (NV "probe_roms"); a new probe takes the first role left without one.
+#define PROBES_MAX 8 // Most probes enumerated on the bus
+static DeviceAddress probe_rom[PROBES]; // ROM code of the probe in each role
+static bool probe_found[PROBES];        // The probe of the role is on the bus
+
+void setup_probes()
+{
+    pref.begin("wd", true);
+    if (pref.getBytes("probe_roms", probe_rom, sizeof(probe_rom)) != sizeof(probe_rom))
+        memset(probe_rom, 0, sizeof(probe_rom));
+    pref.end();
+
+    sensors.begin();
+    sensors.setWaitForConversion(false);
+    DeviceAddress found[PROBES_MAX];
+    int count = 0;
+    for (int i = 0; (i < sensors.getDeviceCount()) && (count < PROBES_MAX); i++)
+        if (sensors.getAddress(found[count], i))
+            count++;
+    wdata.probes = count;
+
+    // Roles whose probe is gone are free for a new one
+    for (int role = 0; role < PROBES; role++)
+        for (int i = 0; i < count; i++)
+            probe_found[role] |= !memcmp(probe_rom[role], found[i], sizeof(DeviceAddress));
+
+    bool changed = false;
+    for (int i = 0; i < count; i++)
+    {
+        bool assigned = false;
+        for (int role = 0; role < PROBES; role++)
+            assigned |= probe_found[role] && !memcmp(probe_rom[role], found[i], sizeof(DeviceAddress));
+        for (int role = 0; (role < PROBES) && !assigned; role++)
+        {
+            if (!probe_found[role])
+            {
+                memcpy(probe_rom[role], found[i], sizeof(DeviceAddress));
+                probe_found[role] = assigned = changed = true;
+            }
+        }
+    }
+    if (changed)
+        pref_set("probe_roms", probe_rom[0], sizeof(probe_rom));
+}
+
+// Assigns the probe given by its ROM code in hex to a role, effective from the next boot. Returns false if the
+// ROM code is not valid.
+bool probe_assign(int role, const char *hex)
+{
+    DeviceAddress rom;
+    for (int i = 0; i < 8; i++)
+    {
+        char byte[3] { hex[i * 2], hex[i * 2 + 1], 0 };
+        char *p_next;
+        if (!isxdigit(byte[0]) || !isxdigit(byte[1]))
+            return false;
+        rom[i] = strtoul(byte, &p_next, 16);
+    }
+    if ((hex[16] != 0) || !sensors.validAddress(rom))
+        return false;
+
+    DeviceAddress roms[PROBES];
+    memcpy(roms, probe_rom, sizeof(roms));
+    memcpy(roms[role], rom, sizeof(DeviceAddress));
+    pref_set("probe_roms", roms[0], sizeof(roms));
+    return true;
+}
+
+// Prints the ROM code of the probe in the role as hex
+void probe_hex(char *buf, int role)
+{
+    for (int i = 0; i < 8; i++)
+        sprintf(buf + i * 2, "%02x", probe_rom[role][i]);
+}
+
+// Reads the probes by their addresses, the conversion was started a second ago
+static void probes_read()
+{
+    uint32_t start = micros();
+    for (int role = 0; role < PROBES; role++)
+    {
+        float c = probe_found[role] ? sensors.getTempC(probe_rom[role]) : DEVICE_DISCONNECTED_C;
+        wdata.probe_valid[role] = (c != DEVICE_DISCONNECTED_C);
+        wdata.probe_temp[role] = wdata.probe_valid[role] ? temp_from_c(c) : 0;
+    }
+    wdata.probe_read_us = micros() - start;
+}
 //------------------------------------------------------------------------------------------
 
 
@@ -88,87 +178,246 @@ static void lcd_init()
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "driver/gpio.h"
+#include "esp_sleep.h"
 #define GPIO_INPUT_IO_0 GPIO_NUM_15
 #define GPIO_INPUT_IO_1 GPIO_NUM_16
 #define GPIO_INPUT_IO_2 GPIO_NUM_17
 #define GPIO_INPUT_PIN_SEL  ((1ULL<<GPIO_INPUT_IO_0) | (1ULL<<GPIO_INPUT_IO_1) | (1ULL<<GPIO_INPUT_IO_2))
 #define ESP_INTR_FLAG_DEFAULT 0
 static xQueueHandle gpio_evt_queue = nullptr;
-static bool buttons[3] {};
+struct GpioEvent
+{
+    uint32_t button_index;
+    uint32_t time_us;     // Time of the interrupt, to measure the latency of the handler
+};
 static uint32_t option_mode_counter {}; // Seconds to switch off from the option mode selector
 #define BUTTON_INDEX_OPTION  0
 #define BUTTON_INDEX_DOWN    1
 #define BUTTON_INDEX_UP      2
+static const gpio_num_t button_gpio[3] { GPIO_INPUT_IO_0, GPIO_INPUT_IO_1, GPIO_INPUT_IO_2 };
+
+// The interrupt only wakes up the button task, which then samples the buttons with a timer until they settle
+#define BUTTON_POLL_MS         5 // Sampling period while any button is down or settling
+#define BUTTON_DEBOUNCE        4 // Number of equal consecutive samples for a stable level (20 ms)
+#define BUTTON_LONG_MS       600 // Hold time before the auto-repeat starts
+#define BUTTON_REPEAT_MS     300 // Initial auto-repeat period
+#define BUTTON_REPEAT_MIN_MS  60 // Auto-repeat period accelerates down to this
+#define BUTTON_COMMIT_MS    2000 // Setpoint changes are committed to NV only after this much time without presses
+
+struct Button
+{
+    bool active;          // Interrupt fired and the button is being sampled; its interrupt is disabled meanwhile
+    bool raw;             // Last sampled level, true when pressed
+    bool pressed;         // Debounced level
+    uint8_t stable;       // Number of consecutive samples equal to the raw level
+    uint8_t flips;        // Raw level changes since the level last settled
+    uint32_t repeat_ms;   // Current auto-repeat period
+    uint32_t next_ms;     // millis() time of the next auto-repeat
+};
+static Button buttons[3] {};
+// Kept out of the task, so that a pending commit survives a restart of the task by the supervisor
+static bool button_commit = false;  // Setpoint changed and needs to be committed to NV
+static uint32_t button_press_ms = 0;// millis() time of the last press or auto-repeat
+static volatile uint32_t lcd_event_us = 0; // ISR time of the button press the LCD should show, 0 if none
 //------------------------------------------------------------------------------------------
 static void IRAM_ATTR gpio_isr_handler(void *arg)
 {
-    uint32_t button_index = (uint32_t) arg;
-    xQueueSendFromISR(gpio_evt_queue, &button_index, nullptr);
+    uint32_t start = esp_timer_get_time();
+    GpioEvent event { (uint32_t) arg, start };
+    gpio_intr_disable(button_gpio[event.button_index]); // Ignore the bounces, the task re-enables it when released
+    xQueueSendFromISR(gpio_evt_queue, &event, nullptr);
+
+    uint32_t isr_us = uint32_t(esp_timer_get_time()) - start;
+    if (isr_us > wdata.btn_isr_max_us)
+        wdata.btn_isr_max_us = isr_us;
+}
 
-    buttons[0] = !gpio_get_level(gpio_num_t(GPIO_INPUT_IO_0));
-    buttons[1] = !gpio_get_level(gpio_num_t(GPIO_INPUT_IO_1));
-    buttons[2] = !gpio_get_level(gpio_num_t(GPIO_INPUT_IO_2));
+// Acts on a debounced button press, or on its auto-repeat. Returns true if the setpoint changed.
+static bool button_press(uint32_t button_index, bool repeat)
+{
+    trace(TRACE_BUTTON, button_index | (repeat ? TRACE_HI : 0), wdata.option);
+    if (button_index == BUTTON_INDEX_OPTION)
+    {
+        if (repeat)
+            return false;
+        wdata.option = wdata.option + 1;
+        if (wdata.option > OPTION_LAST)
+            wdata.option = OPTION_OFF;
+        option_mode_counter = OPTION_MODE_COUNTER_SEC;
+    }
+    else // When the options are setting up fan, up or down buttons change fan mode
+    if (wdata.option == OPTION_FAN)
+    {
+        if (repeat)
+            return false;
+        // To make the physical UI as simple as possible, we limit the fan options to ON/OFF only
+        if (wdata.fan_mode == OPTION_OFF)
+            control.set_fan_mode(FAN_MODE_ON); // OFF goes to ON
+        else
+            control.set_fan_mode(FAN_MODE_OFF); // while anything else goes to OFF
+        option_mode_counter = OPTION_MODE_COUNTER_SEC;
+    }
+    else // When the options are setting the A/C mode, up or down buttons change it
+    if (wdata.option == OPTION_AC)
+    {
+        if (repeat)
+            return false;
+        control.set_ac_mode(wdata.ac_mode + 1);
+        option_mode_counter = OPTION_MODE_COUNTER_SEC;
+    }
+    else // When the options are showing the filter life, holding up or down resets it
+    if (wdata.option == OPTION_FILTER)
+    {
+        // Only a long press resets, so that stepping through the options can not do it by accident
+        if (repeat && wdata.filter_wear)
+        {
+            control.filter_reset();
+            xI2CMessage xMessage;
+            xMessage.xMessageType = I2C_PRINT_STATUS;
+            xQueueSend(xI2CQueue, &xMessage, portMAX_DELAY);
+        }
+        option_mode_counter = OPTION_MODE_COUNTER_SEC;
+    }
+    else // Otherwise, up or down buttons, as expected, change the temperature; these auto-repeat
+    {
+        // Setpoint is not committed to NV on every step, the caller does it once the user stops pressing
+        int delta = (button_index == BUTTON_INDEX_UP) ? +1 : -1;
+        if (wdata.ac_mode == AC_MODE_COOL)
+            control.set_cool_to(temp_step(wdata.cool_to, delta), false);
+        if (wdata.ac_mode == AC_MODE_HEAT)
+            control.set_heat_to(temp_step(wdata.heat_to, delta), false);
+        if (wdata.ac_mode == AC_MODE_AUTO)
+            ; // TODO
+        return true;
+    }
+    return false;
 }
 
 static void vTask_gpio(void* arg)
 {
-    xI2CMessage xMessage;
-    uint32_t button_index;
+    GpioEvent event;
+
+    // The task may have been restarted by the supervisor while buttons were being sampled, with their interrupts
+    // disabled; start over from released buttons with all the interrupts enabled
+    memset(buttons, 0, sizeof(buttons));
+    for (uint32_t i = 0; i < 3; i++)
+        gpio_intr_enable(button_gpio[i]);
+    TickType_t wait = button_commit ? (BUTTON_POLL_MS / portTICK_PERIOD_MS) : portMAX_DELAY;
 
     while(true)
     {
-        while(xQueueReceive(gpio_evt_queue, &button_index, portMAX_DELAY) != pdPASS);
-
-        bool level = buttons[button_index];
+        BaseType_t received = xQueueReceive(gpio_evt_queue, &event, wait);
+        task_alive(TASK_GPIO);
+        if (received == pdPASS)
+        {
+            prof_gpio.add(uint32_t(esp_timer_get_time()) - event.time_us);
+            buttons[event.button_index].active = true;
+            buttons[event.button_index].stable = 0;
+            lcd_event_us = event.time_us;
+        }
 
-        if (level) // Consider buttons only on a press transition
+        uint32_t now = millis();
+        bool busy = false;
+        for (uint32_t i = 0; i < 3; i++)
         {
-            if (button_index == BUTTON_INDEX_OPTION)
+            Button &b = buttons[i];
+            if (!b.active)
+                continue;
+            busy = true;
+            bool print = false;
+
+            bool level = !gpio_get_level(button_gpio[i]);
+            if (level != b.raw)
             {
-                wdata.option = wdata.option + 1;
-                if (wdata.option > OPTION_LAST)
-                    wdata.option = OPTION_OFF;
-                option_mode_counter = OPTION_MODE_COUNTER_SEC;
+                b.raw = level;
+                b.stable = 0;
+                b.flips++;
             }
-            else // When the options are setting up fan, up or down buttons change fan mode
-            if (wdata.option == OPTION_FAN)
+            else if ((b.stable < BUTTON_DEBOUNCE) && (++b.stable == BUTTON_DEBOUNCE))
             {
-                // To make the physical UI as simple as possible, we limit the fan options to ON/OFF only
-                if (wdata.fan_mode == OPTION_OFF)
-                    control.set_fan_mode(FAN_MODE_ON); // OFF goes to ON
+                // The level settled: any flip beyond the one real transition was a bounce, and an
+                // interrupt which did not result in a transition at all was a glitch
+                if (b.raw != b.pressed)
+                {
+                    b.pressed = b.raw;
+                    wdata.btn_bounces += b.flips - 1;
+                    if (b.pressed)
+                    {
+                        button_commit |= button_press(i, false);
+                        b.repeat_ms = BUTTON_REPEAT_MS;
+                        b.next_ms = now + BUTTON_LONG_MS;
+                        button_press_ms = now;
+                        print = true;
+                    }
+                }
                 else
-                    control.set_fan_mode(FAN_MODE_OFF); // while anything else goes to OFF
-                option_mode_counter = OPTION_MODE_COUNTER_SEC;
-            }
-            else // When the options are setting the A/C mode, up or down buttons change it
-            if (wdata.option == OPTION_AC)
-            {
-                control.set_ac_mode(wdata.ac_mode + 1);
-                option_mode_counter = OPTION_MODE_COUNTER_SEC;
+                    wdata.btn_bounces += b.flips ? b.flips : 1;
+                b.flips = 0;
+
+                if (!b.pressed) // Released and settled, wait for the next interrupt
+                {
+                    b.active = false;
+                    gpio_intr_enable(button_gpio[i]);
+                }
             }
-            else // Otherwise, up or down buttons, as expected, change the temperature
+            else if (b.pressed && (b.stable == BUTTON_DEBOUNCE) && (int32_t(now - b.next_ms) >= 0))
             {
-                if (buttons[1] || buttons[2]) // Temperature up or down
+                // Held down: auto-repeat, getting faster the longer the button is held
+                if (button_press(i, true))
                 {
-                    int delta = (button_index == BUTTON_INDEX_UP) ? +1 : -1;
-                    if (wdata.ac_mode == AC_MODE_COOL)
-                        control.set_cool_to(wdata.cool_to + delta);
-                    if (wdata.ac_mode == AC_MODE_HEAT)
-                        control.set_heat_to(wdata.heat_to + delta);
-                    if (wdata.ac_mode == AC_MODE_AUTO)
-                        ; // TODO
+                    button_commit = true;
+                    lcd_event_us = esp_timer_get_time();
+                    print = true;
                 }
+                button_press_ms = now;
+                b.next_ms = now + b.repeat_ms;
+                b.repeat_ms = max(b.repeat_ms * 3 / 4, uint32_t(BUTTON_REPEAT_MIN_MS));
             }
 
-            xI2CMessage xMessage;
-            xMessage.xMessageType = I2C_PRINT_STATUS;
-            xQueueSend(xI2CQueue, &xMessage, portMAX_DELAY);
+            if (print)
+            {
+                xI2CMessage xMessage;
+                xMessage.xMessageType = I2C_PRINT_STATUS;
+                xQueueSend(xI2CQueue, &xMessage, portMAX_DELAY);
+            }
+        }
+
+        // Coalesce a run of setpoint changes into a single NV commit once the user stops pressing
+        if (button_commit && !busy && ((now - button_press_ms) >= BUTTON_COMMIT_MS))
+        {
+            pref_set("cool_to_t", wdata.cool_to);
+            pref_set("heat_to_t", wdata.heat_to);
+            button_commit = false;
         }
+        wait = (busy || button_commit) ? (BUTTON_POLL_MS / portTICK_PERIOD_MS) : portMAX_DELAY;
 
         wdata.task_gpio = uxTaskGetStackHighWaterMark(nullptr);
     }
 }
 
+// Lets the buttons wake up the chip from the light sleep, or stops it. The wakeup needs a level interrupt, an edge
+// is not seen while asleep, and the interrupt type is shared with the button ISR: with the low level, the ISR keeps
+// firing for as long as a button is held, unless its interrupt is masked. It is: the ISR masks it at the first
+// interrupt and the task unmasks it only once the button is released, so the low level costs one interrupt per
+// press as the falling edge does. Without the light sleep, the falling edge is restored.
+void buttons_wakeup(bool enable)
+{
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        if (enable)
+            gpio_wakeup_enable(button_gpio[i], GPIO_INTR_LOW_LEVEL); // Also sets the interrupt type
+        else
+        {
+            gpio_wakeup_disable(button_gpio[i]);
+            gpio_set_intr_type(button_gpio[i], GPIO_INTR_NEGEDGE);
+        }
+    }
+    if (enable)
+        esp_sleep_enable_gpio_wakeup();
+    else
+        esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_GPIO);
+}
+
 void setup_sw()
 {
     gpio_config_t io_conf
@@ -181,9 +430,9 @@ void setup_sw()
     };
     gpio_config(&io_conf);
     // Create a queue to handle gpio events from isr
-    gpio_evt_queue = xQueueCreate(5, sizeof(uint32_t));
+    gpio_evt_queue = xQueueCreate(5, sizeof(GpioEvent));
     // Start gpio task
-    xTaskCreate(vTask_gpio, "task_gpio", 2048, nullptr, tskIDLE_PRIORITY + 4, nullptr);
+    supervise(TASK_GPIO, vTask_gpio, "task_gpio", 2048, nullptr, PRIO_GPIO, CONTROL_CPU, gpio_evt_queue);
     // Install gpio isr service
     gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
     // Hook isr handlers for specific gpio pins
@@ -214,6 +463,13 @@ void pref_set(const char* name, uint32_t value)
     pref.end();
 }
 
+void pref_set(const char* name, int16_t value)
+{
+    pref.begin("wd", false);
+    pref.putShort(name, value);
+    pref.end();
+}
+
 void pref_set(const char* name, float value)
 {
     pref.begin("wd", false);
@@ -221,18 +477,71 @@ void pref_set(const char* name, float value)
     pref.end();
 }
 
-void pref_set(const char* name, String value)
+void pref_set(const char* name, const char *value)
 {
     pref.begin("wd", false);
     pref.putString(name, value);
     pref.end();
 }
 
+// Reads an NV string into a fixed-capacity buffer, the preferences have to be open
+static void pref_get(const char* name, char *value, size_t len, const char *default_value)
+{
+    if (!pref.getString(name, value, len))
+        snprintf(value, len, "%s", default_value);
+}
+
+void pref_set(const char* name, const uint8_t *value, size_t len)
+{
+    pref.begin("wd", false);
+    pref.putBytes(name, value, len);
+    pref.end();
+}
+
+// Converts the setpoints and the hysteresis held in NV by older firmware (whole degrees "F" and float "F" deltas)
+// into the unit-neutral temp_t keys. Runs once; the old keys are removed after the conversion.
+static void pref_migrate()
+{
+    pref.begin("wd", false);
+    if (pref.getShort("cool_to_t", INT16_MIN) == INT16_MIN)
+    {
+        pref.putShort("cool_to_t", temp_from_f(pref.getUChar("cool_to", 90)));
+        pref.putShort("heat_to_t", temp_from_f(pref.getUChar("heat_to", 60)));
+        pref.putShort("hyst_trig_t", temp_delta_from_f(pref.getFloat("hyst_trigger", 1.5)));
+        pref.putShort("hyst_rel_t", temp_delta_from_f(pref.getFloat("hyst_release", 0.5)));
+        pref.remove("cool_to");
+        pref.remove("heat_to");
+        pref.remove("hyst_trigger");
+        pref.remove("hyst_release");
+    }
+    pref.end();
+}
+
+// Prints the temperature in the display units: whole degrees "F", or "C" with one decimal (integer math only)
+int temp_print(char *buf, temp_t t)
+{
+    if (wdata.units == UNITS_C)
+    {
+        int c10 = (int(t) + (t >= 0 ? 5 : -5)) / 10;
+        return sprintf(buf, "%s%d.%d", (c10 < 0) ? "-" : "", abs(c10) / 10, abs(c10) % 10);
+    }
+    return sprintf(buf, "%d", temp_to_f_round(t));
+}
+
+// Steps the temperature up or down by a number of setpoint steps: 1 "F", or 0.5 "C", rounding to the step first
+temp_t temp_step(temp_t t, int steps)
+{
+    if (wdata.units == UNITS_C)
+        return ((int(t) + 25) / 50 + steps) * 50;
+    return temp_from_f(temp_to_f_round(t) + steps);
+}
+
 static void vTask_1s_tick(void *p)
 {
     // Make this task sleep and awake once a second
     const TickType_t xTimePeriod = 1 * 1000 / portTICK_PERIOD_MS;
     TickType_t xLastWakeTime = xTaskGetTickCount();
+    WakeProfile wake { 0, 1000000 };
     xI2CMessage xMessage;
     bool changed = false; // Commit updates to filter counters only on change
 
@@ -240,9 +549,16 @@ static void vTask_1s_tick(void *p)
     {
         // Wait for the next cycle first, all calculation below will be triggered after the initial period passed
         vTaskDelayUntil(&xLastWakeTime, xTimePeriod);
+        prof_wake(wake, prof_tick);
+        task_alive(TASK_TICK);
 
-        // Once every 30 seconds, read the temperature sensor
+        // Once every 30 seconds, start the temperature conversion on all probes and read them the next second
         if ((wdata.seconds % 30) == 0)
+        {
+            xMessage.xMessageType = I2C_CONVERT_TEMP;
+            xQueueSend(xI2CQueue, &xMessage, portMAX_DELAY);
+        }
+        if ((wdata.seconds % 30) == 1)
         {
             xMessage.xMessageType = I2C_READ_TEMP;
             xQueueSend(xI2CQueue, &xMessage, portMAX_DELAY);
@@ -250,6 +566,7 @@ static void vTask_1s_tick(void *p)
 
         // Every second, add up filter, cooling and heating periods
         changed |= control.accounting(wdata.relays);
+        energy_tick(wdata.relays);
         // Once a minute, if changed, commit those accounting values to NV
         if (changed && ((wdata.seconds % 60) == 0))
         {
@@ -257,6 +574,7 @@ static void vTask_1s_tick(void *p)
             pref.putUInt("filter_sec", wdata.filter_sec);
             pref.putUInt("cool_sec", wdata.cool_sec);
             pref.putUInt("heat_sec", wdata.heat_sec);
+            pref.putUInt("filter_wear", wdata.filter_wear);
             pref.end();
             changed = false;
         }
@@ -284,9 +602,12 @@ static void vTask_1s_tick(void *p)
         xMessage.xMessageType = I2C_ANIMATE_FAN;
         xQueueSend(xI2CQueue, &xMessage, portMAX_DELAY);
 
+        power_update();
+
         wdata.seconds++; // Increment the uptime seconds ticker
-        if (wdata.timestamp) // Increment the unix timestamp only if it has been set
-            wdata.timestamp++;
+        wdata.timestamp = clock_now();
+        if ((wdata.seconds % TRACE_TIME_TICKS) == 0)
+            trace32(TRACE_TIME, 0, wdata.timestamp);
         wdata.task_1s = uxTaskGetStackHighWaterMark(nullptr);
     }
 }
@@ -295,11 +616,13 @@ static void vTask_1s_tick(void *p)
 static void vTask_I2C(void *p)
 {
     xI2CMessage xMessage;
+    bool filter_shown = false; // Filter reminder is on the LCD
 
     while(true)
     {
         // Wait for the I2C task message to arrive
         while(xQueueReceive(xI2CQueue, &xMessage, portMAX_DELAY) != pdPASS);
+        task_alive(TASK_I2C);
 
         if (xMessage.xMessageType == I2C_SET_RELAYS)
         {
@@ -309,41 +632,58 @@ static void vTask_I2C(void *p)
 
             wdata.relays = xMessage.bMessage;
         }
-        else if (xMessage.xMessageType == I2C_READ_TEMP)
+        else if (xMessage.xMessageType == I2C_CONVERT_TEMP)
         {
-            // Read temperature sensor
+            // A broadcast conversion on all the probes, it does not wait for the conversion to complete
             sensors.requestTemperatures();
-            wdata.temp_c = sensors.getTempCByIndex(0);
+        }
+        else if (xMessage.xMessageType == I2C_READ_TEMP)
+        {
+            // Read temperature sensors, the return air probe is the thermostat temperature
+            probes_read();
+            wdata.temp = wdata.probe_temp[PROBE_RETURN];
 #if USE_MODEL
-            wdata.temp_c = control.model_get_temperature();
+            wdata.temp = control.model_get_temperature();
 #endif
-            wdata.temp_f = wdata.temp_c * 9.0 / 5.0 + 32.0;
-
             // Sanity check the temperature reading
-            wdata.temp_valid = (wdata.temp_f >= 60.0) && (wdata.temp_f <= 90.0);
+            wdata.temp_valid = wdata.probe_valid[PROBE_RETURN] && (wdata.temp >= wdata.temp_min) && (wdata.temp <= wdata.temp_max);
+            trace_input(TRACE_TEMP, wdata.temp_valid, wdata.temp);
 
             // Update temperature on the screen, round to the nearest
+            char buf[8];
+            temp_print(buf, wdata.get_temp());
             lcd.setCursor(0, 0);
-            lcd.print(String(int(wdata.get_temp_f() + 0.5), DEC));
-            lcd.print(wdata.get_temp_valid() ? " F" : " ?");
+            lcd.print(buf);
+            lcd.print(!wdata.get_temp_valid() ? " ?" : (wdata.units == UNITS_C) ? " C" : " F");
         }
         else if (xMessage.xMessageType == I2C_LCD_INIT)
         {
             lcd_init();
+            filter_shown = false;
         }
         else if (xMessage.xMessageType == I2C_PRINT_STATUS)
         {
+            // Measure the latency from the button press to the LCD showing its result
+            uint32_t event_us = lcd_event_us;
+            lcd_event_us = 0;
+
             lcd.setCursor(6, 0);
             if (wdata.option == OPTION_OFF)
             {
+                // The status field is 10 characters wide; Celsius setpoints have a decimal and get a shorter label
+                char cool[8], heat[8], buf[24];
+                temp_print(cool, wdata.cool_to);
+                temp_print(heat, wdata.heat_to);
+                const char *label = (wdata.units == UNITS_C) ? "" : " to";
                 if (wdata.ac_mode == AC_MODE_OFF)
-                    lcd.print("          ");
+                    buf[0] = 0;
                 else if (wdata.ac_mode == AC_MODE_COOL)
-                    lcd.print("cool to " + String(wdata.cool_to));
+                    sprintf(buf, "cool%s %s", label, cool);
                 else if (wdata.ac_mode == AC_MODE_HEAT)
-                    lcd.print("heat to " + String(wdata.heat_to));
+                    sprintf(buf, "heat%s %s", label, heat);
                 else if (wdata.ac_mode == AC_MODE_AUTO)
-                    lcd.print("auto " + String(wdata.cool_to) + "/" + String(wdata.heat_to));
+                    sprintf(buf, "%s/%s", cool, heat);
+                lcd.printf("%-10.10s", buf);
             }
             else if (wdata.option == OPTION_FAN)
             {
@@ -365,6 +705,12 @@ static void vTask_I2C(void *p)
                 else if (wdata.ac_mode == AC_MODE_AUTO)
                     lcd.print("  A/C AUTO");
             }
+            else if (wdata.option == OPTION_FILTER)
+            {
+                lcd.printf("Filter%3d%%", control.filter_pct());
+            }
+            if (event_us)
+                prof_lcd.add(uint32_t(esp_timer_get_time()) - event_us);
         }
         else if (xMessage.xMessageType == I2C_ANIMATE_FAN)
         {
@@ -373,77 +719,171 @@ static void vTask_I2C(void *p)
                 lcd.write(' ');
             else
                 lcd.write((wdata.seconds & 1) ? CHAR_FAN1 : CHAR_FAN2);
+
+            // Remind to replace the filter, written only when that changes
+            bool filter_due = wdata.status & STATUS_FILTER_DUE;
+            if (filter_due != filter_shown)
+            {
+                lcd.setCursor(2, 1);
+                lcd.print(filter_due ? "FILTER" : "      ");
+                filter_shown = filter_due;
+            }
         }
 
         wdata.task_i2c = uxTaskGetStackHighWaterMark(nullptr);
     }
 }
 
+// Runs the network jobs on the NETWORK_CPU core, wifi_check_loop() paces it at 10 passes a second
+static void vTask_network(void *p)
+{
+    while(true)
+    {
+        uint32_t mark = heap_mark();
+        wifi_check_loop();
+        mdns_loop();
+        heap_account(heap_wifi, mark);
+        mark = heap_mark();
+        ota_loop();
+        heap_account(heap_ota, mark);
+        mark = heap_mark();
+        clock_loop();
+        heap_account(heap_clock, mark);
+        mark = heap_mark();
+        mqtt_loop();
+        heap_account(heap_mqtt, mark);
+        events_loop();
+    }
+}
+
 void setup()
 {
     Serial.begin(115200);
-    Serial.println("START");
+    log_write(LOG_INFO, LOG_SYS, "Boot, reset reason %d", esp_reset_reason());
 
-    delay(2000); // Start with some delay to sleep over any quick power glitches
+    pref_migrate();
 
     // Read the initial values stored in the NV (not-volatile memory)
     pref.begin("wd", true);
-    wdata.id = pref.getString("id", "Thermostat");
-    wdata.tag = pref.getString("tag", "Smart Thermostat station");
-    wdata.ext_server = pref.getString("ext_server", "192.168.1.34/json");
+    pref_get("id", wdata.id, sizeof(wdata.id), "Thermostat");
+    pref_get("tag", wdata.tag, sizeof(wdata.tag), "Smart Thermostat station");
+    pref_get("ext_server", wdata.ext_server, sizeof(wdata.ext_server), "_sensor._tcp");
     wdata.ext_read_sec = pref.getUInt("ext_read_sec", 0);
+    pref_get("api_key", wdata.api_key, sizeof(wdata.api_key), "");
+    pref_get("ntp_server", wdata.ntp_server, sizeof(wdata.ntp_server), "pool.ntp.org");
+    pref_get("mqtt_server", wdata.mqtt_server, sizeof(wdata.mqtt_server), "");
+    char topic[sizeof(wdata.mqtt_topic)];
+    snprintf(topic, sizeof(topic), "thermostat/%s", wdata.id);
+    pref_get("mqtt_topic", wdata.mqtt_topic, sizeof(wdata.mqtt_topic), topic);
+    pref_get("mqtt_user", wdata.mqtt_user, sizeof(wdata.mqtt_user), "");
+    pref_get("mqtt_pass", wdata.mqtt_pass, sizeof(wdata.mqtt_pass), "");
     wdata.fan_mode = pref.getUChar("fan_mode", FAN_MODE_OFF);
     wdata.ac_mode = pref.getUChar("ac_mode", AC_MODE_OFF);
-    wdata.cool_to = pref.getUChar("cool_to", 90);
-    wdata.heat_to = pref.getUChar("heat_to", 60);
-    wdata.hyst_trigger = pref.getFloat("hyst_trigger", 1.5);
-    wdata.hyst_release = pref.getFloat("hyst_release", 0.5);
+    wdata.cool_to = pref.getShort("cool_to_t", TEMP_FROM_F(90));
+    wdata.heat_to = pref.getShort("heat_to_t", TEMP_FROM_F(60));
+    wdata.hyst_trigger = pref.getShort("hyst_trig_t", temp_delta_from_f(1.5));
+    wdata.hyst_release = pref.getShort("hyst_rel_t", temp_delta_from_f(0.5));
+    wdata.ac_eval_sec = constrain(pref.getUInt("ac_eval_sec", 30), AC_EVAL_SEC_MIN, AC_EVAL_SEC_MAX);
+    wdata.fusion = pref.getUChar("fusion", 1);
+    wdata.temp_min = pref.getShort("temp_min_t", TEMP_FROM_F(60));
+    wdata.temp_max = pref.getShort("temp_max_t", TEMP_FROM_F(90));
+    wdata.units = pref.getUChar("units", UNITS_F);
+    wdata.equipment = pref.getUChar("equipment", EQUIP_SINGLE);
     wdata.filter_sec = pref.getUInt("filter_sec", 0);
     wdata.cool_sec = pref.getUInt("cool_sec", 0);
     wdata.heat_sec = pref.getUInt("heat_sec", 0);
+    wdata.filter_wear = pref.getUInt("filter_wear", 0);
+    wdata.filter_life_h = pref.getUInt("filter_life_h", 720);
+    wdata.fan_w = pref.getUInt("fan_w", 500);
+    wdata.cool_w = pref.getUInt("cool_w", 3500);
+    wdata.cool2_w = pref.getUInt("cool2_w", 0);
+    wdata.heat_w = pref.getUInt("heat_w", 0);
+    wdata.heat2_w = pref.getUInt("heat2_w", 0);
+    wdata.tariff_base = pref.getUInt("tariff_base", 0);
+    wdata.tariff_peak = pref.getUInt("tariff_peak", 0);
+    wdata.peak_start = pref.getUChar("peak_start", 0);
+    wdata.peak_end = pref.getUChar("peak_end", 0);
+    wdata.utc_offset_min = pref.getShort("utc_offset", 0);
+    wdata.power_save = pref.getUChar("power_save", 0);
+    wdata.wifi_channel = pref.getUChar("wifi_channel", 0);
+    if (pref.getBytes("wifi_bssid", wdata.wifi_bssid, sizeof(wdata.wifi_bssid)) != sizeof(wdata.wifi_bssid))
+        wdata.wifi_channel = 0; // No valid cached access point
+    wdata.ota_pending = pref.getUChar("ota_pending", 0);
+    wdata.ota_kbps = pref.getUInt("ota_kbps", 0);
+    wdata.ota_rollbacks = pref.getUInt("ota_rollbacks", 0);
+    wdata.sv_reboots = pref.getUInt("sv_reboots", 0);
+    pref_get("sv_reason", wdata.sv_reason, sizeof(wdata.sv_reason), "");
     pref.end();
 
-    setup_wifi();
-    setup_webserver();
+    ota_boot_check(); // May roll back to the previous image and restart
+    setup_energy();
+
+    // Bring up the local control first: LCD, buttons and the tasks do not depend on the network
+    setup_probes();
     setup_i2c();
     setup_sw();
 
-    xTaskCreatePinnedToCore(
+    supervise(
+        TASK_I2C,            // Supervisor index of the task
         vTask_I2C,           // Task function
         "task_i2c",          // Name of the task
         2048,                // Stack size in bytes
         nullptr,             // Parameter passed as input to the task
-        tskIDLE_PRIORITY + 1,// Priority of the task
-        nullptr,             // Task handle
-        APP_CPU);            // Core where the task should run (user program core)
+        PRIO_I2C,            // Priority of the task
+        CONTROL_CPU,         // Core where the task should run
+        xI2CQueue);          // Input queue, the task is idle while it is empty
 
-    xTaskCreatePinnedToCore(
+    supervise(
+        TASK_TICK,           // Supervisor index of the task
         vTask_1s_tick,       // Task function
         "task_1s",           // Name of the task
         2048,                // Stack size in bytes
         &wdata,              // Parameter passed as input to the task
-        tskIDLE_PRIORITY,    // Priority of the task
-        nullptr,             // Task handle
-        APP_CPU);            // Core where the task should run (user program core)
+        PRIO_TICK,           // Priority of the task
+        CONTROL_CPU,         // Core where the task should run
+        nullptr);            // Periodic task, no input queue
 
-    xTaskCreatePinnedToCore(
+    supervise(
+        TASK_EXT,            // Supervisor index of the task
         vTask_ext_temp,      // Task function
         "task_ext_temp",     // Name of the task
         2048,                // Stack size in bytes
         nullptr,             // Parameter passed as input to the task
-        tskIDLE_PRIORITY,    // Priority of the task
-        nullptr,             // Task handle
-        APP_CPU);            // Core where the task should run (user program core)
+        PRIO_NETWORK,        // Priority of the task
+        NETWORK_CPU,         // Core where the task should run
+        nullptr);            // Periodic task, no input queue
+    setup_supervisor();
+
+    // After a warm restart the controller resumes right away with the relays as they were. On a cold boot, the
+    // controller starts with all relays off and takes its usual few seconds before making any decisions.
+    control.set_hysteresis(wdata.hyst_trigger, wdata.hyst_release, false);
+    if (!control.restore())
+    {
+        control.set_fan_mode(wdata.fan_mode);
+        control.set_ac_mode(wdata.ac_mode);
+        control.set_cool_to(wdata.cool_to);
+        control.set_heat_to(wdata.heat_to);
+    }
+    wdata.resume_ms = millis();
 
-    delay(1000); // Give a second for all the tasks to start
+    // WiFi connects in the background, the web server starts listening as soon as the network is up
+    setup_wifi();
+    setup_webserver();
+    setup_power();
+    setup_mqtt();
 
-    control.set_fan_mode(wdata.fan_mode);
-    control.set_ac_mode(wdata.ac_mode);
-    control.set_cool_to(wdata.cool_to);
-    control.set_heat_to(wdata.heat_to);
+    xTaskCreatePinnedToCore(
+        vTask_network,       // Task function
+        "task_network",      // Name of the task
+        8192,                // Stack size in bytes, as the Arduino loop task had
+        nullptr,             // Parameter passed as input to the task
+        PRIO_NETWORK,        // Priority of the task
+        nullptr,             // Task handle
+        NETWORK_CPU);        // Core where the task should run
 }
 
+// The Arduino loop task runs on the control core, its work is done by vTask_network instead
 void loop()
 {
-    wifi_check_loop();
+    vTaskDelete(nullptr);
 }
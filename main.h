@@ -9,31 +9,78 @@
 // The number of seconds that the option mode will wait before going back to displaying temperatures
 #define OPTION_MODE_COUNTER_SEC 5
 
+// Temperatures are held in a single fixed-point representation, in 1/100 of a degree Celsius.
+// Conversions to float or to Fahrenheit are done only at the edges: sensors, LCD, html and json.
+typedef int16_t temp_t;
+#define TEMP_FROM_F(f)  temp_t(((f) - 32) * 500 / 9)  // Constant whole degrees F to temp_t
+#define TEMP_DELTA_FROM_F(f)  temp_t((f) * 500 / 9)   // Constant whole degrees F delta to temp_t
+inline temp_t temp_from_c(float c) { return lroundf(c * 100.0); }
+inline temp_t temp_from_f(float f) { return lroundf((f - 32.0) * 500.0 / 9.0); }
+inline temp_t temp_delta_from_f(float f) { return lroundf(f * 500.0 / 9.0); }
+inline float temp_delta_to_f(temp_t t) { return t * 9.0 / 500.0; }
+inline float temp_to_c(temp_t t) { return t / 100.0; }
+inline float temp_to_f(temp_t t) { return t * 9.0 / 500.0 + 32.0; }
+// Rounded to the nearest whole degree F, using only the integer math
+inline int temp_to_f_round(temp_t t) { int f10 = int(t) * 90 / 500 + 320; return (f10 + (f10 >= 0 ? 5 : -5)) / 10; }
+
 struct StationData
 {
     // Variables marked with [NV] are held in the non-volatile memory using Preferences
-    String id;            // [NV] Station identification string, held in the non-volatile memory
-    String tag;           // [NV] Station description or a tag, held in the non-volatile memory
-    float temp_c;         // Current temperature in "C"
-    float temp_f;         // Current temperature in "F"
+    // Strings are held in fixed-capacity buffers, so that changing them never allocates from the heap
+    char id[32];          // [NV] Station identification string, held in the non-volatile memory
+    char tag[64];         // [NV] Station description or a tag, held in the non-volatile memory
+    temp_t temp;          // Current temperature
     bool temp_valid {0};  // True if termperature reading is correct
-    float ext_temp_c;     // External sensor temperature in "C"
-    float ext_temp_f;     // External sensor temperature in "F"
+    temp_t ext_temp;      // External sensor temperature
     bool ext_valid  {0};  // True if external sensor termperature reading is correct
-    String ext_server;    // [NV] Server/path name of the external temperature sensor
+
+    // Temperature probes on the OneWire bus, by their role
+#define PROBE_RETURN   0  // Return air, the thermostat temperature
+#define PROBE_SUPPLY   1  // Supply air
+#define PROBE_OUTDOOR  2  // Outdoor
+#define PROBES         3
+    temp_t probe_temp[PROBES] {};
+    bool probe_valid[PROBES] {};
+    uint32_t probes {0};  // Number of probes found on the bus
+    uint32_t probe_read_us {0};// Time to read out all the probes after their conversion
+    temp_t supply_delta {0};// Supply minus return air temperature during the last call
+    char ext_server[64];  // [NV] External temperature sensor: "host[:port]", "name.local" or "_service._tcp[@name]"
     uint32_t ext_read_sec;// [NV] Period in seconds to read external temperature sensor, 0 to disable reading
+    uint32_t mdns_queries {0};// Number of mDNS queries made to resolve the external sensor
+    uint32_t mdns_hits {0};// Number of resolutions answered from the cache
+    uint32_t mdns_fails {0};// Number of mDNS queries which found nothing
+    uint32_t mdns_query_ms {0};// Duration of the last successful mDNS query
+    uint32_t mdns_query_max_ms {0};// Longest successful mDNS query
+
+    // Fusion of the internal probe and the external sensor into the effective temperature (sensor.cpp)
+    uint8_t fusion;       // [NV] 1 to blend between the sensors by their health, 0 to switch to whichever is valid
+    temp_t fused_temp {0};// Effective temperature
+    bool fused_valid {0};
+    uint8_t fused_source {0};// Source of the effective temperature
+#define SOURCE_NONE   0
+#define SOURCE_INT    1   // Internal probe, corrected by its offset against the external sensor
+#define SOURCE_EXT    2   // External sensor
+#define SOURCE_BLEND  3   // Moving from one to the other
+    uint8_t fused_confidence {0};// Health of the sources in the proportion they are used, 0-100
+#define SENSOR_INT    0
+#define SENSOR_EXT    1
+    uint16_t sensor_health[2] {};// Health of each source, up by 1 every second it is valid, 0..HEALTH_MAX
+    uint16_t ext_weight {0};// Weight of the external sensor in the blend, 0..BLEND_SEC
+    bool ext_preferred {0};// The external sensor is healthy enough to be used
+    bool int_offset_set {0};// The offset was measured
+    int32_t int_offset {0};// Offset of the internal probe against the external sensor, temp_t << 16
 
     // Returns the effective temperature to be used for thermostat operation, display and json output
-    // Using this method abstracts the internal sensor from the external sensor override
-    inline float get_temp_c() { return ext_valid ? ext_temp_c : temp_c; }
-    inline float get_temp_f() { return ext_valid ? ext_temp_f : temp_f; }
-    inline bool get_temp_valid() { return ext_valid ? true : temp_valid; }
+    // Using this method abstracts the sensors from the fusion of their readings, updated every control tick
+    inline temp_t get_temp() { return fused_temp; }
+    inline bool get_temp_valid() { return fused_valid; }
 
     uint8_t option {0};   // UI option mode
 #define OPTION_OFF    0   // No option
 #define OPTION_FAN    1   // Setting the fan mode
 #define OPTION_AC     2   // Setting the AC mode
-#define OPTION_LAST   OPTION_AC
+#define OPTION_FILTER 3   // Showing the filter life, holding up or down resets it
+#define OPTION_LAST   OPTION_FILTER
 
     uint8_t fan_mode;     // [NV] Fan operation mode: OFF, ON, CYC, TIMED
 #define FAN_MODE_OFF   0
@@ -50,21 +97,113 @@ struct StationData
 #define AC_MODE_AUTO  3   // TODO
 #define AC_MODE_LAST  AC_MODE_HEAT
 
-    uint8_t cool_to;      // [NV] Temperature cooling target
-    uint8_t heat_to;      // [NV] Temperature heating target
+    uint8_t equipment;    // [NV] HVAC equipment wired to the relays
+#define EQUIP_SINGLE     0 // Single stage heating and cooling
+#define EQUIP_TWO_STAGE  1 // Two stage heating and cooling
+#define EQUIP_HP_O       2 // Heat pump with aux heat, reversing valve energized for cooling (O)
+#define EQUIP_HP_B       3 // Heat pump with aux heat, reversing valve energized for heating (B)
+    uint8_t call {0};     // Current call from the controller
+#define CALL_NONE  0
+#define CALL_COOL  1
+#define CALL_HEAT  2
+    uint8_t stage {1};    // Current stage of the call: 1 or 2
+
+    temp_t cool_to;       // [NV] Temperature cooling target
+    temp_t heat_to;       // [NV] Temperature heating target
+#define SETPOINT_MIN  TEMP_FROM_F(60)
+#define SETPOINT_MAX  TEMP_FROM_F(90)
 
     // Adjustable hysteresis on cooling and heating: delta temps to turn on and off the appliance
-    float hyst_trigger;   // [NV] Hysteresis trigger temperature delta
-    float hyst_release;   // [NV] Hysteresis release temperature delta
+    temp_t hyst_trigger;  // [NV] Hysteresis trigger temperature delta
+    temp_t hyst_release;  // [NV] Hysteresis release temperature delta
+    uint32_t ac_eval_sec; // [NV] Period in seconds of the A/C decisions (call and stage)
+#define AC_EVAL_SEC_MIN   10
+#define AC_EVAL_SEC_MAX  300
+
+    // Temperature readings outside of these limits are considered sensor errors
+    temp_t temp_min;      // [NV] Lowest valid temperature reading
+    temp_t temp_max;      // [NV] Highest valid temperature reading
+
+    uint8_t units;        // [NV] Units used to show and set the temperatures on the LCD, html and json
+#define UNITS_F  0        // Fahrenheit, whole degrees
+#define UNITS_C  1        // Celsius, with 0.5 degree steps
 
     uint32_t seconds {0}; // Uptime seconds counter (shown as "uptime" in web reports)
-    uint32_t timestamp {0};// Unix timestamp date/time (shown as "timestamp" in web reports)
+    uint32_t timestamp {0};// Unix timestamp date/time (shown as "timestamp" in web reports), 0 if the clock is not set
+    char ntp_server[64];  // [NV] NTP server as "host" or "host:port", empty to disable the time synchronization
+    int32_t clock_offset_ms {0};// Clock offset corrected by the last synchronization
+    uint32_t clock_rtt_ms {0};// Round trip time to the NTP server at the last synchronization
+    uint32_t clock_syncs {0};// Number of successful synchronizations
+    uint32_t clock_fails {0};// Number of synchronizations without a valid reply
+    uint32_t clock_steps {0};// Number of times the clock was stepped instead of slewed
+    uint32_t clock_sync_at {0};// Unix time of the last successful synchronization
     uint32_t filter_sec;  // [NV] Total A/C + fan on time in seconds
     uint32_t cool_sec;    // [NV] Total A/C cooling time in seconds
     uint32_t heat_sec;    // [NV] Total A/C heating time in seconds
+    uint32_t filter_wear; // [NV] Wear of the current filter in nominal fan seconds, weighted by the airflow
+    uint32_t filter_life_h;// [NV] Replacement interval of the filter in nominal fan hours
+
+    // Equipment power and the electricity tariff used to estimate the energy use and the cost
+    uint32_t fan_w;       // [NV] Power of the fan in W
+    uint32_t cool_w;      // [NV] Power of the first cooling stage, or the heat pump compressor in W
+    uint32_t cool2_w;     // [NV] Additional power of the second cooling stage in W
+    uint32_t heat_w;      // [NV] Power of the first heating stage in W
+    uint32_t heat2_w;     // [NV] Power of the second heating stage, or the heat pump aux heat in W
+    uint32_t tariff_base; // [NV] Base price of 1 kWh in 1/1000 of the currency unit
+    uint32_t tariff_peak; // [NV] Peak price of 1 kWh in 1/1000 of the currency unit
+    uint8_t peak_start;   // [NV] Hour of the day the peak tariff starts
+    uint8_t peak_end;     // [NV] Hour of the day the peak tariff ends (may be less than peak_start)
+    int16_t utc_offset_min;// [NV] Local time offset from UTC in minutes, the hours above and the energy days are local
+
+    char api_key[48];     // [NV] Key required by the requests which change the state, empty to use the default
+    uint32_t auth_rejected {0};// Number of requests rejected for a missing or wrong API key
+    uint32_t auth_throttled {0};// Number of requests rejected by the rate limiter
+
+    char mqtt_server[64]; // [NV] MQTT broker as "host" or "host:port", empty to disable MQTT
+    char mqtt_topic[64];  // [NV] Base topic of the MQTT messages
+    char mqtt_user[32];   // [NV] MQTT user name, empty if the broker does not need one
+    char mqtt_pass[48];   // [NV] MQTT password
+    uint32_t mqtt_queued {0};// Number of MQTT messages waiting to be published
+    uint32_t mqtt_dropped {0};// Number of MQTT messages dropped because the queue was full
+    uint32_t log_dropped {0};// Number of log records overwritten before any /log request returned them
+
     uint32_t status;      // Bitfield containing possible errors and status bits
     uint8_t relays {0xFF};// Effective state of the relay control byte
     bool gpio23;          // GPIO23 strap value
+    uint8_t wifi_bssid[6];// [NV] BSSID of the last access point we connected to, used for a fast reconnect
+    uint8_t wifi_channel; // [NV] WiFi channel of that access point, 0 if not known
+    uint32_t wifi_connect_ms {0};  // Duration of the last WiFi (re)connect in milliseconds
+    uint32_t first_decision_ms {0};// Milliseconds from boot to the first A/C relay decision
+    bool warm_boot {0};   // True if the controller state was restored from the RTC memory on this boot
+    uint32_t resume_ms {0};// Milliseconds from boot until the controller was started or resumed
+    uint32_t control_ticks {0};// Number of control loop ticks since boot
+
+    uint8_t ota_pending;  // [NV] The running image was flashed by OTA and is on trial, not yet marked valid
+    uint32_t ota_kbps;    // [NV] Throughput of the last OTA upload in KB/s
+    uint32_t ota_rollbacks;// [NV] Number of times an OTA image failed on trial and was rolled back
+    uint32_t ota_downtime_ms {0};// Milliseconds from the reboot into a new OTA image until the controller resumed
+
+    uint8_t power_save;   // [NV] Power save mode: 0 - off, 1 - DFS, WiFi modem sleep and automatic light sleep
+    bool light_sleep {0}; // True if the automatic light sleep is active (power save mode is on and supported)
+    uint32_t cpu_mhz {0}; // Current CPU frequency
+    uint8_t idle_pct[2] {};// Percentage of time each core spent idle or asleep during the last second
+    uint32_t wake_timer {0};// Number of wakeups from the light sleep by the timer (task deadlines)
+    uint32_t wake_gpio {0};// Number of wakeups from the light sleep by the buttons
+    uint32_t wake_other {0};// Number of wakeups from the light sleep by other sources (WiFi, UART)
+    uint32_t btn_bounces {0};// Number of button contact bounces and glitches filtered out by the debouncer
+    uint32_t btn_isr_max_us {0};// Longest time spent in the button interrupt handler
+
+    // Tasks watched by the supervisor, by their index
+#define TASK_CONTROL   0
+#define TASK_TICK      1
+#define TASK_I2C       2
+#define TASK_GPIO      3
+#define TASK_EXT       4
+#define TASKS          5
+    uint32_t sv_recoveries[TASKS] {};// Number of recovery actions (I2C bus clear, task restart) taken on each task
+    uint32_t sv_stall_ms[TASKS] {};// Duration of the last (or the current) stall of each task
+    uint32_t sv_reboots;  // [NV] Number of reboots by the supervisor or the task watchdog
+    char sv_reason[48];   // [NV] Reason of the last such reboot
 
     // Debug methods
     int task_1s {-1};     // Stack high watermark for the corresponding task
@@ -76,17 +215,45 @@ struct StationData
 
 extern StationData wdata;
 
+// Conversions between temp_t and the temperature units selected for display
+inline float temp_to_units(temp_t t) { return (wdata.units == UNITS_C) ? temp_to_c(t) : temp_to_f(t); }
+inline temp_t temp_from_units(float v) { return (wdata.units == UNITS_C) ? temp_from_c(v) : temp_from_f(v); }
+inline float temp_delta_to_units(temp_t t) { return (wdata.units == UNITS_C) ? temp_to_c(t) : temp_delta_to_f(t); }
+inline temp_t temp_delta_from_units(float v) { return (wdata.units == UNITS_C) ? temp_from_c(v) : temp_delta_from_f(v); }
+inline const char *units_str() { return (wdata.units == UNITS_C) ? "C" : "F"; }
+
 // Possible errors
 #define STATUS_LCD_INIT_ERROR  (1 << 0) // LCD was not able to initialize
 #define STATUS_EXT_GET_ERROR   (1 << 1) // Http GET error when reading external sensor
 #define STATUS_EXT_JSON_ERROR  (1 << 2) // Error parsing external temperature json response
 #define STATUS_EXT_TEMP_ERROR  (1 << 3) // Error reading external temperature sensor
 #define STATUS_BUF_OVERFLOW    (1 << 4) // Web response buffer overflowed
+#define STATUS_FILTER_DUE      (1 << 5) // Filter reached the end of its life and should be replaced
+#define STATUS_DELTA_LOW       (1 << 6) // Heating or cooling runs, but barely changes the supply air temperature
+#define STATUS_TASK_STALL      (1 << 7) // A critical task is stalled and being recovered, cleared once it is alive
+#define STATUS_MASK            ((1 << 8) - 1) // All the bits above
 
-// Specific to ESP32's FreeRTOS port, Arduino loop is running on core 1 and priority 1
+// Specific to ESP32's FreeRTOS port, Arduino loop is running on core 1 and priority 1, ours ends right away
 #define PRO_CPU 0
 #define APP_CPU 1
 
+// Task layout. The WiFi driver and the lwIP stack run on PRO_CPU at high priorities, so the real-time work (control,
+// sensor acquisition, relay I/O and buttons) gets the APP_CPU core in a priority band above anything else there.
+// The network work of our own goes to the PRO_CPU core: the network task (WiFi reconnects, mDNS, OTA, clock, MQTT and
+// the UI events) and the external sensor client. The async_tcp task of the web
+// server is not ours to place: it is not pinned to a core by default (CONFIG_ASYNC_TCP_RUNNING_CORE is -1 in
+// AsyncTCP.h), so it runs on whichever is free, at priority 3 below the control band; build with
+// -DCONFIG_ASYNC_TCP_RUNNING_CORE=0 to pin it to PRO_CPU.
+// tools/loadtest.py floods the web server and reads the control tick jitter from /prof, to measure what is left.
+#define CONTROL_CPU   APP_CPU
+#define NETWORK_CPU   PRO_CPU
+#define PRIO_SUPERVISOR (tskIDLE_PRIORITY + 9) // Task supervisor, on the NETWORK_CPU core
+#define PRIO_CONTROL  (tskIDLE_PRIORITY + 8) // Control loop
+#define PRIO_I2C      (tskIDLE_PRIORITY + 7) // Relay I/O, LCD and the temperature sensor
+#define PRIO_GPIO     (tskIDLE_PRIORITY + 6) // Buttons
+#define PRIO_TICK     (tskIDLE_PRIORITY + 5) // 1 sec housekeeping tick
+#define PRIO_NETWORK  (tskIDLE_PRIORITY + 1) // Network task and the external sensor web client
+
 // Type of a message sent to the I2C task
 typedef struct
 {
@@ -99,6 +266,7 @@ typedef struct
 #define I2C_SET_RELAYS    2
 #define I2C_PRINT_STATUS  3
 #define I2C_ANIMATE_FAN   4
+#define I2C_CONVERT_TEMP  5
 
 extern QueueHandle_t xI2CQueue; // The queue of messages to the I2C task
 
@@ -106,13 +274,184 @@ extern QueueHandle_t xI2CQueue; // The queue of messages to the I2C task
 void pref_set(const char* name, bool value);
 void pref_set(const char* name, uint8_t value);
 void pref_set(const char* name, uint32_t value);
+void pref_set(const char* name, int16_t value);
 void pref_set(const char* name, float value);
-void pref_set(const char* name, String value);
+void pref_set(const char* name, const char *value);
+void pref_set(const char* name, const uint8_t *value, size_t len);
+int temp_print(char *buf, temp_t t);
+bool probe_assign(int role, const char *hex);
+void probe_hex(char *buf, int role);
+temp_t temp_step(temp_t t, int steps);
+void buttons_wakeup(bool enable);
 
 // From webserver.cpp
+class AsyncWebServerRequest;
+const char *request_header(AsyncWebServerRequest *request, const char *name);
 void setup_wifi();
 void setup_webserver();
 void wifi_check_loop();
+void events_loop();
+
+// From ota.cpp
+void setup_ota();
+bool ota_rollback(const char *why);
+void ota_boot_check();
+void ota_loop();
+
+// From set.cpp
+const char *request_arg(AsyncWebServerRequest *request, const char *name);
+void handleSet(AsyncWebServerRequest *request);
 
 // From webclient.cpp
 void vTask_ext_temp(void *p);
+
+// From mdns.cpp
+class IPAddress;
+void setup_mdns();
+void mdns_loop();
+bool mdns_resolve(const char *name, IPAddress &ip, uint16_t &port);
+void mdns_forget(const char *name);
+
+// From power.cpp
+void setup_power();
+void power_update();
+
+// From clock.cpp
+uint32_t clock_now();
+void clock_set(uint32_t timestamp);
+void clock_loop();
+
+// From energy.cpp
+void setup_energy();
+void energy_tick(uint8_t relays);
+void get_energy_json(char *p);
+
+// From auth.cpp
+bool auth_check(AsyncWebServerRequest *request);
+bool auth_request(AsyncWebServerRequest *request, bool limit);
+
+// From mqtt.cpp
+void setup_mqtt();
+void mqtt_loop();
+
+// From supervisor.cpp
+extern volatile uint32_t task_beat_ms[TASKS];
+inline void task_alive(int task) { task_beat_ms[task] = millis(); } // Heartbeat of a supervised task
+void supervise(int task, TaskFunction_t fn, const char *name, uint32_t stack, void *param, UBaseType_t prio, BaseType_t core, QueueHandle_t queue);
+void setup_supervisor();
+
+// From sensor.cpp
+void sensor_fusion();
+const char *fused_source_str();
+
+// From trace.cpp
+// A record of an input the controller saw, or of an output it made, tagged with the number of control ticks which
+// ran before it (wdata.control_ticks). A relay record is made by the tick that follows, tick number "tick" + 1.
+struct TraceRecord
+{
+    uint32_t tick;
+    uint8_t type;         // TRACE_*
+    uint8_t arg;
+    int16_t value;
+};
+#define TRACE_VERSION     1
+#define TRACE_HEADER      0 // First record of a download: arg is the record size, value is TRACE_VERSION
+#define TRACE_TEMP        1 // Thermostat temperature: arg is temp_valid, value the temperature
+#define TRACE_EXT         2 // External sensor temperature: arg is ext_valid, value the temperature
+#define TRACE_BUTTON      3 // Button press: arg is the button index, | TRACE_HI for an auto-repeat; value is wdata.option
+#define TRACE_SET         4 // Setting changed by /set, MQTT or the buttons: arg is TRACE_F_*, value the new value
+#define TRACE_RELAYS      5 // Relays written by the controller: value is the relay byte
+#define TRACE_TIME        6 // Unix time, in two records
+#define TRACE_CHECKPOINT  7 // Start of a checkpoint, followed by TRACE_STATE records and the sensor readings
+#define TRACE_STATE       8 // Field of the controller state in a checkpoint: arg is TRACE_F_*, value the field value
+#define TRACE_HI       0x80 // Added to arg of the record with the high 16 bits of a 32-bit value
+// Fields of the settings and of the controller state
+#define TRACE_F_FAN_MODE      0
+#define TRACE_F_AC_MODE       1
+#define TRACE_F_COOL_TO       2
+#define TRACE_F_HEAT_TO       3
+#define TRACE_F_HYST_TRIGGER  4
+#define TRACE_F_HYST_RELEASE  5
+#define TRACE_F_EQUIPMENT     6
+#define TRACE_F_FAN_SEC       7 // 32-bit
+#define TRACE_F_RELAYS        8 // The rest are only in the checkpoints
+#define TRACE_F_CALL          9
+#define TRACE_F_STAGE        10
+#define TRACE_F_STAGE_TEMP   11
+#define TRACE_F_STAGE_SEC    12 // 32-bit
+#define TRACE_F_CALL_SEC     13 // 32-bit
+#define TRACE_F_FAN_COUNTER  14 // 32-bit
+#define TRACE_F_AC_COUNTER   15 // 32-bit
+#define TRACE_F_AC_EVAL_SEC  16 // 32-bit, in the settings and in the checkpoints
+#define TRACE_F_FUSION       17 // In the settings and in the checkpoints
+#define TRACE_F_HEALTH_INT   18 // The rest are only in the checkpoints
+#define TRACE_F_HEALTH_EXT   19
+#define TRACE_F_EXT_WEIGHT   20
+#define TRACE_F_FUSION_FLAGS 21 // ext_preferred | int_offset_set << 1
+#define TRACE_F_INT_OFFSET   22 // 32-bit
+#define TRACE_CHECKPOINT_TICKS (30 * 60)
+#define TRACE_TIME_TICKS       (10 * 60)
+void trace(uint8_t type, uint8_t arg, int16_t value);
+void trace32(uint8_t type, uint8_t arg, uint32_t value);
+void trace_input(uint8_t type, bool valid, temp_t temp);
+void trace_checkpoint(const uint32_t (*state)[2], int fields);
+void handleTrace(AsyncWebServerRequest *request);
+
+// From log.cpp
+// A record keeps the format string and up to 4 arguments, which are formatted only when /log is read: the
+// arguments are integers, or pointers to string literals (never to a buffer, which may change before it is read)
+#define LOG_DEBUG  0
+#define LOG_INFO   1
+#define LOG_WARN   2
+#define LOG_ERROR  3
+#define LOG_SYS    0 // Subsystem tags
+#define LOG_WIFI   1
+#define LOG_MDNS   2
+#define LOG_EXT    3
+#define LOG_OTA    4
+#define LOG_SV     5
+#define LOG_CLOCK  6
+#define LOG_MQTT   7
+void log_write(uint8_t level, uint8_t tag, const char *fmt, uintptr_t a0 = 0, uintptr_t a1 = 0, uintptr_t a2 = 0, uintptr_t a3 = 0);
+int get_log_prof_json(char *p, size_t size);
+void handleLog(AsyncWebServerRequest *request);
+
+// From profile.cpp
+#define HIST_BUCKETS 12
+struct Histogram
+{
+    uint32_t bucket[HIST_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+    void add(uint32_t us);
+};
+struct WakeProfile
+{
+    int64_t next_us;      // Intended time of the next wake up
+    uint32_t period_us;   // Task period
+};
+extern Histogram prof_control;
+extern Histogram prof_tick;
+extern Histogram prof_gpio;
+extern Histogram prof_lcd;
+extern Histogram prof_set;
+extern Histogram prof_auth;
+extern Histogram prof_mqtt;
+// Net change of the free heap across the calls of a subsystem; not a count of its allocations (see profile.cpp)
+struct HeapStat
+{
+    uint32_t calls;       // Number of measured calls
+    uint32_t lost_calls;  // Calls after which the heap had less free memory than before
+    int32_t lost_bytes;   // Sum of the free heap lost over the calls (negative if more was freed)
+};
+extern HeapStat heap_wifi;
+extern HeapStat heap_ota;
+extern HeapStat heap_clock;
+extern HeapStat heap_mqtt;
+extern HeapStat heap_ext;
+extern HeapStat heap_set;
+extern HeapStat heap_json;
+void prof_wake(WakeProfile &w, Histogram &hist);
+uint32_t heap_mark();
+void heap_account(HeapStat &stat, uint32_t mark);
+bool get_profile_json(char *buf, size_t size);
@@ -0,0 +1,235 @@
+#include "main.h"
+#include <WiFi.h>
+#include <ESPmDNS.h>
+
+// mDNS: advertising this unit and discovering the external sensor
+//
+// Once the WiFi is up, the unit takes a host name made from its id ("<id>.local") and advertises the service
+// _thermostat._tcp on the web server port, with the id as the instance name. The TXT records of the service carry
+// the temperature, the modes and the current call, so that a scanner sees the state of every unit on the network
+// without an HTTP request to each. Every change of a TXT record is announced to the network, so they are updated
+// only when a value changed, and at most every MDNS_TXT_SEC.
+//
+// The external sensor (ext_server) is one of
+//   "host" or "host:port"              an address or a DNS name; a "/path" after it is ignored, /json is read
+//   "name.local"                       an mDNS host name
+//   "_service._tcp" or "_service._tcp@name"  the first instance of the service type found, or the one on host "name"
+// An mDNS query takes up to a few seconds, so the names are resolved only from the external sensor task and the
+// addresses are cached for MDNS_CACHE_MS; a failed connection drops the entry, so the next read queries again.
+// The query times and the cache hits are counted. To measure them without a real sensor, a PC on the same network
+// can advertise a test service with tools/mdns_responder.py.
+
+#define MDNS_SERVICE    "_thermostat"
+#define MDNS_PROTO      "_tcp"
+#define MDNS_TXT_SEC         10 // Shortest interval between the updates of the TXT records
+#define MDNS_CACHE            4 // Number of resolved names kept
+#define MDNS_CACHE_MS (10 * 60 * 1000) // A resolved address is used this long before it is queried again
+#define MDNS_HOST_TIMEOUT  2000 // Wait this long on an answer to a host name query
+
+struct MdnsTxt
+{
+    temp_t temp;
+    bool temp_valid;
+    uint8_t ac_mode;
+    uint8_t fan_mode;
+    uint8_t call;
+};
+
+struct MdnsEntry
+{
+    char name[sizeof(wdata.ext_server)]; // Name without its path, empty if the slot is free
+    uint32_t ip;
+    uint16_t port;
+    uint32_t resolved_at;                // millis() when it was resolved
+};
+
+static bool started = false;
+static MdnsTxt txt;                      // Values in the TXT records
+static uint32_t txt_at = 0;              // wdata.seconds of the last TXT update
+static MdnsEntry cache[MDNS_CACHE];      // Used only by the external sensor task
+
+// Sets the TXT records which changed, or all of them if prev is null
+static void mdns_txt(const MdnsTxt &t, const MdnsTxt *prev)
+{
+    char buf[16];
+    if (!prev || (t.temp != prev->temp) || (t.temp_valid != prev->temp_valid))
+    {
+        if (t.temp_valid)
+            sprintf(buf, "%.1f", temp_to_c(t.temp));
+        else
+            buf[0] = 0;
+        MDNS.addServiceTxt(MDNS_SERVICE, MDNS_PROTO, "temp_c", buf);
+    }
+#define TXT(name) if (!prev || (t.name != prev->name)) { sprintf(buf, "%d", t.name); MDNS.addServiceTxt(MDNS_SERVICE, MDNS_PROTO, #name, buf); }
+    TXT(ac_mode);
+    TXT(fan_mode);
+    TXT(call);
+#undef TXT
+}
+
+static MdnsTxt mdns_state()
+{
+    MdnsTxt t;
+    memset(&t, 0, sizeof(t)); // The structure is compared as a whole, including its padding
+    t.temp_valid = wdata.get_temp_valid();
+    t.temp = t.temp_valid ? wdata.get_temp() : 0;
+    t.ac_mode = wdata.ac_mode;
+    t.fan_mode = wdata.fan_mode;
+    t.call = wdata.call;
+    return t;
+}
+
+// Called once the WiFi connected for the first time; the responder follows the later reconnects by itself
+void setup_mdns()
+{
+    // Host names are letters, digits and hyphens
+    char host[32];
+    int len = 0;
+    for (const char *p = wdata.id; *p && (len < int(sizeof(host)) - 1); p++)
+        host[len++] = isalnum(*p) ? tolower(*p) : '-';
+    host[len] = 0;
+    if (!len)
+        strcpy(host, "thermostat");
+
+    if (!MDNS.begin(host))
+    {
+        log_write(LOG_ERROR, LOG_MDNS, "Responder failed to start");
+        return;
+    }
+    MDNS.setInstanceName(wdata.id);
+    MDNS.addService(MDNS_SERVICE, MDNS_PROTO, 80);
+    MDNS.addServiceTxt(MDNS_SERVICE, MDNS_PROTO, "id", wdata.id);
+    txt = mdns_state();
+    mdns_txt(txt, nullptr);
+    txt_at = wdata.seconds;
+    started = true;
+    log_write(LOG_INFO, LOG_MDNS, "Responder started");
+}
+
+// Called from the network task, never blocks
+void mdns_loop()
+{
+    if (!started || (wdata.seconds - txt_at < MDNS_TXT_SEC))
+        return;
+    MdnsTxt t = mdns_state();
+    if (memcmp(&t, &txt, sizeof(MdnsTxt)))
+    {
+        mdns_txt(t, &txt);
+        txt = t;
+        txt_at = wdata.seconds;
+    }
+}
+
+// Queries the network for the name, which is the part of an mDNS name before any port or path
+static bool mdns_query(const char *name, IPAddress &ip, uint16_t &port)
+{
+    if (name[0] == '_')
+    {
+        // "_service._tcp[@host]"
+        char service[sizeof(wdata.ext_server)];
+        strcpy(service, name);
+        char *host = strchr(service, '@');
+        if (host)
+            *host++ = 0;
+        char *proto = strchr(service, '.');
+        if (!proto)
+            return false;
+        *proto++ = 0;
+        int n = MDNS.queryService(service, proto);
+        for (int i = 0; i < n; i++)
+        {
+            if (!host || !strcasecmp(MDNS.hostname(i).c_str(), host))
+            {
+                ip = MDNS.IP(i);
+                port = MDNS.port(i);
+                return uint32_t(ip) != 0;
+            }
+        }
+        return false;
+    }
+    // "name.local"
+    char host[sizeof(wdata.ext_server)];
+    strcpy(host, name);
+    char *colon = strchr(host, ':');
+    if (colon)
+        *colon = 0;
+    host[strlen(host) - strlen(".local")] = 0;
+    ip = MDNS.queryHost(host, MDNS_HOST_TIMEOUT);
+    return uint32_t(ip) != 0;
+}
+
+// Copies the name without a path, which is the key of the cache
+static void mdns_key(const char *name, char *host)
+{
+    strncpy(host, name, sizeof(wdata.ext_server) - 1);
+    host[sizeof(wdata.ext_server) - 1] = 0;
+    char *slash = strchr(host, '/');
+    if (slash)
+        *slash = 0;
+}
+
+// Resolves the external sensor name into its address and port. Blocks for the time of a query on a cache miss,
+// so it is called only from the external sensor task.
+bool mdns_resolve(const char *name, IPAddress &ip, uint16_t &port)
+{
+    char host[sizeof(wdata.ext_server)];
+    mdns_key(name, host);
+    char *colon = strchr(host, ':');
+    port = colon ? atoi(colon + 1) : 80;
+
+    size_t len = colon ? size_t(colon - host) : strlen(host);
+    bool local = (len > 6) && !strncasecmp(host + len - 6, ".local", 6);
+    if ((host[0] != '_') && !local)
+    {
+        // An address or a DNS name, the DNS client does its own caching
+        if (colon)
+            *colon = 0;
+        return host[0] && (ip.fromString(host) || WiFi.hostByName(host, ip));
+    }
+
+    uint32_t now = millis();
+    MdnsEntry *e = nullptr;
+    for (int i = 0; (i < MDNS_CACHE) && !e; i++)
+        if (!strcmp(cache[i].name, host))
+            e = &cache[i];
+    if (e && (now - e->resolved_at < MDNS_CACHE_MS))
+    {
+        wdata.mdns_hits++;
+        ip = e->ip;
+        port = e->port;
+        return true;
+    }
+    if (!e)
+    {
+        // Take a free slot, or else the one resolved the longest time ago
+        e = &cache[0];
+        for (int i = 1; (i < MDNS_CACHE) && e->name[0]; i++)
+            if (!cache[i].name[0] || (int32_t(cache[i].resolved_at - e->resolved_at) < 0))
+                e = &cache[i];
+    }
+
+    wdata.mdns_queries++;
+    if (!mdns_query(host, ip, port))
+    {
+        wdata.mdns_fails++;
+        e->name[0] = 0;
+        return false;
+    }
+    wdata.mdns_query_ms = millis() - now;
+    wdata.mdns_query_max_ms = max(wdata.mdns_query_ms, wdata.mdns_query_max_ms);
+    strcpy(e->name, host);
+    e->ip = ip;
+    e->port = port;
+    e->resolved_at = now;
+    return true;
+}
+
+// Drops the cached address of a name, after a connection to it failed
+void mdns_forget(const char *name)
+{
+    char host[sizeof(wdata.ext_server)];
+    mdns_key(name, host);
+    for (int i = 0; i < MDNS_CACHE; i++)
+        if (!strcmp(cache[i].name, host))
+            cache[i].name[0] = 0;
+}
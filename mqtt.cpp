@@ -0,0 +1,250 @@
+#include "main.h"
+#include <WiFi.h>
+#include <AsyncMqttClient.h>
+#include "control.h"
+
+// MQTT telemetry and commands
+// Requires library: "AsyncMqttClient" by Marvin Roger (https://github.com/marvinroger/async-mqtt-client),
+// which runs on top of the AsyncTCP library already used by the web server
+//
+// Once a second, the state is compared with the last one published and the changed fields are batched into a
+// single json message on <mqtt_topic>/state. The whole state, including the run time counters (which change every
+// second and so do not trigger a message by themselves), is published as a heartbeat every MQTT_HEARTBEAT_SEC.
+// Messages wait in a bounded queue while the broker is down, the oldest one is dropped when it is full. A message
+// is removed from the queue only once the broker acknowledged it (QoS 1), so nothing is lost over a reconnect.
+// Commands are received on <mqtt_topic>/set/<name> with the value as the payload, for the names fan_mode, ac_mode,
+// cool_to and heat_to (in the display units).
+// The broker is set in NV ("mqtt_server") as "host" or "host:port", so a local broker can stand in for tests;
+// the broker settings are read at boot.
+
+#define MQTT_PORT           1883
+#define MQTT_HEARTBEAT_SEC    60 // Period of the full state messages
+#define MQTT_QUEUE             8 // Number of messages buffered while the broker is down
+#define MQTT_MSG_SIZE        384 // Longest message, the full state
+#define MQTT_RETRY_MIN_MS   2000 // Reconnect backoff doubles from this value
+#define MQTT_RETRY_MAX_MS  60000 // up to this value
+
+struct MqttState
+{
+    temp_t temp;
+    bool temp_valid;
+    uint8_t relays;
+    uint8_t fan_mode;
+    uint8_t ac_mode;
+    uint8_t call;
+    uint8_t stage;
+    temp_t cool_to;
+    temp_t heat_to;
+    uint32_t status;
+};
+
+struct MqttMessage
+{
+    uint32_t queued_us;   // esp_timer time when the message was queued, to measure the publish latency
+    char text[MQTT_MSG_SIZE];
+};
+
+static AsyncMqttClient mqtt;
+static MqttState last;                // State published last
+static MqttMessage queue[MQTT_QUEUE]; // Circular queue of messages waiting to be published
+static uint32_t queue_head = 0;       // Index of the oldest message
+static uint16_t inflight_id = 0;      // Packet id of the published head message waiting on its ack, 0 if none
+static volatile uint16_t acked_id = 0;// Packet id of the last ack, written by the AsyncTCP task
+static volatile bool connected = false;
+static bool connecting = false;
+static uint32_t retry_ms = MQTT_RETRY_MIN_MS;
+static uint32_t retry_at = 0;
+static uint32_t last_second = 0;
+static uint32_t heartbeat_at = 0;     // wdata.seconds of the next heartbeat
+// The client keeps pointers to these strings, they have to stay valid even when wdata changes
+static char host[sizeof(wdata.mqtt_server)];
+static char client_id[sizeof(wdata.id)];
+static char user[sizeof(wdata.mqtt_user)];
+static char pass[sizeof(wdata.mqtt_pass)];
+static char topic_state[sizeof(wdata.mqtt_topic) + 8];
+static char topic_set[sizeof(wdata.mqtt_topic) + 8];
+
+// Prints the fields of the state which differ from the previous one, or all of them if prev is null
+static int print_state(char *p, const MqttState &s, const MqttState *prev)
+{
+    char *start = p;
+    p += sprintf(p, "{\"ts\":%d,\"uptime\":%d", wdata.timestamp, wdata.seconds);
+#define FIELD(name, fmt, value) if (!prev || (s.name != prev->name)) p += sprintf(p, ",\"" #name "\":" fmt, value)
+    FIELD(temp_valid, "%d", s.temp_valid);
+    if (s.temp_valid)
+        FIELD(temp, "%.1f", temp_to_units(s.temp));
+    FIELD(relays, "%d", s.relays);
+    FIELD(fan_mode, "%d", s.fan_mode);
+    FIELD(ac_mode, "%d", s.ac_mode);
+    FIELD(call, "%d", s.call);
+    FIELD(stage, "%d", s.stage);
+    FIELD(cool_to, "%.1f", temp_to_units(s.cool_to));
+    FIELD(heat_to, "%.1f", temp_to_units(s.heat_to));
+    FIELD(status, "%d", s.status);
+#undef FIELD
+    if (!prev)
+    {
+        p += sprintf(p, ",\"units\":\"%s\",\"filter_sec\":%d,\"cool_sec\":%d,\"heat_sec\":%d,\"filter_pct\":%d",
+            units_str(), wdata.filter_sec, wdata.cool_sec, wdata.heat_sec, control.filter_pct());
+    }
+    p += sprintf(p, "}");
+    return p - start;
+}
+
+// Adds a message to the queue, dropping the oldest one if it is full
+static void mqtt_queue(const MqttState &s, bool full)
+{
+    if (wdata.mqtt_queued == MQTT_QUEUE)
+    {
+        queue_head = (queue_head + 1) % MQTT_QUEUE;
+        wdata.mqtt_queued--;
+        wdata.mqtt_dropped++;
+        inflight_id = 0; // If the head was in flight, it is gone now
+    }
+    MqttMessage &m = queue[(queue_head + wdata.mqtt_queued) % MQTT_QUEUE];
+    m.queued_us = esp_timer_get_time();
+    print_state(m.text, s, full ? nullptr : &last);
+    wdata.mqtt_queued++;
+}
+
+static void mqtt_command(const char *name, const char *value)
+{
+    char *p_next;
+    float f = strtof(value, &p_next);
+    if ((p_next == value) || *p_next || !isfinite(f))
+        return;
+
+    if (!strcmp(name, "fan_mode") && (f >= FAN_MODE_OFF) && (f <= FAN_MODE_LAST))
+        control.set_fan_mode(f);
+    else if (!strcmp(name, "ac_mode") && (f >= AC_MODE_OFF) && (f <= AC_MODE_LAST))
+        control.set_ac_mode(f);
+    else if (!strcmp(name, "cool_to") && (f > -50) && (f < 150))
+        control.set_cool_to(temp_from_units(f));
+    else if (!strcmp(name, "heat_to") && (f > -50) && (f < 150))
+        control.set_heat_to(temp_from_units(f));
+    else
+        return;
+
+    xI2CMessage xMessage;
+    xMessage.xMessageType = I2C_PRINT_STATUS;
+    xQueueSend(xI2CQueue, &xMessage, portMAX_DELAY);
+}
+
+void setup_mqtt()
+{
+    if (!wdata.mqtt_server[0])
+        return;
+
+    strcpy(host, wdata.mqtt_server);
+    uint16_t port = MQTT_PORT;
+    char *colon = strchr(host, ':');
+    if (colon)
+    {
+        *colon = 0;
+        port = atoi(colon + 1);
+    }
+    strcpy(client_id, wdata.id);
+    strcpy(user, wdata.mqtt_user);
+    strcpy(pass, wdata.mqtt_pass);
+    sprintf(topic_state, "%s/state", wdata.mqtt_topic);
+    sprintf(topic_set, "%s/set/#", wdata.mqtt_topic);
+
+    // The callbacks run in the AsyncTCP task
+    mqtt.onConnect([](bool session_present)
+    {
+        connected = true;
+        retry_ms = MQTT_RETRY_MIN_MS;
+        mqtt.subscribe(topic_set, 1);
+    });
+    mqtt.onDisconnect([](AsyncMqttClientDisconnectReason reason)
+    {
+        if (connected)
+            log_write(LOG_WARN, LOG_MQTT, "Disconnected, reason %d", int(reason));
+        connected = false;
+        connecting = false;
+    });
+    mqtt.onPublish([](uint16_t packet_id)
+    {
+        acked_id = packet_id;
+    });
+    mqtt.onMessage([](char *name, char *payload, AsyncMqttClientMessageProperties properties, size_t len, size_t index, size_t total)
+    {
+        // Commands are short, a fragmented payload is not a command
+        char value[16];
+        if ((index != 0) || (len != total) || (len >= sizeof(value)))
+            return;
+        memcpy(value, payload, len);
+        value[len] = 0;
+        const char *p = strrchr(name, '/');
+        mqtt_command(p ? p + 1 : name, value);
+    });
+    mqtt.setServer(host, port);
+    mqtt.setClientId(client_id);
+    if (user[0])
+        mqtt.setCredentials(user, pass);
+    mqtt.setKeepAlive(MQTT_HEARTBEAT_SEC);
+}
+
+// Called from the network task, never blocks
+void mqtt_loop()
+{
+    if (!host[0])
+        return;
+
+    // The head message was acknowledged: remove it from the queue
+    if (inflight_id && (acked_id == inflight_id))
+    {
+        prof_mqtt.add(uint32_t(esp_timer_get_time()) - queue[queue_head].queued_us);
+        queue_head = (queue_head + 1) % MQTT_QUEUE;
+        wdata.mqtt_queued--;
+        inflight_id = 0;
+    }
+
+    // Once a tick, batch all the changes into one message
+    if (wdata.seconds != last_second)
+    {
+        last_second = wdata.seconds;
+        MqttState s;
+        memset(&s, 0, sizeof(s)); // The structure is compared as a whole, including its padding
+        s.temp = wdata.get_temp();
+        s.temp_valid = wdata.get_temp_valid();
+        s.relays = wdata.relays;
+        s.fan_mode = wdata.fan_mode;
+        s.ac_mode = wdata.ac_mode;
+        s.call = wdata.call;
+        s.stage = wdata.stage;
+        s.cool_to = wdata.cool_to;
+        s.heat_to = wdata.heat_to;
+        s.status = wdata.status;
+        bool heartbeat = int32_t(wdata.seconds - heartbeat_at) >= 0;
+        if (heartbeat || memcmp(&s, &last, sizeof(MqttState)))
+        {
+            mqtt_queue(s, heartbeat);
+            last = s;
+        }
+        if (heartbeat)
+            heartbeat_at = wdata.seconds + MQTT_HEARTBEAT_SEC;
+    }
+
+    if (!connected)
+    {
+        inflight_id = 0; // An unacknowledged message is published again after the reconnect
+        if (!connecting && (WiFi.status() == WL_CONNECTED) && (int32_t(millis() - retry_at) >= 0))
+        {
+            connecting = true;
+            retry_at = millis() + retry_ms;
+            retry_ms = min(retry_ms * 2, uint32_t(MQTT_RETRY_MAX_MS));
+            mqtt.connect();
+        }
+        else if (connecting && (int32_t(millis() - retry_at) >= 0))
+            connecting = false; // The attempt did not complete in time, allow the next one
+        return;
+    }
+
+    // Publish the oldest message, one at a time so that they arrive in order
+    if (!inflight_id && wdata.mqtt_queued)
+    {
+        const char *text = queue[queue_head].text;
+        inflight_id = mqtt.publish(topic_state, 1, false, text, strlen(text));
+    }
+}
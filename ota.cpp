@@ -0,0 +1,245 @@
+#include "main.h"
+#include <ESPAsyncWebServer.h>
+#include "esp_ota_ops.h"
+#include "mbedtls/sha256.h"
+
+// Streaming, resumable OTA firmware update
+//
+// The firmware image is POSTed to /ota as raw binary chunks, each one with its file offset, the total size and the
+// expected SHA-256 digest of the whole image as the URL arguments:
+//     POST /ota?size=<bytes>&sha256=<hex>&offset=<bytes>
+// Every response (and GET /ota) returns the current state, including the offset the client should continue from,
+// so an interrupted upload is resumed by re-sending from that offset. The new partition is selected for boot only
+// after the digest matches. The new image then runs on trial; it is marked valid once the control loop has been
+// running healthy for OTA_TRIAL_MIN minutes. If it crashes, gets reset by a watchdog or rebooted by the supervisor
+// before that, or the control loop did not keep pace during the trial, the previous image is booted again.
+
+extern AsyncWebServer server;
+
+#define OTA_BUF_SIZE     4096 // Bounded buffer, image data is written to flash in blocks of this size
+#define OTA_TRIAL_MIN      10 // Minutes the new image needs to run healthy before it is marked valid
+#define OTA_RESTART_MS   1000 // Delay before restarting into the new image, lets the last response go out
+
+static esp_ota_handle_t ota_handle = 0;
+static const esp_partition_t *ota_part = nullptr;
+static mbedtls_sha256_context ota_sha;
+static uint8_t ota_buf[OTA_BUF_SIZE];
+static uint32_t ota_buf_len = 0;
+static uint32_t ota_size = 0;         // Total size of the image being received
+static uint32_t ota_received = 0;     // Bytes received so far (written plus buffered); the resume offset
+static char ota_digest[65] {};        // Expected SHA-256 digest in hex
+static uint32_t ota_start_ms = 0;     // millis() when the upload started
+static uint32_t ota_restart_at = 0;   // millis() when to restart into the new image, 0 if not pending
+static const char *ota_state = "idle";// idle, receiving, verified or failed
+static const char *ota_error = "";
+
+static void ota_fail(const char *error)
+{
+    if (ota_handle)
+        esp_ota_end(ota_handle);
+    ota_handle = 0;
+    mbedtls_sha256_free(&ota_sha);
+    ota_state = "failed";
+    ota_error = error;
+    log_write(LOG_ERROR, LOG_OTA, "OTA failed: %s", uintptr_t(error));
+}
+
+static bool ota_flush()
+{
+    if (ota_buf_len && (esp_ota_write(ota_handle, ota_buf, ota_buf_len) != ESP_OK))
+    {
+        ota_fail("flash write");
+        return false;
+    }
+    ota_buf_len = 0;
+    return true;
+}
+
+static void ota_begin(uint32_t size, const char *digest)
+{
+    if (ota_handle)
+        ota_fail("restarted");
+
+    ota_part = esp_ota_get_next_update_partition(nullptr);
+    if (!ota_part || (size == 0) || (size > ota_part->size) || (strlen(digest) != 64))
+    {
+        ota_fail("invalid size or digest");
+        return;
+    }
+    if (esp_ota_begin(ota_part, size, &ota_handle) != ESP_OK)
+    {
+        ota_handle = 0;
+        ota_fail("begin");
+        return;
+    }
+    mbedtls_sha256_init(&ota_sha);
+    mbedtls_sha256_starts_ret(&ota_sha, 0);
+    strcpy(ota_digest, digest);
+    ota_size = size;
+    ota_received = 0;
+    ota_buf_len = 0;
+    ota_start_ms = millis();
+    ota_state = "receiving";
+    ota_error = "";
+
+    // Stop the web client during the OTA
+    wdata.ext_read_sec = 0;
+}
+
+static void ota_finish()
+{
+    if (!ota_flush())
+        return;
+
+    uint8_t hash[32];
+    char hex[65];
+    mbedtls_sha256_finish_ret(&ota_sha, hash);
+    mbedtls_sha256_free(&ota_sha);
+    for (int i = 0; i < 32; i++)
+        sprintf(hex + i * 2, "%02x", hash[i]);
+
+    if (strcasecmp(hex, ota_digest))
+    {
+        ota_fail("digest mismatch");
+        return;
+    }
+    esp_err_t err = esp_ota_end(ota_handle); // Also validates the image
+    ota_handle = 0;
+    if ((err != ESP_OK) || (esp_ota_set_boot_partition(ota_part) != ESP_OK))
+    {
+        ota_fail("image not valid");
+        return;
+    }
+
+    uint32_t ms = max(millis() - ota_start_ms, 1UL);
+    wdata.ota_kbps = uint64_t(ota_size) * 1000 / 1024 / ms;
+    wdata.ota_pending = 1;
+    pref_set("ota_kbps", wdata.ota_kbps);
+    pref_set("ota_pending", wdata.ota_pending);
+
+    ota_state = "verified";
+    ota_restart_at = millis() + OTA_RESTART_MS;
+    log_write(LOG_INFO, LOG_OTA, "OTA verified, %d bytes at %d KB/s, rebooting", ota_size, wdata.ota_kbps);
+}
+
+// Accepts a chunk of the image at the given file offset. Data which does not continue exactly where
+// the previous chunk ended is ignored; the client learns the correct offset from the response.
+static void ota_write(uint32_t offset, const uint8_t *data, size_t len)
+{
+    if (!ota_handle || (offset != ota_received))
+        return;
+    len = min(len, size_t(ota_size - ota_received));
+    mbedtls_sha256_update_ret(&ota_sha, data, len);
+    ota_received += len;
+
+    while (len)
+    {
+        size_t n = min(len, size_t(OTA_BUF_SIZE - ota_buf_len));
+        memcpy(ota_buf + ota_buf_len, data, n);
+        ota_buf_len += n;
+        data += n;
+        len -= n;
+        if ((ota_buf_len == OTA_BUF_SIZE) && !ota_flush())
+            return;
+    }
+    if (ota_received == ota_size)
+        ota_finish();
+}
+
+static void ota_send_status(AsyncWebServerRequest *request)
+{
+    static char buf[256];
+    uint32_t ms = max(millis() - ota_start_ms, 1UL);
+    uint32_t kbps = ota_handle ? uint64_t(ota_received) * 1000 / 1024 / ms : wdata.ota_kbps;
+    snprintf(buf, sizeof(buf),
+        "{ \"state\":\"%s\", \"error\":\"%s\", \"offset\":%d, \"size\":%d, \"sha256\":\"%s\", \"kbps\":%d"
+        ", \"pending\":%d, \"downtime_ms\":%d, \"rollbacks\":%d }",
+        ota_state, ota_error, ota_received, ota_size, ota_digest, kbps,
+        wdata.ota_pending, wdata.ota_downtime_ms, wdata.ota_rollbacks);
+    AsyncWebServerResponse *response = request->beginResponse(200, "application/json", buf);
+    response->addHeader("Connection", "close");
+    request->send(response);
+}
+
+void setup_ota()
+{
+    server.on("/ota", HTTP_GET, ota_send_status);
+    server.on("/ota", HTTP_POST, [](AsyncWebServerRequest *request)
+    {
+        if (auth_request(request, false))
+            ota_send_status(request);
+    }, nullptr,
+        [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+    {
+        // The response to an unauthenticated upload is sent once the request completes
+        if (!auth_check(request))
+            return;
+        uint32_t offset = strtoul(request_arg(request, "offset"), nullptr, 0);
+        // A chunk at the offset 0 (re)starts the upload, unless it is a retry of the very first chunk
+        if ((index == 0) && (offset == 0) && !(ota_handle && (ota_received == 0)))
+            ota_begin(strtoul(request_arg(request, "size"), nullptr, 0), request_arg(request, "sha256"));
+        if (!strcasecmp(request_arg(request, "sha256"), ota_digest))
+            ota_write(offset + index, data, len);
+    });
+}
+
+// Ends the trial of the running image as failed and selects the previous image for the next boot. Does nothing if
+// no image is on trial. The reason is logged by reference, it has to be a literal. Returns true if the previous image was selected, the caller then restarts.
+bool ota_rollback(const char *why)
+{
+    if (!wdata.ota_pending)
+        return false;
+    // With two OTA slots, the next update partition is the one we came from
+    const esp_partition_t *prev = esp_ota_get_next_update_partition(nullptr);
+    wdata.ota_pending = 0;
+    wdata.ota_rollbacks++;
+    pref_set("ota_pending", wdata.ota_pending);
+    pref_set("ota_rollbacks", wdata.ota_rollbacks);
+    if (!prev || (esp_ota_set_boot_partition(prev) != ESP_OK))
+    {
+        log_write(LOG_ERROR, LOG_OTA, "OTA image failed on trial (%s), no image to roll back to", uintptr_t(why));
+        return false;
+    }
+    log_write(LOG_ERROR, LOG_OTA, "OTA image failed on trial (%s), rolling back", uintptr_t(why));
+    return true;
+}
+
+// Runs at boot, before the control tasks start. Decides whether an image on trial should be rolled back.
+void ota_boot_check()
+{
+    if (!wdata.ota_pending)
+        return;
+
+    // A crash or a watchdog reset of the image on trial rolls back to the previous image; a power cycle does not.
+    // A reboot by the supervisor is a software reset, it rolled back already if it had to (see reboot()).
+    esp_reset_reason_t reason = esp_reset_reason();
+    if ((reason == ESP_RST_PANIC) || (reason == ESP_RST_INT_WDT) || (reason == ESP_RST_TASK_WDT) || (reason == ESP_RST_WDT))
+        if (ota_rollback((reason == ESP_RST_PANIC) ? "crash" : "watchdog"))
+            esp_restart();
+}
+
+// Called from the network task
+void ota_loop()
+{
+    if (ota_restart_at && (int32_t(millis() - ota_restart_at) >= 0))
+        esp_restart();
+
+    // Downtime is the time from the reboot into the new image until the controller resumed
+    if (wdata.ota_pending && !wdata.ota_downtime_ms)
+        wdata.ota_downtime_ms = wdata.resume_ms;
+
+    // The image on trial is healthy if the control loop kept pace with the uptime for the whole trial. Both count
+    // seconds, so a control loop which fell behind never catches up: at the end of the trial, the image either
+    // passed or failed, it does not stay on trial.
+    if (wdata.ota_pending && (wdata.seconds >= OTA_TRIAL_MIN * 60))
+    {
+        if (wdata.control_ticks + 5 >= wdata.seconds)
+        {
+            wdata.ota_pending = 0;
+            pref_set("ota_pending", wdata.ota_pending);
+            log_write(LOG_INFO, LOG_OTA, "OTA image marked valid");
+        }
+        else if (ota_rollback("control loop behind"))
+            esp_restart();
+    }
+}
@@ -0,0 +1,98 @@
+#include "main.h"
+#include <WiFi.h>
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_freertos_hooks.h"
+
+// Power management: dynamic frequency scaling, WiFi modem sleep and automatic light sleep
+//
+// Automatic light sleep needs the IDF to be built with CONFIG_PM_ENABLE and CONFIG_FREERTOS_USE_TICKLESS_IDLE.
+// If esp_pm_configure() reports that it is not supported, we fall back to a fixed lower CPU frequency and
+// modem sleep only. Either way, the idle hooks below measure how much time each core spends idle (or asleep).
+
+#define PM_MAX_FREQ_MHZ  240
+#define PM_MIN_FREQ_MHZ   40 // Lowest DFS frequency (XTAL) while all tasks are blocked
+#define PM_FIXED_MHZ      80 // Fallback fixed frequency, the lowest one which still runs the WiFi
+
+static bool light_sleep = false; // True if the automatic light sleep is enabled
+static volatile uint64_t idle_us[portNUM_PROCESSORS];   // Accumulated idle time per core
+static int64_t idle_last[portNUM_PROCESSORS];           // Time of the previous idle hook call per core
+static uint64_t idle_prev[portNUM_PROCESSORS];          // Idle time at the previous power_update() call
+static int64_t update_last = 0;                         // Time of the previous power_update() call
+
+// Called repeatedly from the idle task of each core. Consecutive calls are one tick apart when the core stays
+// idle (it waits for an interrupt in between), or farther apart when it slept through several ticks.
+static inline void idle_account(int cpu)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t delta = now - idle_last[cpu];
+    idle_last[cpu] = now;
+
+    // Without the tickless idle, anything longer than one tick means that other tasks ran in between
+    if (!light_sleep && (delta > 1000000 / configTICK_RATE_HZ))
+        return;
+    idle_us[cpu] += delta;
+
+    // A longer gap with the light sleep enabled means we just woke up, record the reason
+    if (light_sleep && (delta > 1000000 / configTICK_RATE_HZ))
+    {
+        esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+        if (cause == ESP_SLEEP_WAKEUP_TIMER)
+            wdata.wake_timer++;
+        else if (cause == ESP_SLEEP_WAKEUP_GPIO)
+            wdata.wake_gpio++;
+        else
+            wdata.wake_other++;
+    }
+}
+
+static bool idle_hook_pro() { idle_account(PRO_CPU); return true; }
+static bool idle_hook_app() { idle_account(APP_CPU); return true; }
+
+// Applies the current wdata.power_save setting, can be called again to change it at run time
+void setup_power()
+{
+    static bool hooks = false;
+    if (!hooks)
+    {
+        esp_register_freertos_idle_hook_for_cpu(idle_hook_pro, PRO_CPU);
+        esp_register_freertos_idle_hook_for_cpu(idle_hook_app, APP_CPU);
+        hooks = true;
+    }
+
+    esp_pm_config_esp32_t pm_config;
+    pm_config.max_freq_mhz = PM_MAX_FREQ_MHZ;
+    pm_config.min_freq_mhz = wdata.power_save ? PM_MIN_FREQ_MHZ : PM_MAX_FREQ_MHZ;
+    pm_config.light_sleep_enable = wdata.power_save;
+
+    esp_err_t err = esp_pm_configure(&pm_config);
+    light_sleep = (err == ESP_OK) && wdata.power_save;
+    if (err == ESP_ERR_NOT_SUPPORTED)
+        setCpuFrequencyMhz(wdata.power_save ? PM_FIXED_MHZ : PM_MAX_FREQ_MHZ);
+
+    // Buttons have to wake up the chip from the light sleep, and go back to their edge interrupts when it is turned off
+    buttons_wakeup(light_sleep);
+
+    // In the modem sleep, the radio wakes up only to listen to the AP beacons at each DTIM interval
+    WiFi.setSleep(wdata.power_save);
+}
+
+// Called once a second to refresh the idle percentages
+void power_update()
+{
+    int64_t now = esp_timer_get_time();
+    int64_t elapsed = now - update_last;
+    update_last = now;
+    if (elapsed <= 0)
+        return;
+
+    for (int cpu = 0; cpu < portNUM_PROCESSORS; cpu++)
+    {
+        uint64_t idle = idle_us[cpu];
+        uint32_t pct = (idle - idle_prev[cpu]) * 100 / elapsed;
+        wdata.idle_pct[cpu] = (pct > 100) ? 100 : pct;
+        idle_prev[cpu] = idle;
+    }
+    wdata.cpu_mhz = getCpuFrequencyMhz();
+    wdata.light_sleep = light_sleep;
+}
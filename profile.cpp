@@ -0,0 +1,190 @@
+#include "main.h"
+#include <esp_heap_caps.h>
+#include <stdarg.h>
+
+// Run-time profiler: task scheduling latency, button ISR-to-handler latency and per task CPU usage
+//
+// Latencies are collected into histograms with logarithmic buckets: bucket 0 counts values below 16 us,
+// bucket i counts values in [16 << (i-1), 16 << i) us, and the last bucket counts everything above.
+// Per task CPU usage needs the FreeRTOS run-time stats (configGENERATE_RUN_TIME_STATS); without them,
+// only the per core load from the idle hooks in power.cpp is reported.
+//
+// The heap monitor reports the free heap, its low water mark and fragmentation (1 - largest free block / free),
+// and, per subsystem, how much free heap its calls left behind, as [ calls, lost_calls, lost_bytes ]. This is the
+// net change of the free heap from before a call to after it, not a count or a size of its allocations: what a
+// call allocates and frees again is not seen at all, memory it hands over to be freed later (a response on its way
+// out) is seen as lost, and the allocations and frees of the other tasks in the meantime are counted too. So only a
+// trend means something: a subsystem whose lost_bytes keep growing over many calls is leaking or fragmenting.
+// Finding the allocations themselves takes the heap tracing of ESP-IDF (CONFIG_HEAP_TRACING), which the prebuilt
+// Arduino core does not have.
+
+Histogram prof_control;   // vTask_control wake latency
+Histogram prof_tick;      // vTask_1s_tick wake latency
+Histogram prof_gpio;      // Button ISR to vTask_gpio latency
+Histogram prof_lcd;       // Button ISR to the LCD showing the result (includes the debounce time)
+Histogram prof_set;       // Time spent in the /set request handler
+Histogram prof_auth;      // Time spent authenticating and rate limiting a request
+Histogram prof_mqtt;      // MQTT message queued to acknowledged by the broker
+
+HeapStat heap_wifi;       // wifi_check_loop()
+HeapStat heap_ota;        // ota_loop()
+HeapStat heap_clock;      // clock_loop()
+HeapStat heap_mqtt;       // mqtt_loop()
+HeapStat heap_ext;        // Reading the external sensor
+HeapStat heap_set;        // /set request handler, with its response which the server frees once it is sent
+HeapStat heap_json;       // /json request handler, up to its response
+
+void Histogram::add(uint32_t us)
+{
+    uint32_t i = 0;
+    while ((i < HIST_BUCKETS - 1) && (us >= (16UL << i)))
+        i++;
+    bucket[i]++;
+    count++;
+    if (us > max_us)
+        max_us = us;
+}
+
+// Called right after a periodic task wakes up from vTaskDelayUntil(). The first call anchors the schedule,
+// each subsequent call records how late the task woke up against its intended wake time.
+void prof_wake(WakeProfile &w, Histogram &hist)
+{
+    int64_t now = esp_timer_get_time();
+    if (w.next_us)
+    {
+        int64_t late = now - w.next_us;
+        if (late >= 0)
+        {
+            hist.add(late);
+            w.next_us += w.period_us;
+            return;
+        }
+    }
+    // First call, or the tick and the esp_timer clocks drifted apart: re-anchor the schedule
+    w.next_us = now + w.period_us;
+}
+
+// Returns the free heap, to be passed to heap_account() after the measured call
+uint32_t heap_mark()
+{
+    return heap_caps_get_free_size(MALLOC_CAP_8BIT);
+}
+
+void heap_account(HeapStat &stat, uint32_t mark)
+{
+    int32_t lost = int32_t(mark - heap_caps_get_free_size(MALLOC_CAP_8BIT));
+    stat.calls++;
+    if (lost > 0)
+        stat.lost_calls++;
+    stat.lost_bytes += lost;
+}
+
+// Prints into the /prof buffer up to its end and moves p past what was printed. Output which does not fit is cut
+// short and moves p to the end, the rest of the output is dropped then.
+static void put(char *&p, char *end, const char *fmt, ...)
+{
+    if (p == end)
+        return;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(p, end - p, fmt, args);
+    va_end(args);
+    p += ((n < 0) || (n >= end - p)) ? end - p : n;
+}
+
+static void print_heap(char *&p, char *end)
+{
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+    uint32_t frag_pct = info.total_free_bytes ? 100 - info.largest_free_block * 100 / info.total_free_bytes : 0;
+    put(p, end, ", \"heap\":{ \"free\":%d, \"min_free\":%d, \"largest\":%d, \"blocks\":%d, \"frag_pct\":%d",
+        info.total_free_bytes, info.minimum_free_bytes, info.largest_free_block, info.allocated_blocks, frag_pct);
+#define HEAP(name) put(p, end, ", \"" #name "\":[%d,%d,%d]", heap_##name.calls, heap_##name.lost_calls, heap_##name.lost_bytes)
+    HEAP(wifi);
+    HEAP(ota);
+    HEAP(clock);
+    HEAP(mqtt);
+    HEAP(ext);
+    HEAP(set);
+    HEAP(json);
+#undef HEAP
+    put(p, end, " }");
+}
+
+static void print_hist(char *&p, char *end, const char *name, const Histogram &hist)
+{
+    put(p, end, "\"%s\":{ \"count\":%d, \"max_us\":%d, \"hist\":[", name, hist.count, hist.max_us);
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        put(p, end, i ? ",%d" : "%d", hist.bucket[i]);
+    put(p, end, "] }");
+}
+
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+#define PROF_MAX_TASKS 24
+static TaskStatus_t tasks[PROF_MAX_TASKS];
+static uint32_t prev_number[PROF_MAX_TASKS]; // Task numbers and their run time counters at the previous call
+static uint32_t prev_runtime[PROF_MAX_TASKS];
+static uint32_t prev_total = 0;
+
+// Prints the percentage of CPU each task used since the previous call
+static void print_tasks(char *&p, char *end)
+{
+    uint32_t total;
+    UBaseType_t n = uxTaskGetSystemState(tasks, PROF_MAX_TASKS, &total);
+    // Total run time counts for one core, the percentages are of a single core and add up to 200%
+    uint32_t elapsed = max(total - prev_total, 1U);
+    prev_total = total;
+
+    put(p, end, ", \"tasks\":[");
+    for (UBaseType_t i = 0; i < n; i++)
+    {
+        uint32_t runtime = tasks[i].ulRunTimeCounter;
+        for (int j = 0; j < PROF_MAX_TASKS; j++)
+            if (prev_number[j] == tasks[i].xTaskNumber)
+                runtime -= prev_runtime[j];
+        put(p, end, "%s{ \"name\":\"%s\", \"prio\":%d, \"pct\":%d, \"stack\":%d }", i ? "," : "",
+            tasks[i].pcTaskName, tasks[i].uxCurrentPriority, uint32_t(uint64_t(runtime) * 100 / elapsed), tasks[i].usStackHighWaterMark);
+    }
+    put(p, end, "]");
+
+    for (UBaseType_t j = 0; j < PROF_MAX_TASKS; j++)
+    {
+        prev_number[j] = (j < n) ? tasks[j].xTaskNumber : 0;
+        prev_runtime[j] = (j < n) ? tasks[j].ulRunTimeCounter : 0;
+    }
+}
+#else
+static void print_tasks(char *&p, char *end) {}
+#endif
+
+// Prints the profiler results as json into the given buffer
+// Returns false if they did not fit, the output is cut short then
+bool get_profile_json(char *buf, size_t size)
+{
+    char *p = buf, *end = buf + size;
+    put(p, end, "{ ");
+    print_hist(p, end, "control", prof_control);
+    put(p, end, ", ");
+    print_hist(p, end, "tick", prof_tick);
+    put(p, end, ", ");
+    print_hist(p, end, "gpio", prof_gpio);
+    put(p, end, ", ");
+    print_hist(p, end, "lcd", prof_lcd);
+    put(p, end, ", ");
+    print_hist(p, end, "set", prof_set);
+    put(p, end, ", ");
+    print_hist(p, end, "auth", prof_auth);
+    put(p, end, ", ");
+    print_hist(p, end, "mqtt", prof_mqtt);
+    put(p, end, ", \"btn_bounces\":%d, \"btn_isr_max_us\":%d", wdata.btn_bounces, wdata.btn_isr_max_us);
+    put(p, end, ", \"load_pct\":[%d,%d], ", 100 - wdata.idle_pct[PRO_CPU], 100 - wdata.idle_pct[APP_CPU]);
+    if (p < end)
+    {
+        int n = get_log_prof_json(p, end - p);
+        p += ((n < 0) || (n >= end - p)) ? end - p : n;
+    }
+    print_heap(p, end);
+    print_tasks(p, end);
+    put(p, end, " }");
+    return p < end;
+}
@@ -0,0 +1,91 @@
+#include "main.h"
+
+// Sensor fusion: the effective temperature from the internal probe and the external sensor
+//
+// Switching straight to whichever sensor is valid makes the temperature jump by the difference between the two
+// rooms every time the external sensor drops out or comes back, and a flapping sensor then cycles the compressor.
+// Instead, each source has a health which rises by 1 every second it is valid, up to HEALTH_MAX, and falls by
+// HEALTH_DOWN every second it is not. The external sensor is preferred once its health reaches PREFER_ON, and until
+// it falls below PREFER_OFF, so it has to be valid for a good while before it is used again after an outage.
+// While both are valid, the offset of the internal probe against the external sensor is tracked, and the internal
+// reading stands in for the external one corrected by that offset; the offset fades out over hours once the
+// external sensor is gone. A change of the preferred source moves the weight of the external sensor by 1/BLEND_SEC
+// every second, so the effective temperature glides from one to the other, the external sensor weighing with its
+// last valid reading while it fades out.
+// It runs at the start of every control tick, on the readings in wdata, in integer arithmetic, so that a replay of
+// a trace computes exactly the same effective temperature as the device did.
+
+#define HEALTH_MAX       600 // Health after 10 minutes of valid readings
+#define HEALTH_DOWN        4 // Health lost every second without a valid reading, a full health lasts 2.5 minutes
+#define PREFER_ON  (HEALTH_MAX * 3 / 4)
+#define PREFER_OFF (HEALTH_MAX / 2)
+#define BLEND_SEC        300 // Time to move from one source to the other
+#define OFFSET_TAU_SEC   900 // Time constant of the offset tracking
+#define OFFSET_FADE_SEC (6 * 3600) // Time constant of the offset fading out while the external sensor is gone
+#define OFFSET_MAX       500 // Largest offset tracked, 5 C
+
+static void health(int source, bool valid)
+{
+    uint16_t &h = wdata.sensor_health[source];
+    h = valid ? min(h + 1, HEALTH_MAX) : max(h - HEALTH_DOWN, 0);
+}
+
+void sensor_fusion()
+{
+    bool int_valid = wdata.temp_valid, ext_valid = wdata.ext_valid;
+    health(SENSOR_INT, int_valid);
+    health(SENSOR_EXT, ext_valid);
+
+    if (int_valid && ext_valid)
+    {
+        int32_t diff = int32_t(constrain(wdata.ext_temp - wdata.temp, -OFFSET_MAX, OFFSET_MAX)) * 65536;
+        wdata.int_offset = wdata.int_offset_set ? wdata.int_offset + (diff - wdata.int_offset) / OFFSET_TAU_SEC : diff;
+        wdata.int_offset_set = true;
+    }
+    else if (!wdata.sensor_health[SENSOR_EXT])
+        wdata.int_offset -= wdata.int_offset / OFFSET_FADE_SEC;
+
+    if (wdata.sensor_health[SENSOR_EXT] >= PREFER_ON)
+        wdata.ext_preferred = true;
+    else if (wdata.sensor_health[SENSOR_EXT] < PREFER_OFF)
+        wdata.ext_preferred = false;
+    wdata.ext_weight = wdata.ext_preferred ? min(wdata.ext_weight + 1, BLEND_SEC) : max(wdata.ext_weight - 1, 0);
+
+    int32_t int_temp = wdata.temp + wdata.int_offset / 65536;
+    int32_t w = wdata.ext_weight;
+    uint32_t confidence;
+    if (!wdata.fusion)
+    {
+        // Hard switch, as the thermostat used to do
+        wdata.fused_source = ext_valid ? SOURCE_EXT : int_valid ? SOURCE_INT : SOURCE_NONE;
+        if (wdata.fused_source != SOURCE_NONE)
+            wdata.fused_temp = ext_valid ? wdata.ext_temp : wdata.temp;
+        confidence = wdata.sensor_health[ext_valid ? SENSOR_EXT : SENSOR_INT];
+    }
+    else if (int_valid)
+    {
+        // The external sensor weighs in, with its last valid reading, for as long as its weight is not 0
+        wdata.fused_source = (w == 0) ? SOURCE_INT : (w == BLEND_SEC) ? SOURCE_EXT : SOURCE_BLEND;
+        wdata.fused_temp = (w * wdata.ext_temp + (BLEND_SEC - w) * int_temp) / BLEND_SEC;
+        confidence = (w * wdata.sensor_health[SENSOR_EXT] + (BLEND_SEC - w) * wdata.sensor_health[SENSOR_INT]) / BLEND_SEC;
+    }
+    else if (ext_valid)
+    {
+        wdata.fused_source = SOURCE_EXT;
+        wdata.fused_temp = wdata.ext_temp;
+        confidence = wdata.sensor_health[SENSOR_EXT];
+    }
+    else
+    {
+        wdata.fused_source = SOURCE_NONE;
+        confidence = 0;
+    }
+    wdata.fused_valid = (wdata.fused_source != SOURCE_NONE);
+    wdata.fused_confidence = wdata.fused_valid ? confidence * 100 / HEALTH_MAX : 0;
+}
+
+const char *fused_source_str()
+{
+    static const char *const names[] { "none", "int", "ext", "blend" };
+    return names[wdata.fused_source & 3];
+}
@@ -0,0 +1,234 @@
+#include "main.h"
+#include <ESPAsyncWebServer.h>
+#include "control.h"
+
+// /set: the settings and the commands, one ?name=value at a time
+//
+// Every value is parsed whole and checked against its range before anything is stored, and only the first valid
+// key of a request is used. The handler is built on the host too, against a stand-in request, by the harness in
+// tools/set/ which replays recorded /set traffic, fuzzes the parsers and measures the requests per second.
+
+// Parsers of the ?name=value arguments; they return false unless the whole value is a valid number of the type
+static bool parse(const char *s, uint32_t &n)
+{
+    char *p_next;
+    errno = 0; // The strto* functions only ever set errno, a stale ERANGE would reject a good value
+    unsigned long long u = strtoull(s, &p_next, 0);
+    n = u;
+    // Requiring a leading digit rejects the sign and the whitespace which strtoull would accept
+    return isdigit(s[0]) && (*p_next == 0) && (errno != ERANGE) && (u <= UINT32_MAX);
+}
+
+static bool parse(const char *s, uint8_t &n)
+{
+    uint32_t u;
+    if (!parse(s, u) || (u > UINT8_MAX)) // Do not let the value silently truncate
+        return false;
+    n = u;
+    return true;
+}
+
+static bool parse(const char *s, int16_t &n)
+{
+    char *p_next;
+    errno = 0;
+    long l = strtol(s, &p_next, 10);
+    n = l;
+    // A sign is allowed, the whitespace is not
+    return (isdigit(s[0]) || ((s[0] == '-') && isdigit(s[1]))) && (*p_next == 0) && (errno != ERANGE) &&
+        (l >= INT16_MIN) && (l <= INT16_MAX);
+}
+
+static bool parse(const char *s, float &n)
+{
+    char *p_next;
+    errno = 0;
+    n = strtof(s, &p_next);
+    return !isspace(s[0]) && (p_next != s) && (*p_next == 0) && (errno != ERANGE) && isfinite(n);
+}
+
+static int print_value(char *buf, uint32_t n) { return sprintf(buf, "%u", n); }
+static int print_value(char *buf, uint8_t n) { return sprintf(buf, "%u", n); }
+static int print_value(char *buf, int16_t n) { return sprintf(buf, "%d", n); }
+static int print_value(char *buf, float n) { return sprintf(buf, "%.2f", n); }
+
+// Returns the value of the ?name=value argument, or an empty string if there is none. Unlike request->arg(), it
+// does not allocate a String for the name on every lookup.
+const char *request_arg(AsyncWebServerRequest *request, const char *name)
+{
+    for (size_t i = 0; i < request->params(); i++)
+    {
+        AsyncWebParameter *param = request->getParam(i);
+        if (!strcmp(param->name().c_str(), name))
+            return param->value().c_str();
+    }
+    return "";
+}
+
+// Parses the GET method ?name=value argument and returns false if the key or its value are not valid
+// When the key name is matched, and the value is correct and within [lo, hi], it updates the wdata reference
+// variable and its NV value
+template <class T>
+static bool get_parse_value(AsyncWebServerRequest *request, const char *key_name, T& dest, bool save_nv, double lo, double hi)
+{
+    const char *value = request_arg(request, key_name);
+    T n;
+    if (!value[0] || !parse(value, n) || (n < lo) || (n > hi))
+        return false;
+
+    dest = n; // Set the wdata.<key_name> member
+    if (save_nv)
+        pref_set(key_name, n); // Set the new value into an NV variable
+    char buf[24] = "OK ";
+    print_value(buf + 3, n);
+    request->send(200, "text/html", buf);
+    return true;
+}
+
+// Strings are trimmed and copied into the fixed-capacity wdata buffer; a value which does not fit is not valid
+template <size_t N>
+static bool get_parse_value(AsyncWebServerRequest *request, const char *key_name, char (&dest)[N], bool save_nv)
+{
+    const char *value = request_arg(request, key_name);
+    while (isspace(*value))
+        value++;
+    size_t len = strlen(value);
+    while (len && isspace(value[len - 1]))
+        len--;
+    if (!len || (len >= N))
+        return false;
+
+    for (size_t i = 0; i < len; i++)
+        dest[i] = (value[i] == '"') ? '\'' : value[i]; // Disallow the quotation character to ensure valid JSON output when printed
+    dest[len] = 0;
+    if (save_nv)
+        pref_set(key_name, dest);
+    char buf[N + 4];
+    sprintf(buf, "OK %s", dest);
+    request->send(200, "text/html", buf);
+    return true;
+}
+
+// Temperatures set through the web are limited to this range in either display units; the setpoints are further
+// clamped by the controller. The limits keep the conversion into temp_t from overflowing.
+#define TEMP_SET_MIN  -50
+#define TEMP_SET_MAX  150
+// Timestamps before 2020-01-01 are taken as a client with an unset clock
+#define TIMESTAMP_MIN  1577836800
+
+// Assigns a probe, given by its ROM code in hex, to a role
+static bool get_parse_probe(AsyncWebServerRequest *request, const char *key_name, int role)
+{
+    const char *value = request_arg(request, key_name);
+    if (!value[0] || (strlen(value) != 16) || !probe_assign(role, value))
+        return false;
+    char buf[24];
+    sprintf(buf, "OK %s", value);
+    request->send(200, "text/html", buf);
+    return true;
+}
+
+// Keys of /set which need more than their value stored, recorded by the parse chain below
+enum SetAction
+{
+    SET_NONE, SET_EQUIPMENT, SET_POWER_SAVE, SET_AC_EVAL_SEC, SET_FUSION, SET_FAN_MODE, SET_FAN_SEC, SET_AC_MODE,
+    SET_FILTER_RESET, SET_COOL_TO, SET_HEAT_TO, SET_HYST_TRIGGER, SET_HYST_RELEASE, SET_TEMP_MIN, SET_TEMP_MAX,
+    SET_TIMESTAMP
+};
+
+// Set a variable from the client side. The key/value pairs are passed using an HTTP GET method.
+void handleSet(AsyncWebServerRequest *request)
+{
+    if (!auth_request(request, true))
+        return;
+    uint32_t start = esp_timer_get_time();
+    uint32_t mark = heap_mark();
+    uint8_t u8 = 0;
+    float f = 0; // Temperatures and deltas are set in the display units
+    int action = SET_NONE;
+    // Updating one at a time will respond with "OK" followed by the new value; only the first valid key is used,
+    // and the action is taken for that key only, whichever other keys the request has
+#define ACTION(a) (action = (a))
+    bool ok =
+        get_parse_value(request, "id", wdata.id, true) ||
+        get_parse_value(request, "tag", wdata.tag, true) ||
+        get_parse_value(request, "ext_server", wdata.ext_server, true) ||
+        get_parse_value(request, "api_key", wdata.api_key, true) ||
+        get_parse_probe(request, "probe_return", PROBE_RETURN) ||
+        get_parse_probe(request, "probe_supply", PROBE_SUPPLY) ||
+        get_parse_probe(request, "probe_outdoor", PROBE_OUTDOOR) ||
+        get_parse_value(request, "ntp_server", wdata.ntp_server, true) ||
+        get_parse_value(request, "mqtt_server", wdata.mqtt_server, true) ||
+        get_parse_value(request, "mqtt_topic", wdata.mqtt_topic, true) ||
+        get_parse_value(request, "mqtt_user", wdata.mqtt_user, true) ||
+        get_parse_value(request, "mqtt_pass", wdata.mqtt_pass, true) ||
+        get_parse_value(request, "ext_read_sec", wdata.ext_read_sec, true, 0, 24 * 3600) ||
+        get_parse_value(request, "units", wdata.units, true, UNITS_F, UNITS_C) ||
+        (get_parse_value(request, "equipment", wdata.equipment, true, EQUIP_SINGLE, EQUIP_HP_B) && ACTION(SET_EQUIPMENT)) ||
+        get_parse_value(request, "filter_sec", wdata.filter_sec, true, 0, UINT32_MAX) ||
+        get_parse_value(request, "cool_sec", wdata.cool_sec, true, 0, UINT32_MAX) ||
+        get_parse_value(request, "heat_sec", wdata.heat_sec, true, 0, UINT32_MAX) ||
+        get_parse_value(request, "filter_life_h", wdata.filter_life_h, true, 1, 100000) ||
+        (get_parse_value(request, "power_save", wdata.power_save, true, 0, 1) && ACTION(SET_POWER_SAVE)) ||
+        get_parse_value(request, "fan_w", wdata.fan_w, true, 0, 100000) ||
+        get_parse_value(request, "cool_w", wdata.cool_w, true, 0, 100000) ||
+        get_parse_value(request, "cool2_w", wdata.cool2_w, true, 0, 100000) ||
+        get_parse_value(request, "heat_w", wdata.heat_w, true, 0, 100000) ||
+        get_parse_value(request, "heat2_w", wdata.heat2_w, true, 0, 100000) ||
+        get_parse_value(request, "tariff_base", wdata.tariff_base, true, 0, 1000000) ||
+        get_parse_value(request, "tariff_peak", wdata.tariff_peak, true, 0, 1000000) ||
+        get_parse_value(request, "peak_start", wdata.peak_start, true, 0, 24) ||
+        get_parse_value(request, "peak_end", wdata.peak_end, true, 0, 24) ||
+        get_parse_value(request, "utc_offset", wdata.utc_offset_min, true, -12 * 60, 14 * 60) ||
+        (get_parse_value(request, "ac_eval_sec", wdata.ac_eval_sec, true, AC_EVAL_SEC_MIN, AC_EVAL_SEC_MAX) && ACTION(SET_AC_EVAL_SEC)) ||
+        (get_parse_value(request, "fusion", wdata.fusion, true, 0, 1) && ACTION(SET_FUSION)) ||
+        // The following set of variables do not store their new value in NV
+        (get_parse_value(request, "fan_mode", u8, false, FAN_MODE_OFF, FAN_MODE_LAST) && ACTION(SET_FAN_MODE)) ||
+        (get_parse_value(request, "fan_sec", wdata.fan_sec, false, 0, 24 * 3600) && ACTION(SET_FAN_SEC)) ||
+        (get_parse_value(request, "ac_mode", u8, false, AC_MODE_OFF, AC_MODE_LAST) && ACTION(SET_AC_MODE)) ||
+        (get_parse_value(request, "filter_reset", u8, false, 1, 1) && ACTION(SET_FILTER_RESET)) ||
+        (get_parse_value(request, "cool_to", f, false, TEMP_SET_MIN, TEMP_SET_MAX) && ACTION(SET_COOL_TO)) ||
+        (get_parse_value(request, "heat_to", f, false, TEMP_SET_MIN, TEMP_SET_MAX) && ACTION(SET_HEAT_TO)) ||
+        (get_parse_value(request, "hyst_trigger", f, false, 0, 10) && ACTION(SET_HYST_TRIGGER)) ||
+        (get_parse_value(request, "hyst_release", f, false, 0, 10) && ACTION(SET_HYST_RELEASE)) ||
+        (get_parse_value(request, "temp_min", f, false, TEMP_SET_MIN, TEMP_SET_MAX) && ACTION(SET_TEMP_MIN)) ||
+        (get_parse_value(request, "temp_max", f, false, TEMP_SET_MIN, TEMP_SET_MAX) && ACTION(SET_TEMP_MAX)) ||
+        get_parse_value(request, "status", wdata.status, false, 0, STATUS_MASK) ||
+        (get_parse_value(request, "timestamp", wdata.timestamp, false, TIMESTAMP_MIN, UINT32_MAX) && ACTION(SET_TIMESTAMP));
+#undef ACTION
+    if (!ok)
+        request->send(400, "text/html", "Invalid request");
+    else
+    {
+        switch (action)
+        {
+            case SET_FAN_MODE:     control.set_fan_mode(u8); break;
+            case SET_AC_MODE:      control.set_ac_mode(u8); break;
+            case SET_FILTER_RESET: control.filter_reset(); break;
+            case SET_COOL_TO:      control.set_cool_to(temp_from_units(f)); break;
+            case SET_HEAT_TO:      control.set_heat_to(temp_from_units(f)); break;
+            case SET_HYST_TRIGGER: control.set_hysteresis(temp_delta_from_units(f), wdata.hyst_release); break;
+            case SET_HYST_RELEASE: control.set_hysteresis(wdata.hyst_trigger, temp_delta_from_units(f)); break;
+            case SET_TEMP_MIN:
+                wdata.temp_min = temp_from_units(f);
+                pref_set("temp_min_t", wdata.temp_min);
+                break;
+            case SET_TEMP_MAX:
+                wdata.temp_max = temp_from_units(f);
+                pref_set("temp_max_t", wdata.temp_max);
+                break;
+            case SET_EQUIPMENT:    trace(TRACE_SET, TRACE_F_EQUIPMENT, wdata.equipment); break;
+            case SET_FAN_SEC:      trace32(TRACE_SET, TRACE_F_FAN_SEC, wdata.fan_sec); break;
+            case SET_AC_EVAL_SEC:  trace32(TRACE_SET, TRACE_F_AC_EVAL_SEC, wdata.ac_eval_sec); break;
+            case SET_FUSION:       trace(TRACE_SET, TRACE_F_FUSION, wdata.fusion); break;
+            case SET_POWER_SAVE:   setup_power(); break;
+            case SET_TIMESTAMP:    clock_set(wdata.timestamp); break;
+        }
+
+        xI2CMessage xMessage;
+        xMessage.xMessageType = I2C_PRINT_STATUS;
+        xQueueSend(xI2CQueue, &xMessage, portMAX_DELAY);
+    }
+    heap_account(heap_set, mark);
+    prof_set.add(uint32_t(esp_timer_get_time()) - start);
+}
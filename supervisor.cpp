@@ -0,0 +1,203 @@
+#include "main.h"
+#include <Wire.h>
+#include <esp_task_wdt.h>
+
+// Task supervisor
+//
+// Each supervised task calls task_alive() on every pass of its loop. Once a second, the supervisor checks that every
+// task did so within its deadline. A task which is blocked on its input queue with nothing in it is idle, not
+// stalled, so the event driven tasks (I2C, buttons) do not have to wake up just to report. Their deadline runs from
+// the first check which saw an event waiting in the queue, as their last heartbeat may be hours old by then.
+// A stalled task gets a staged recovery: at its deadline, the I2C task gets an I2C bus clear (a slave holding SDA
+// low is clocked out of its transfer) and the others are restarted; at twice the deadline, the task is restarted;
+// at four times the deadline, a stalled critical task reboots the system, with the reason saved in NV.
+// The supervisor feeds the task watchdog only while all the critical tasks are alive, so if its own recovery does
+// not complete, or the supervisor itself stops, the watchdog resets the system anyway.
+
+#define SV_PERIOD_MS        1000 // Supervisor check period
+#define SV_WDT_SEC            30 // Task watchdog timeout, longer than the whole staged recovery
+#define I2C_SDA_PIN           21 // Default Wire pins
+#define I2C_SCL_PIN           22
+
+struct Supervised
+{
+    const char *name;
+    TaskFunction_t fn;
+    uint32_t stack;
+    void *param;
+    UBaseType_t prio;
+    BaseType_t core;
+    QueueHandle_t queue;  // Input queue of an event driven task, or nullptr
+    TaskHandle_t handle;
+    uint32_t stall_at;    // millis() when the task was found stalled, 0 while it is alive
+    uint32_t pending_at;  // millis() when the queue was first seen with an event waiting, 0 while it is empty
+    uint8_t stage;        // Recovery stage reached during the current stall
+};
+
+// Deadlines and whether a stall is worth a reboot, by the task index
+static const uint32_t deadline_ms[TASKS] { 5000, 5000, 5000, 5000, 180000 };
+static const bool critical[TASKS] { true, true, true, true, false };
+
+volatile uint32_t task_beat_ms[TASKS];
+static Supervised tasks[TASKS];
+
+static void create(Supervised &t)
+{
+    t.handle = nullptr;
+    xTaskCreatePinnedToCore(t.fn, t.name, t.stack, t.param, t.prio, &t.handle, t.core);
+}
+
+// Creates a supervised task, it is supervised once setup_supervisor() is called
+void supervise(int task, TaskFunction_t fn, const char *name, uint32_t stack, void *param, UBaseType_t prio, BaseType_t core, QueueHandle_t queue)
+{
+    tasks[task] = Supervised { name, fn, stack, param, prio, core, queue };
+    task_beat_ms[task] = millis();
+    create(tasks[task]);
+}
+
+// Releases a slave which holds SDA low in the middle of a transfer: clocks SCL until SDA goes high, then
+// sends a STOP condition and gives the pins back to the I2C controller
+static void i2c_bus_clear()
+{
+    pinMode(I2C_SDA_PIN, INPUT_PULLUP);
+    pinMode(I2C_SCL_PIN, OUTPUT_OPEN_DRAIN);
+    for (int i = 0; (i < 9) && !digitalRead(I2C_SDA_PIN); i++)
+    {
+        digitalWrite(I2C_SCL_PIN, LOW);
+        delayMicroseconds(5);
+        digitalWrite(I2C_SCL_PIN, HIGH);
+        delayMicroseconds(5);
+    }
+    pinMode(I2C_SDA_PIN, OUTPUT_OPEN_DRAIN);
+    digitalWrite(I2C_SDA_PIN, LOW);
+    delayMicroseconds(5);
+    digitalWrite(I2C_SDA_PIN, HIGH);
+    Wire.begin();
+}
+
+static void restart(Supervised &t)
+{
+    if (t.handle)
+        vTaskDelete(t.handle);
+    create(t);
+}
+
+static void reboot(int task, uint32_t stall_ms)
+{
+    char reason[sizeof(wdata.sv_reason)];
+    snprintf(reason, sizeof(reason), "%s stalled %d ms", tasks[task].name, stall_ms);
+    pref_set("sv_reason", reason);
+    pref_set("sv_reboots", wdata.sv_reboots + 1);
+    log_write(LOG_ERROR, LOG_SV, "%s stalled %d ms, rebooting", uintptr_t(tasks[task].name), stall_ms);
+    // An image on trial which needs the supervisor to reboot it failed its trial; the reset reason after
+    // esp_restart() does not tell this reboot from the one into a new image, so roll back before it
+    ota_rollback("rebooted by the supervisor");
+    esp_restart();
+}
+
+// Checks one task, returns false if it is stalled
+static bool check(int task, uint32_t now)
+{
+    Supervised &t = tasks[task];
+    uint32_t beat = task_beat_ms[task];
+    bool idle = false;
+    if (t.queue)
+    {
+        // An event driven task is due to take its event from when it was seen waiting, if it last ran before that
+        idle = !uxQueueMessagesWaiting(t.queue);
+        if (idle)
+            t.pending_at = 0;
+        else if (!t.pending_at)
+            t.pending_at = max(now, 1U); // Never 0, which means empty
+        if (t.pending_at && (int32_t(t.pending_at - beat) > 0))
+            beat = t.pending_at;
+    }
+    // During a stall, only a new heartbeat ends it
+    bool alive = t.stall_at ? (int32_t(beat - t.stall_at) > 0) : (now - beat < deadline_ms[task]);
+    if (alive || idle)
+    {
+        if (t.stall_at)
+        {
+            wdata.sv_stall_ms[task] = now - t.stall_at;
+            t.stall_at = 0;
+            t.stage = 0;
+        }
+        return true;
+    }
+
+    if (!t.stall_at)
+        t.stall_at = max(beat, 1U); // Never 0, which means alive, nor later than now
+    uint32_t stall_ms = now - t.stall_at;
+    wdata.sv_stall_ms[task] = stall_ms;
+    if (stall_ms >= 4 * deadline_ms[task])
+    {
+        if (critical[task])
+            reboot(task, stall_ms);
+        // A non-critical task starts over with another round of recovery
+        t.stall_at = now;
+        t.stage = 0;
+    }
+    else if ((t.stage < 2) && (stall_ms >= 2 * deadline_ms[task]))
+    {
+        t.stage = 2;
+        wdata.sv_recoveries[task]++;
+        log_write(LOG_WARN, LOG_SV, "%s stalled %d ms, restarted", uintptr_t(t.name), stall_ms);
+        restart(t);
+    }
+    else if (t.stage < 1)
+    {
+        t.stage = 1;
+        wdata.sv_recoveries[task]++;
+        log_write(LOG_WARN, LOG_SV, (task == TASK_I2C) ? "%s stalled %d ms, I2C bus cleared" : "%s stalled %d ms, restarted",
+            uintptr_t(t.name), stall_ms);
+        if (task == TASK_I2C)
+            i2c_bus_clear();
+        else
+            restart(t);
+    }
+    return !critical[task];
+}
+
+static void vTask_supervisor(void *p)
+{
+    esp_task_wdt_init(SV_WDT_SEC, true);
+    esp_task_wdt_add(nullptr);
+
+    while(true)
+    {
+        vTaskDelay(SV_PERIOD_MS / portTICK_PERIOD_MS);
+        uint32_t now = millis();
+        bool alive = true;
+        for (int task = 0; task < TASKS; task++)
+            if (tasks[task].fn)
+                alive &= check(task, now);
+
+        if (alive)
+        {
+            esp_task_wdt_reset();
+            wdata.status &= ~STATUS_TASK_STALL;
+        }
+        else
+            wdata.status |= STATUS_TASK_STALL;
+    }
+}
+
+void setup_supervisor()
+{
+    // A reboot by the task watchdog had no chance to save its reason, record it now
+    if (esp_reset_reason() == ESP_RST_TASK_WDT)
+    {
+        strcpy(wdata.sv_reason, "task watchdog");
+        pref_set("sv_reason", wdata.sv_reason);
+        pref_set("sv_reboots", ++wdata.sv_reboots);
+    }
+
+    xTaskCreatePinnedToCore(
+        vTask_supervisor,    // Task function
+        "task_supervisor",   // Name of the task
+        2048,                // Stack size in bytes
+        nullptr,             // Parameter passed as input to the task
+        PRIO_SUPERVISOR,     // Priority of the task
+        nullptr,             // Task handle
+        NETWORK_CPU);        // Core where the task should run
+}
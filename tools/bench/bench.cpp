@@ -0,0 +1,248 @@
+// Sweeps the controller tuning (hyst_trigger, hyst_release, ac_eval_sec) against a family of building models, on
+// the host, with the real controller code
+//
+// Build from the repository root and run:
+//   g++ -O2 -I tools/host -I . -o bench tools/bench/bench.cpp tools/host/host.cpp control.cpp sensor.cpp
+//   ./bench [-d days] [-j jobs] [-v]
+//
+// The building model extends model_get_temperature() into a lumped thermal mass behind an insulation, with the
+// outdoor temperature following a daily profile, internal gains, and a staged heating or cooling capacity. The
+// sensor lags the room air and is quantized like the probes, and it is read every 30 sec as on the device.
+// Every combination of the tuning values runs on every building, both on a hot day (cooling) and on a cold day
+// (heating), each run in its own process, as many at once as there are cores.
+// The results are averaged over the scenarios into a table of the comfort error (mean distance of the room from
+// the setpoint), the compressor or burner cycles per day and the runtime hours per day. The rows which no other row
+// beats on all three are marked as the Pareto front. The speed of the simulation is reported in simulated hours
+// per second of wall time; with -v, the table of every scenario is printed too.
+
+#include "host.h"
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <vector>
+
+#define SENSOR_READ_SEC   30 // The I2C task reads the probes every 30 sec
+#define SENSOR_STEP    0.0625 // Resolution of the probes in degrees C (12 bit)
+#define SENSOR_TAU_SEC   120 // Time constant of the sensor and the air around it
+#define COOL_TO         24.0 // Setpoints in degrees C
+#define HEAT_TO         21.0
+
+struct Building
+{
+    const char *name;
+    double mass;          // Thermal mass of the air, the structure and the furniture, J/K
+    double ua;            // Heat loss through the envelope, W/K
+    double gains;         // Internal gains from people and appliances, W
+    double stage1;        // Heating or cooling capacity of the first stage, W
+    double stage2;        // Capacity added by the second stage, W
+};
+
+static const Building buildings[]
+{
+    { "light",  6e6, 250, 400, 7000, 4000 },
+    { "heavy", 25e6, 150, 400, 7000, 4000 },
+    { "leaky", 10e6, 420, 600, 8000, 5000 },
+};
+
+struct Weather
+{
+    const char *name;
+    uint8_t ac_mode;      // AC_MODE_COOL or AC_MODE_HEAT
+    double mean;          // Daily mean outdoor temperature, degrees C
+    double swing;         // Amplitude of the daily outdoor temperature, degrees C
+};
+
+static const Weather weathers[]
+{
+    { "hot",  AC_MODE_COOL, 30, 7 },
+    { "cold", AC_MODE_HEAT, -2, 5 },
+};
+
+static const double triggers[] { 0.25, 0.5, 0.75, 1.0 };  // Degrees C
+static const double releases[] { 0.0, 0.25, 0.5 };        // Degrees C
+static const uint32_t evals[] { 10, 30, 60, 120 };        // Seconds
+
+#define COUNT(a) int(sizeof(a) / sizeof(a[0]))
+#define SCENARIOS (COUNT(buildings) * COUNT(weathers))
+#define TUNINGS (COUNT(triggers) * COUNT(releases) * COUNT(evals))
+
+struct Result
+{
+    double error;         // Mean absolute distance of the room from the setpoint, degrees C
+    double cycles;        // Starts of the first stage per day
+    double runtime;       // Hours per day of the first stage running
+    bool pareto;
+};
+
+// Runs one tuning on one scenario, in a process of its own since the controller and wdata are globals
+static Result simulate(const Building &b, const Weather &w, double trigger, double release, uint32_t eval, int days)
+{
+    wdata.equipment = EQUIP_TWO_STAGE;
+    wdata.ac_eval_sec = eval;
+    wdata.temp_valid = true;
+    wdata.ext_valid = false;
+    control.set_hysteresis(temp_t(lround(trigger * 100)), temp_t(lround(release * 100)), false);
+    control.set_cool_to(temp_t(lround(COOL_TO * 100)), false);
+    control.set_heat_to(temp_t(lround(HEAT_TO * 100)), false);
+    control.set_ac_mode(w.ac_mode);
+
+    bool cooling = (w.ac_mode == AC_MODE_COOL);
+    double setpoint = cooling ? COOL_TO : HEAT_TO;
+    double room = setpoint, sensor = setpoint;
+    double error = 0;
+    uint32_t cycles = 0, run_sec = 0;
+    bool was_on = false;
+    uint32_t seconds = days * 24 * 3600;
+    for (uint32_t t = 0; t < seconds; t++)
+    {
+        if ((t % SENSOR_READ_SEC) == 0)
+            wdata.temp = temp_t(lround(round(sensor / SENSOR_STEP) * SENSOR_STEP * 100));
+        control.tick();
+        wdata.control_ticks++;
+        wdata.relays = uint8_t(host_relays);
+
+        // Relays are active low; the heat pump settings are not swept, so heating is W1/W2
+        uint8_t on = ~wdata.relays;
+        bool stage1 = on & (cooling ? PIN_COOL : PIN_HEAT);
+        bool stage2 = on & (cooling ? PIN_COOL2 : PIN_HEAT2);
+        double outdoor = w.mean + w.swing * sin(2 * M_PI * (double(t % (24 * 3600)) / (24 * 3600) - 0.375)); // Peak at 15h
+        double hvac = (stage1 ? b.stage1 : 0) + (stage2 ? b.stage2 : 0);
+        room += (b.ua * (outdoor - room) + b.gains + (cooling ? -hvac : hvac)) / b.mass;
+        sensor += (room - sensor) / SENSOR_TAU_SEC;
+
+        error += fabs(room - setpoint);
+        run_sec += stage1;
+        cycles += stage1 && !was_on;
+        was_on = stage1;
+    }
+    return Result { error / seconds, double(cycles) / days, double(run_sec) / 3600 / days, false };
+}
+
+// Marks the rows which no other row beats on all the metrics
+static void pareto(Result *r, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        r[i].pareto = true;
+        for (int j = 0; (j < n) && r[i].pareto; j++)
+        {
+            bool no_worse = (r[j].error <= r[i].error) && (r[j].cycles <= r[i].cycles) && (r[j].runtime <= r[i].runtime);
+            bool better = (r[j].error < r[i].error) || (r[j].cycles < r[i].cycles) || (r[j].runtime < r[i].runtime);
+            if ((j != i) && no_worse && better)
+                r[i].pareto = false;
+        }
+    }
+}
+
+static void print_table(const char *title, Result *r)
+{
+    pareto(r, TUNINGS);
+    printf("\n%s\n", title);
+    printf("  trigger  release  eval_sec    error C  cycles/day  runtime h/day\n");
+    for (int k = 0; k < TUNINGS; k++)
+    {
+        printf("  %7.2f  %7.2f  %8u  %9.3f  %10.1f  %13.2f %s\n", triggers[k / (COUNT(releases) * COUNT(evals))],
+            releases[(k / COUNT(evals)) % COUNT(releases)], evals[k % COUNT(evals)], r[k].error, r[k].cycles,
+            r[k].runtime, r[k].pareto ? "*" : "");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int days = 3;
+    int jobs = int(sysconf(_SC_NPROCESSORS_ONLN));
+    bool verbose = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:j:v")) != -1)
+    {
+        if (opt == 'd')
+            days = max(atoi(optarg), 1);
+        else if (opt == 'j')
+            jobs = max(atoi(optarg), 1);
+        else if (opt == 'v')
+            verbose = true;
+        else
+        {
+            fprintf(stderr, "Usage: %s [-d days] [-j jobs] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // The runs write their results straight into memory shared with this process, indexed by scenario and tuning
+    const int runs = SCENARIOS * TUNINGS;
+    Result *results = (Result *)mmap(nullptr, runs * sizeof(Result), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int running = 0, failed = 0;
+    for (int i = 0; i < runs; i++)
+    {
+        if (running == jobs)
+        {
+            int status;
+            wait(&status);
+            failed += !WIFEXITED(status) || WEXITSTATUS(status);
+            running--;
+        }
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0)
+        {
+            int s = i / TUNINGS, k = i % TUNINGS;
+            results[i] = simulate(buildings[s / COUNT(weathers)], weathers[s % COUNT(weathers)],
+                triggers[k / (COUNT(releases) * COUNT(evals))], releases[(k / COUNT(evals)) % COUNT(releases)],
+                evals[k % COUNT(evals)], days);
+            _exit(0);
+        }
+        running++;
+    }
+    while (running)
+    {
+        int status;
+        wait(&status);
+        failed += !WIFEXITED(status) || WEXITSTATUS(status);
+        running--;
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (failed)
+    {
+        fprintf(stderr, "%d runs failed\n", failed);
+        return 1;
+    }
+
+    if (verbose)
+    {
+        for (int s = 0; s < SCENARIOS; s++)
+        {
+            char title[64];
+            sprintf(title, "%s building, %s day", buildings[s / COUNT(weathers)].name, weathers[s % COUNT(weathers)].name);
+            print_table(title, &results[s * TUNINGS]);
+        }
+    }
+
+    // Average every tuning over all the scenarios
+    Result mean[TUNINGS] {};
+    for (int i = 0; i < runs; i++)
+    {
+        mean[i % TUNINGS].error += results[i].error / SCENARIOS;
+        mean[i % TUNINGS].cycles += results[i].cycles / SCENARIOS;
+        mean[i % TUNINGS].runtime += results[i].runtime / SCENARIOS;
+    }
+    char title[64];
+    sprintf(title, "Mean over %d scenarios of %d days (* Pareto front)", SCENARIOS, days);
+    print_table(title, mean);
+
+    double hours = double(runs) * days * 24;
+    printf("\n%d runs, %.0f simulated hours in %.2f s on %d jobs: %.0f simulated hours/s, %.0f per job\n",
+        runs, hours, wall, jobs, hours / wall, hours / wall / jobs);
+    return 0;
+}
@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+# Embeds the web UI files from ui/ into webui.h as gzipped byte arrays
+# Run it after changing anything in ui/ and commit the generated webui.h with the change:
+#   python tools/embed_assets.py
+# The ETag of each file is a hash of its content, so the browser revalidates its cached copy with a 304 response
+# until the firmware brings a different file.
+
+import gzip
+import hashlib
+import os
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+
+# URL path, file in ui/, content type
+ASSETS = [
+    ('/', 'index.html', 'text/html'),
+    ('/upload', 'upload.html', 'text/html'),
+]
+
+def c_name(file):
+    return 'webui_' + file.replace('.', '_').replace('-', '_')
+
+def main():
+    out = []
+    out.append('// Generated by tools/embed_assets.py from the files in ui/, do not edit')
+    out.append('#pragma once')
+    out.append('')
+    report = []
+    for path, file, ctype in ASSETS:
+        raw = open(os.path.join(ROOT, 'ui', file), 'rb').read()
+        data = gzip.compress(raw, 9, mtime=0)
+        out.append('static const uint8_t %s[] PROGMEM = {' % c_name(file))
+        for i in range(0, len(data), 24):
+            out.append('    ' + ','.join('0x%02x' % b for b in data[i:i + 24]) + ',')
+        out.append('};')
+        out.append('')
+        report.append((path, file, ctype, len(raw), len(data), hashlib.sha1(raw).hexdigest()[:16]))
+
+    out.append('static const WebAsset webui_assets[] = {')
+    for path, file, ctype, raw_size, size, etag in report:
+        out.append('    { "%s", "%s", "\\"%s\\"", %s, sizeof(%s) }, // %d bytes uncompressed' %
+            (path, ctype, etag, c_name(file), c_name(file), raw_size))
+    out.append('};')
+    open(os.path.join(ROOT, 'webui.h'), 'w', newline='\n').write('\n'.join(out) + '\n')
+
+    for path, file, ctype, raw_size, size, etag in report:
+        print('%-10s %-12s %6d -> %5d bytes' % (path, file, raw_size, size))
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,55 @@
+// Minimal stand-in for the Arduino and FreeRTOS headers, just enough to build control.cpp, set.cpp and supervisor.cpp
+// on the host
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+#define constrain(v, lo, hi) ((v) < (lo) ? (lo) : ((v) > (hi) ? (hi) : (v)))
+
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef int portBASE_TYPE;
+typedef uint32_t TickType_t;
+typedef void *QueueHandle_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFF
+#define portTICK_PERIOD_MS 1
+#define tskIDLE_PRIORITY 0
+#define RTC_NOINIT_ATTR
+#define LOW 0
+#define HIGH 1
+#define INPUT_PULLUP 0x05
+#define OUTPUT_OPEN_DRAIN 0x12
+
+uint32_t millis();
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+TickType_t xTaskGetTickCount();
+void vTaskDelayUntil(TickType_t *last, TickType_t period);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+int64_t esp_timer_get_time();
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *param, UBaseType_t prio,
+    TaskHandle_t *handle, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+void delayMicroseconds(uint32_t us);
+void esp_restart();
+
+typedef enum { ESP_RST_UNKNOWN, ESP_RST_POWERON, ESP_RST_EXT, ESP_RST_SW, ESP_RST_PANIC, ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT, ESP_RST_WDT, ESP_RST_DEEPSLEEP, ESP_RST_BROWNOUT, ESP_RST_SDIO } esp_reset_reason_t;
+esp_reset_reason_t esp_reset_reason();
@@ -0,0 +1,73 @@
+// Minimal stand-in for the request side of ESPAsyncWebServer, just enough to run a request handler on the host
+#pragma once
+#include <string>
+#include <vector>
+
+class String
+{
+    std::string s;
+public:
+    String(const char *p = "") : s(p) {}
+    String(const std::string &v) : s(v) {}
+    const char *c_str() const { return s.c_str(); }
+    size_t length() const { return s.size(); }
+};
+
+class AsyncWebParameter
+{
+    String _name, _value;
+public:
+    AsyncWebParameter(const String &name, const String &value) : _name(name), _value(value) {}
+    const String &name() const { return _name; }
+    const String &value() const { return _value; }
+};
+
+class AsyncWebServerRequest
+{
+public:
+    std::vector<AsyncWebParameter> args; // The ?name=value arguments, in their order in the URL
+    int responses = 0;                   // Number of responses the handler sent, it has to be exactly one
+    int code = 0;                        // and the last of them
+    std::string content;
+
+    // Takes the arguments from a query string, decoded as the server does: '+' is a space and %XX a byte
+    void set_query(const char *q, size_t len)
+    {
+        args.clear();
+        responses = code = 0;
+        content.clear();
+        std::string name, value, *p = &name;
+        for (size_t i = 0; i <= len; i++)
+        {
+            char c = (i < len) ? q[i] : '&';
+            if (c == '&')
+            {
+                if (!name.empty() || !value.empty())
+                    args.emplace_back(String(name), String(value));
+                name.clear();
+                value.clear();
+                p = &name;
+            }
+            else if ((c == '=') && (p == &name))
+                p = &value;
+            else if (c == '+')
+                *p += ' ';
+            else if ((c == '%') && (i + 2 < len) && isxdigit(q[i + 1]) && isxdigit(q[i + 2]))
+            {
+                *p += char(strtoul(std::string(q + i + 1, 2).c_str(), nullptr, 16));
+                i += 2;
+            }
+            else
+                *p += c;
+        }
+    }
+
+    size_t params() const { return args.size(); }
+    AsyncWebParameter *getParam(size_t i) { return (i < args.size()) ? &args[i] : nullptr; }
+    void send(int c, const String &, const String &body)
+    {
+        responses++;
+        code = c;
+        content = body.c_str();
+    }
+};
@@ -0,0 +1,10 @@
+// Stand-in for the Arduino Wire library, for the host build of supervisor.cpp
+#pragma once
+
+class TwoWire
+{
+public:
+    bool begin();
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,8 @@
+// Stand-in for the ESP-IDF task watchdog header, for the host build of supervisor.cpp
+#pragma once
+#include <Arduino.h>
+
+typedef int esp_err_t;
+esp_err_t esp_task_wdt_init(uint32_t timeout, bool panic);
+esp_err_t esp_task_wdt_add(TaskHandle_t task);
+esp_err_t esp_task_wdt_reset();
@@ -0,0 +1,39 @@
+// The rest of the firmware as control.cpp sees it, reduced to what a host tool needs: the controller's relay
+// writes are captured, the time runs on the control ticks, and everything else does nothing
+
+#include "host.h"
+
+StationData wdata;
+CControl control;
+QueueHandle_t xI2CQueue;
+volatile uint32_t task_beat_ms[TASKS];
+Histogram prof_control;
+int host_relays = -1;
+
+uint32_t millis() { return wdata.control_ticks * 1000; }
+BaseType_t xQueueSend(QueueHandle_t, const void *item, TickType_t)
+{
+    const xI2CMessage *m = (const xI2CMessage *)item;
+    if (m->xMessageType == I2C_SET_RELAYS)
+        host_relays = m->bMessage;
+    return pdPASS;
+}
+TickType_t xTaskGetTickCount() { return 0; }
+void vTaskDelayUntil(TickType_t *, TickType_t) {}
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 0; }
+int64_t esp_timer_get_time() { return 0; }
+esp_reset_reason_t esp_reset_reason() { return ESP_RST_POWERON; }
+uint32_t crc32_le(uint32_t crc, const uint8_t *, uint32_t) { return crc; }
+void supervise(int, TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, BaseType_t, QueueHandle_t) {}
+void prof_wake(WakeProfile &, Histogram &) {}
+void pref_set(const char *, bool) {}
+void pref_set(const char *, uint8_t) {}
+void pref_set(const char *, uint32_t) {}
+void pref_set(const char *, int16_t) {}
+void pref_set(const char *, float) {}
+void pref_set(const char *, const char *) {}
+void pref_set(const char *, const uint8_t *, size_t) {}
+void trace(uint8_t, uint8_t, int16_t) {}
+void trace32(uint8_t, uint8_t, uint32_t) {}
+void trace_input(uint8_t, bool, temp_t) {}
+void trace_checkpoint(const uint32_t (*)[2], int) {}
@@ -0,0 +1,6 @@
+// Host build of the controller code: control.cpp compiled against the stand-in headers in this directory
+#pragma once
+#include "main.h"
+#include "control.h"
+
+extern int host_relays; // Relays last written by the controller, -1 if none yet
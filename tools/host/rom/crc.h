@@ -0,0 +1,4 @@
+// Stand-in for the ESP32 ROM header, for the host build of control.cpp
+#pragma once
+#include <stdint.h>
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+# Load test of the task layout: floods the web server of a thermostat with requests while reading the control tick
+# jitter from its /prof, to see how much the network work disturbs the control core:
+#   python tools/loadtest.py 192.168.1.40 --threads 8 --seconds 60
+# The control and the 1 s tick wake latencies are first measured for --idle-seconds without load, then during the
+# flood. /prof only has the histograms since boot, so each phase is the difference of two reads of them; the
+# percentiles are the upper bounds of the histogram buckets (16 us, 32 us, ... as in profile.cpp). The max_us of
+# /prof is since boot as well, it is printed as is. The CPU load of both cores is read at the end of each phase.
+
+import argparse
+import json
+import threading
+import time
+import urllib.request
+
+HIST_BASE_US = 16
+HISTS = ('control', 'tick')
+
+def get(url, timeout=5):
+    with urllib.request.urlopen(url, timeout=timeout) as r:
+        return r.status, r.read()
+
+def read_prof(host):
+    return json.loads(get('http://%s/prof' % host)[1])
+
+def bucket_bound(i, n):
+    return ('>= %d us' % (HIST_BASE_US << (n - 2))) if i == n - 1 else ('< %d us' % (HIST_BASE_US << i))
+
+def percentile(hist, p):
+    total = sum(hist)
+    if not total:
+        return '-'
+    seen = 0
+    for i, n in enumerate(hist):
+        seen += n
+        if seen * 100 >= total * p:
+            return bucket_bound(i, len(hist))
+
+def report(phase, before, after, seconds):
+    print('%s, %.0f s: load %d%% / %d%% (PRO_CPU / APP_CPU)' % (phase, seconds, *after['load_pct']))
+    for name in HISTS:
+        hist = [a - b for a, b in zip(after[name]['hist'], before[name]['hist'])]
+        print('  %-8s %6d wakes, p50 %-10s p99 %-10s p99.9 %-10s max since boot %d us' % (name, sum(hist),
+            percentile(hist, 50), percentile(hist, 99), percentile(hist, 99.9), after[name]['max_us']))
+        print('           histogram %s' % hist)
+
+class Flood:
+    def __init__(self, host, paths, threads):
+        self.urls = ['http://%s%s' % (host, p) for p in paths]
+        self.stop = threading.Event()
+        self.lock = threading.Lock()
+        self.ok = self.failed = 0
+        self.threads = [threading.Thread(target=self.run, args=(i,), daemon=True) for i in range(threads)]
+
+    def run(self, i):
+        n = i
+        while not self.stop.is_set():
+            url = self.urls[n % len(self.urls)]
+            n += 1
+            try:
+                status, _ = get(url)
+                good = status == 200
+            except Exception:
+                good = False
+            with self.lock:
+                if good:
+                    self.ok += 1
+                else:
+                    self.failed += 1
+
+    def __enter__(self):
+        for t in self.threads:
+            t.start()
+        return self
+
+    def __exit__(self, *args):
+        self.stop.set()
+        for t in self.threads:
+            t.join()
+
+def main():
+    parser = argparse.ArgumentParser(description='Flood the web server and measure the control tick jitter')
+    parser.add_argument('host', help='address of the thermostat')
+    parser.add_argument('--threads', type=int, default=8, help='concurrent clients')
+    parser.add_argument('--seconds', type=float, default=60, help='duration of the flood')
+    parser.add_argument('--idle-seconds', type=float, default=30, help='duration of the baseline without load')
+    parser.add_argument('--path', action='append', help='path to request, repeat for several (default /json, /status, /)')
+    args = parser.parse_args()
+    paths = args.path or ['/json', '/status', '/']
+
+    before = read_prof(args.host)
+    time.sleep(args.idle_seconds)
+    idle = read_prof(args.host)
+    report('Idle', before, idle, args.idle_seconds)
+
+    start = time.time()
+    with Flood(args.host, paths, args.threads) as flood:
+        time.sleep(args.seconds)
+        loaded = read_prof(args.host) # While the flood runs, for the CPU load under it
+    wall = time.time() - start
+    report('Flood of %s by %d clients' % (', '.join(paths), args.threads), idle, loaded, wall)
+    print('  %d requests answered (%.0f/s), %d failed' % (flood.ok, flood.ok / wall, flood.failed))
+
+if __name__ == '__main__':
+    main()
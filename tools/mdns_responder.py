@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+# Stand-in for an external sensor on the local network: advertises a service by mDNS and, optionally, serves the
+# /json the thermostat reads from it. It measures the discovery and the address cache of the thermostat:
+#   python tools/mdns_responder.py --name kitchen --ip 192.168.1.50 --port 8080 --json 21.5
+# then set ext_server to "_sensor._tcp" (or "_sensor._tcp@kitchen", or "kitchen.local:8080") and watch the mdns
+# counters in /status. Every query it answers is printed with its time, so the queries the thermostat made can be
+# told apart from the reads it answered from its cache; --delay-ms holds the answers back like a slow responder.
+
+import argparse
+import json
+import socket
+import struct
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, HTTPServer
+
+MDNS_ADDR = '224.0.0.251'
+MDNS_PORT = 5353
+TYPE_A, TYPE_PTR, TYPE_TXT, TYPE_SRV, TYPE_ANY = 1, 12, 16, 33, 255
+CLASS_IN, CACHE_FLUSH = 1, 0x8000
+TTL = 120
+
+def encode_name(name):
+    out = b''
+    for label in name.rstrip('.').split('.'):
+        out += bytes([len(label)]) + label.encode()
+    return out + b'\0'
+
+def decode_name(data, offset):
+    labels = []
+    end = None
+    while True:
+        n = data[offset]
+        if n & 0xC0 == 0xC0: # Compression pointer
+            if end is None:
+                end = offset + 2
+            offset = ((n & 0x3F) << 8) | data[offset + 1]
+            continue
+        offset += 1
+        if n == 0:
+            break
+        labels.append(data[offset:offset + n].decode(errors='replace'))
+        offset += n
+    return '.'.join(labels).lower(), end if end is not None else offset
+
+def record(name, rtype, rclass, rdata):
+    return encode_name(name) + struct.pack('>HHIH', rtype, rclass, TTL, len(rdata)) + rdata
+
+class Responder:
+    def __init__(self, args):
+        self.args = args
+        self.service = args.service.lower() + '.local'
+        self.instance = args.name.lower() + '.' + self.service
+        self.host = args.name.lower() + '.local'
+        self.queries = 0
+        self.start = time.monotonic()
+
+    def records(self, qname, qtype):
+        a = self.args
+        ptr = record(self.service, TYPE_PTR, CLASS_IN, encode_name(self.instance))
+        srv = record(self.instance, TYPE_SRV, CLASS_IN | CACHE_FLUSH,
+            struct.pack('>HHH', 0, 0, a.port) + encode_name(self.host))
+        txt = b''.join(bytes([len(t)]) + t.encode() for t in ['id=' + a.name] + a.txt)
+        txt = record(self.instance, TYPE_TXT, CLASS_IN | CACHE_FLUSH, txt)
+        addr = record(self.host, TYPE_A, CLASS_IN | CACHE_FLUSH, socket.inet_aton(a.ip))
+        if qname == self.service and qtype in (TYPE_PTR, TYPE_ANY):
+            return [ptr], [srv, txt, addr]
+        if qname == self.instance and qtype in (TYPE_SRV, TYPE_TXT, TYPE_ANY):
+            return [srv, txt], [addr]
+        if qname == self.host and qtype in (TYPE_A, TYPE_ANY):
+            return [addr], []
+        return [], []
+
+    def handle(self, sock, data, source):
+        qid, flags, qdcount = struct.unpack('>HHH', data[:6])
+        if flags & 0x8000: # A response, not a query
+            return
+        offset = 12
+        answers, additional = [], []
+        for _ in range(qdcount):
+            qname, offset = decode_name(data, offset)
+            qtype, qclass = struct.unpack('>HH', data[offset:offset + 4])
+            offset += 4
+            an, ar = self.records(qname, qtype)
+            if an:
+                self.queries += 1
+                print('%9.3f s  query %d from %s: %s type %d' % (time.monotonic() - self.start, self.queries,
+                    source[0], qname, qtype), flush=True)
+            answers += [r for r in an if r not in answers]
+            additional += [r for r in ar if r not in additional and r not in answers]
+        if not answers:
+            return
+        if self.args.delay_ms:
+            time.sleep(self.args.delay_ms / 1000)
+        # A query from a port other than 5353 is a one-shot (legacy) query, answered to its sender with its id
+        legacy = source[1] != MDNS_PORT
+        header = struct.pack('>HHHHHH', qid if legacy else 0, 0x8400, 0, len(answers), 0, len(additional))
+        sock.sendto(header + b''.join(answers + additional), source if legacy else (MDNS_ADDR, MDNS_PORT))
+
+    def run(self):
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        if hasattr(socket, 'SO_REUSEPORT'):
+            sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEPORT, 1)
+        sock.bind(('', MDNS_PORT))
+        iface = socket.inet_aton(self.args.ip)
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, socket.inet_aton(MDNS_ADDR) + iface)
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF, iface)
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 255)
+        print('Advertising %s on %s:%d' % (self.instance, self.args.ip, self.args.port), flush=True)
+        while True:
+            data, source = sock.recvfrom(9000)
+            try:
+                self.handle(sock, data, source)
+            except (IndexError, struct.error, UnicodeError):
+                pass # Malformed packet
+
+def serve_json(port, temp_c):
+    class Handler(BaseHTTPRequestHandler):
+        def do_GET(self):
+            body = (json.dumps({'temp_c': temp_c}) + '\n').encode()
+            self.send_response(200 if self.path == '/json' else 404)
+            self.send_header('Content-Type', 'application/json')
+            self.send_header('Content-Length', str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+        def log_message(self, format, *args):
+            print('           http %s %s' % (self.client_address[0], format % args), flush=True)
+    HTTPServer(('', port), Handler).serve_forever()
+
+def main():
+    parser = argparse.ArgumentParser(description='mDNS stand-in for an external sensor')
+    parser.add_argument('--service', default='_sensor._tcp', help='service type to advertise')
+    parser.add_argument('--name', default='sensor', help='instance and host name')
+    parser.add_argument('--ip', required=True, help='address of this PC on the network of the thermostat')
+    parser.add_argument('--port', type=int, default=80, help='port of the service')
+    parser.add_argument('--txt', action='append', default=[], help='additional TXT record, key=value')
+    parser.add_argument('--delay-ms', type=int, default=0, help='hold every answer back this long')
+    parser.add_argument('--json', type=float, help='also serve /json on the port, with this temperature in C')
+    args = parser.parse_args()
+    if args.json is not None:
+        threading.Thread(target=serve_json, args=(args.port, args.json), daemon=True).start()
+    Responder(args).run()
+
+if __name__ == '__main__':
+    main()
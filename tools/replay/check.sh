@@ -0,0 +1,39 @@
+#!/bin/sh
+# Replays the fixtures (tools/replay/*.bin) through the controller code and fails if a relay change differs from the
+# one recorded in the fixture. Then replays the flapping external sensor of gen_trace.py on the hard switch between
+# the sensors and on the sensor fusion, and fails unless the fusion makes a small fraction of the relay changes of
+# the hard switch. Run from the repository root:
+#   sh tools/replay/check.sh
+# A fixture is a synthetic input trace of gen_trace.py, with the relay changes recorded by "replay -w". After a
+# deliberate change of the controller, look at the differences with "replay fixture.bin -v", then record the fixture
+# again from its inputs: "python tools/replay/gen_trace.py day day_inputs.bin && replay day_inputs.bin -w day.bin".
+
+set -e
+build=${TMPDIR:-/tmp}/replay_check
+mkdir -p "$build"
+g++ -O2 -I tools/host -I . -o "$build/replay" tools/replay/replay.cpp tools/host/host.cpp control.cpp sensor.cpp
+
+failed=0
+for fixture in tools/replay/*.bin; do
+    if "$build/replay" "$fixture" > "$build/out.txt"; then
+        echo "$fixture: $(tail -n 1 "$build/out.txt")"
+    else
+        cat "$build/out.txt"
+        echo "$fixture: FAILED"
+        failed=1
+    fi
+done
+# The hard switch follows every dropout of the external sensor across the setpoint, the fusion rides them out
+python3 tools/replay/gen_trace.py flap "$build/flap.bin"
+changes() {
+    "$build/replay" "$build/flap.bin" -f $1 | sed -n 's/.* \([0-9]*\) made by the replay$/\1/p'
+}
+hard=$(changes 0)
+fused=$(changes 1)
+if [ -n "$hard" ] && [ -n "$fused" ] && [ $((fused * 10)) -le "$hard" ]; then
+    echo "flapping sensor: $hard relay changes on the hard switch, $fused on the fusion"
+else
+    echo "flapping sensor: $hard relay changes on the hard switch, $fused on the fusion: FAILED"
+    failed=1
+fi
+exit $failed
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+# Writes a synthetic input trace in the format of /trace, for the replay and the fixtures of check.sh:
+#   python tools/replay/gen_trace.py day day_inputs.bin
+# A synthetic trace has the inputs only: a checkpoint to start from, the sensor readings and the settings changes.
+# Its relay changes are recorded by replaying it, "./replay day_inputs.bin -w tools/replay/day.bin".
+#
+# Scenarios:
+#   day   A day on a two stage system: the room warms up in the morning and cools down at night, the external sensor
+#         drops out for a while, the cooling setpoint, the fan mode and the hysteresis are changed during the day,
+#         and the system is switched to heating in the evening.
+#   flap  The external sensor reads 2 degrees below the internal probe, right around the cooling setpoint, then
+#         drops out every other minute for 2 hours and is gone after that. The trace has no fusion setting, so it
+#         replays on the hard switch between the sensors unless -f is given.
+
+import math
+import struct
+import sys
+
+TRACE_VERSION = 1
+HEADER, TEMP, EXT, BUTTON, SET, RELAYS, TIME, CHECKPOINT, STATE = range(9)
+HI = 0x80
+# TRACE_F_* of main.h
+FAN_MODE, AC_MODE, COOL_TO, HEAT_TO, HYST_TRIGGER, HYST_RELEASE, EQUIPMENT, FAN_SEC, RELAYS_F, CALL, STAGE, \
+    STAGE_TEMP, STAGE_SEC, CALL_SEC, FAN_COUNTER, AC_COUNTER, AC_EVAL_SEC, FUSION, HEALTH_INT, HEALTH_EXT, \
+    EXT_WEIGHT, FUSION_FLAGS, INT_OFFSET = range(23)
+FAN_MODE_OFF, FAN_MODE_ON, FAN_MODE_CYC = range(3)
+AC_MODE_OFF, AC_MODE_COOL, AC_MODE_HEAT = range(3)
+EQUIP_TWO_STAGE = 1
+READ_SEC = 30 # The probes are read every 30 sec
+HEALTH_MAX = 600 # HEALTH_MAX and BLEND_SEC of sensor.cpp
+BLEND_SEC = 300
+
+def temp(c):
+    # temp_t of a reading of a probe with a resolution of 1/16 degree C
+    return int(round(round(c * 16) / 16 * 100))
+
+class Trace:
+    def __init__(self):
+        self.records = []
+
+    def add(self, tick, type, arg, value):
+        self.records.append((tick, len(self.records), type, arg, value))
+
+    def add32(self, tick, type, arg, value):
+        self.add(tick, type, arg, value & 0xFFFF)
+        self.add(tick, type, arg | HI, value >> 16)
+
+    def checkpoint(self, tick, state, temp, ext):
+        self.add(tick, CHECKPOINT, 0, 0)
+        for field, value in state.items():
+            self.add32(tick, STATE, field, value)
+        self.add(tick, TEMP, 1, temp)
+        self.add(tick, EXT, ext is not None, ext or 0)
+
+    def write(self, path):
+        # In the order of the ticks, and of the calls within a tick
+        with open(path, 'wb') as f:
+            f.write(struct.pack('<IBBh', 0, HEADER, 8, TRACE_VERSION))
+            for tick, _, type, arg, value in sorted(self.records):
+                if value >= 0x8000:
+                    value -= 0x10000
+                f.write(struct.pack('<IBBh', tick, type, arg, value))
+
+def day(t):
+    start = 100
+    hours = 24
+    t.checkpoint(start, {
+        FAN_MODE: FAN_MODE_OFF, AC_MODE: AC_MODE_COOL, COOL_TO: temp(24), HEAT_TO: temp(20),
+        HYST_TRIGGER: 83, HYST_RELEASE: 28, EQUIPMENT: EQUIP_TWO_STAGE, FAN_SEC: 0, RELAYS_F: 0xFF, CALL: 0,
+        STAGE: 0, STAGE_TEMP: 0, STAGE_SEC: 0, CALL_SEC: 0, FAN_COUNTER: 1, AC_COUNTER: 30, AC_EVAL_SEC: 30,
+        FUSION: 1, HEALTH_INT: HEALTH_MAX, HEALTH_EXT: HEALTH_MAX, EXT_WEIGHT: BLEND_SEC, FUSION_FLAGS: 1, INT_OFFSET: 0,
+    }, temp(23), temp(23))
+    # The room follows the day, warmest in the afternoon, with a swing of 1.5 hours on top which crosses the on and
+    # off points of the calls; it rises faster around noon, so that the second stage is called in
+    for s in range(READ_SEC, hours * 3600, READ_SEC):
+        h = s / 3600
+        room = 23 + 1.5 * math.sin((h - 8) * math.pi / 12) + 1.5 * math.exp(-((h - 13) ** 2) / 2) + \
+            0.8 * math.sin(h * 2 * math.pi / 1.5)
+        t.add(start + s, TEMP, 1, temp(room))
+        ext_gone = 10 <= h < 11.5
+        t.add(start + s, EXT, not ext_gone, 0 if ext_gone else temp(room - 0.3))
+    for s, field, value in (
+            (2 * 3600, FAN_MODE, FAN_MODE_CYC),
+            (9 * 3600, COOL_TO, temp(23.5)),
+            (15 * 3600, HYST_TRIGGER, 56), (15 * 3600, HYST_RELEASE, 28),
+            (18 * 3600, AC_MODE, AC_MODE_OFF),
+            (19 * 3600, HEAT_TO, temp(23)), (19 * 3600, AC_MODE, AC_MODE_HEAT),
+            (21 * 3600, FAN_MODE, FAN_MODE_OFF)):
+        t.add(start + s, SET, field, value)
+
+def flap(t):
+    start = 100
+    EQUIP_SINGLE = 0
+    t.checkpoint(start, {
+        FAN_MODE: FAN_MODE_OFF, AC_MODE: AC_MODE_COOL, COOL_TO: temp(23), HEAT_TO: temp(20),
+        HYST_TRIGGER: 83, HYST_RELEASE: 28, EQUIPMENT: EQUIP_SINGLE, FAN_SEC: 0, RELAYS_F: 0xFF, CALL: 0,
+        STAGE: 1, STAGE_TEMP: 0, STAGE_SEC: 0, CALL_SEC: 0, FAN_COUNTER: 0, AC_COUNTER: 30, AC_EVAL_SEC: 30,
+    }, temp(24), temp(22))
+    # Steady for 20 minutes, then 60 sec without a reading and 60 sec with one, for 2 hours
+    s = 1200
+    while s < 1200 + 7200:
+        t.add(start + s, EXT, 0, temp(22))
+        t.add(start + s + 60, EXT, 1, temp(22))
+        s += 120
+    t.add(start + s, EXT, 0, temp(22))
+    # With the external sensor gone for good, the room warms up and then settles back
+    t.add(start + s + 3000, TEMP, 1, temp(26))
+    t.add(start + s + 9000, TEMP, 1, temp(24))
+
+SCENARIOS = { 'day': day, 'flap': flap }
+
+if __name__ == '__main__':
+    if (len(sys.argv) != 3) or (sys.argv[1] not in SCENARIOS):
+        print('Usage: %s %s out.bin' % (sys.argv[0], '|'.join(SCENARIOS)))
+        sys.exit(2)
+    trace = Trace()
+    SCENARIOS[sys.argv[1]](trace)
+    trace.write(sys.argv[2])
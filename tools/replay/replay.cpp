@@ -0,0 +1,211 @@
+// Replays an input trace downloaded from /trace through the real controller code, on the host
+//
+// Build from the repository root and run:
+//   g++ -O2 -I tools/host -I . -o replay tools/replay/replay.cpp tools/host/host.cpp control.cpp sensor.cpp
+//   curl -o trace.bin http://<thermostat>/trace
+//   ./replay trace.bin [-v] [-f 0|1] [-w out.bin]
+//
+// The replay starts from the first checkpoint in the trace, then feeds the sensor readings and the settings to
+// CControl in the same order against the control ticks as they happened on the device. Each relay change it makes
+// is compared with the one recorded; with -v, every input and every relay change is printed.
+// The order of an input against a tick is exact, except for an input which arrived while that tick was running.
+// With -f, the sensor fusion is forced on or off whatever the trace set, to see how the other one would have driven
+// the relays from the same readings; the relay changes then differ from the recorded ones, as they should.
+// With -w, the trace is written again with the relay changes of the replay in place of the recorded ones: this
+// records the fixtures of check.sh from their inputs, and records them again after a deliberate change of the
+// controller.
+
+#include "host.h"
+#include <time.h>
+#include <chrono>
+#include <vector>
+
+// Relays the replayed controller wrote last, -1 if none yet, and the tick which wrote them
+static int relays = -1;
+static uint32_t relays_tick = 0;
+
+static const char *relays_str(int r)
+{
+    static char buf[32];
+    static const char *names[] { "G", "Y1", "W1", "M", "Y2", "W2", "OB" };
+    char *p = buf;
+    *p = 0;
+    for (int i = 0; i < 7; i++)
+        if (~r & (1 << i))
+            p += sprintf(p, "%s%s", (p == buf) ? "" : ",", names[i]);
+    return (p == buf) ? "off" : buf;
+}
+
+int main(int argc, char *argv[])
+{
+    bool verbose = false;
+    int fusion = -1;            // Fusion forced by -f, -1 to follow the trace
+    const char *out_path = nullptr;
+    for (int a = 2; a < argc; a++)
+    {
+        if (!strcmp(argv[a], "-v"))
+            verbose = true;
+        else if (!strcmp(argv[a], "-f") && (a + 1 < argc))
+            fusion = atoi(argv[++a]) ? 1 : 0;
+        else if (!strcmp(argv[a], "-w") && (a + 1 < argc))
+            out_path = argv[++a];
+        else
+            argc = 0;
+    }
+    if (argc < 2)
+    {
+        printf("Usage: %s trace.bin [-v] [-f 0|1] [-w out.bin]\n", argv[0]);
+        return 2;
+    }
+    FILE *f = fopen(argv[1], "rb");
+    if (!f)
+    {
+        printf("Can not open %s\n", argv[1]);
+        return 2;
+    }
+    std::vector<TraceRecord> trace;
+    TraceRecord r;
+    while (fread(&r, sizeof(r), 1, f) == 1)
+        trace.push_back(r);
+    fclose(f);
+    if (trace.empty() || (trace[0].type != TRACE_HEADER) || (trace[0].arg != sizeof(TraceRecord)) || (trace[0].value != TRACE_VERSION))
+    {
+        printf("Not a trace of version %d\n", TRACE_VERSION);
+        return 2;
+    }
+
+    size_t i = 1;
+    while ((i < trace.size()) && (trace[i].type != TRACE_CHECKPOINT))
+        i++;
+    if (i == trace.size())
+    {
+        printf("No checkpoint in the trace, nothing to start from\n");
+        return 2;
+    }
+    printf("%zu records, replaying from the checkpoint at tick %u\n", trace.size() - 1, trace[i].tick);
+    // The trace as written by -w: the records up to the checkpoint as they are, the rest as the replay goes on
+    std::vector<TraceRecord> out(trace.begin(), trace.begin() + i + 1);
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t value[256] {};     // Values of the fields as they are assembled from the 16-bit halves
+    uint32_t recorded = 0, mismatched = 0, changes = 0;
+    bool in_checkpoint = true;  // Only the first checkpoint sets the state, the replay runs freely after that
+    uint32_t start_tick = trace[i].tick;
+    wdata.control_ticks = start_tick;
+    wdata.ac_eval_sec = 30; // Traces made before it was a setting do not have it
+    wdata.fusion = 0;       // nor the sensor fusion, they were made on the hard switch
+    for (i++; i < trace.size(); i++)
+    {
+        const TraceRecord &r = trace[i];
+        // A relay change was made by the tick after the one it is tagged with
+        uint32_t target = r.tick + (r.type == TRACE_RELAYS);
+        while (int32_t(wdata.control_ticks - target) < 0)
+        {
+            int before = relays;
+            if (fusion >= 0)
+                wdata.fusion = fusion;
+            control.tick();
+            wdata.control_ticks++;
+            relays = host_relays;
+            if (relays != before)
+            {
+                changes++;
+                relays_tick = wdata.control_ticks;
+                out.push_back(TraceRecord { wdata.control_ticks - 1, TRACE_RELAYS, 0, int16_t(relays) });
+                if (verbose)
+                    printf("%10u  replay %s\n", wdata.control_ticks, relays_str(relays));
+            }
+        }
+
+        if (r.type != TRACE_RELAYS)
+            out.push_back(r);
+        uint8_t field = r.arg & ~TRACE_HI;
+        if ((r.type == TRACE_SET) || (r.type == TRACE_STATE) || (r.type == TRACE_TIME))
+        {
+            if (r.arg & TRACE_HI)
+                value[field] = (value[field] & 0xFFFF) | (uint32_t(uint16_t(r.value)) << 16);
+            else
+                value[field] = uint16_t(r.value);
+        }
+        if (r.type != TRACE_STATE)
+            in_checkpoint = (r.type == TRACE_CHECKPOINT) && in_checkpoint;
+
+        if (r.type == TRACE_TEMP)
+        {
+            wdata.temp = r.value;
+            wdata.temp_valid = r.arg;
+            if (verbose)
+                printf("%10u  temp %.2f C%s\n", r.tick, temp_to_c(r.value), r.arg ? "" : " (invalid)");
+        }
+        else if (r.type == TRACE_EXT)
+        {
+            wdata.ext_temp = r.value;
+            wdata.ext_valid = r.arg;
+            if (verbose)
+                printf("%10u  ext %.2f C%s\n", r.tick, temp_to_c(r.value), r.arg ? "" : " (invalid)");
+        }
+        else if ((r.type == TRACE_STATE) && in_checkpoint)
+            control.set_state(field, value[field]);
+        else if (r.type == TRACE_SET)
+        {
+            temp_t t = value[field];
+            if (field == TRACE_F_FAN_MODE)
+                control.set_fan_mode(t);
+            else if (field == TRACE_F_AC_MODE)
+                control.set_ac_mode(t);
+            else if (field == TRACE_F_COOL_TO)
+                control.set_cool_to(t);
+            else if (field == TRACE_F_HEAT_TO)
+                control.set_heat_to(t);
+            else if (field == TRACE_F_HYST_RELEASE) // Recorded together, right after the trigger
+                control.set_hysteresis(value[TRACE_F_HYST_TRIGGER], t);
+            else if (field == TRACE_F_EQUIPMENT)
+                wdata.equipment = t;
+            else if (field == TRACE_F_FAN_SEC)
+                wdata.fan_sec = value[field];
+            else if (field == TRACE_F_AC_EVAL_SEC)
+                wdata.ac_eval_sec = value[field];
+            else if (field == TRACE_F_FUSION)
+                wdata.fusion = t;
+            if (verbose)
+                printf("%10u  set %d = %d\n", r.tick, field, value[field]);
+        }
+        else if ((r.type == TRACE_BUTTON) && verbose)
+            printf("%10u  button %d%s on option %d\n", r.tick, r.arg & ~TRACE_HI, (r.arg & TRACE_HI) ? " repeat" : "", r.value);
+        else if ((r.type == TRACE_TIME) && verbose && (r.arg & TRACE_HI))
+        {
+            time_t t = value[field];
+            printf("%10u  time %s", r.tick, ctime(&t));
+        }
+        else if (r.type == TRACE_RELAYS)
+        {
+            recorded++;
+            if ((uint8_t(r.value) != relays) || (relays_tick != r.tick + 1))
+            {
+                mismatched++;
+                printf("%10u  MISMATCH recorded %s,", r.tick + 1, relays_str(uint8_t(r.value)));
+                printf(" replay %s at %u\n", (relays < 0) ? "none" : relays_str(relays), relays_tick);
+                relays = host_relays = uint8_t(r.value); // Continue from the recorded outputs
+                relays_tick = r.tick + 1;
+            }
+            else if (verbose)
+                printf("%10u  recorded %s\n", r.tick + 1, relays_str(relays));
+        }
+    }
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint32_t ticks = wdata.control_ticks - start_tick;
+    printf("%u ticks (%.1f hours) replayed in %.3f s, %.0fx real time\n", ticks, ticks / 3600.0, sec, ticks / max(sec, 1e-6));
+    printf("%u relay changes recorded, %u mismatched, %u made by the replay\n", recorded, mismatched, changes);
+    if (out_path)
+    {
+        FILE *w = fopen(out_path, "wb");
+        if (!w || (fwrite(out.data(), sizeof(TraceRecord), out.size(), w) != out.size()) || fclose(w))
+        {
+            printf("Can not write %s\n", out_path);
+            return 2;
+        }
+        printf("%zu records written to %s, with the relay changes of the replay\n", out.size() - 1, out_path);
+        return 0;
+    }
+    return (mismatched || (changes != recorded)) ? 1 : 0;
+}
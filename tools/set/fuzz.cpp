@@ -0,0 +1,236 @@
+// Coverage-guided fuzzer of the /set parsers: parse(), get_parse_value() and the dispatch of handleSet
+//
+// The fuzz target is the libFuzzer entry point, so it builds with libFuzzer where clang is available:
+//   clang++ -O1 -g -fsanitize=fuzzer,address,undefined -DLIBFUZZER -I tools/host -I . -o set_fuzz tools/set/fuzz.cpp tools/set/harness.cpp set.cpp tools/host/host.cpp control.cpp sensor.cpp
+// and with g++ alone, through the small driver below which takes its coverage from set.cpp built with trace-pc:
+//   g++ -O1 -g -I tools/host -I . -fsanitize-coverage=trace-pc -c set.cpp -o set_cov.o
+//   g++ -O1 -g -fsanitize=address,undefined -I tools/host -I . -o set_fuzz tools/set/fuzz.cpp tools/set/harness.cpp set_cov.o tools/host/host.cpp control.cpp sensor.cpp
+//   ./set_fuzz [-t seconds] [-r runs] [-s seed] [tools/set/traffic.txt ...]
+//
+// Each input is the query of one /set request, the part after "/set?", run from a freshly flashed unit and checked
+// as in set_check(). A request with several arguments is also run one argument at a time: only one of them is used,
+// so the whole request has to leave wdata exactly as one of the accepted arguments does alone. A violation prints
+// the request and aborts. The driver starts from the requests in the given
+// traffic files, mutates them with the key names and the edge values of the parsers, and keeps every input which
+// reached a new edge of set.cpp, or the same edge a new number of times, as the AFL family of fuzzers does.
+
+#include "harness.h"
+
+#define FUZZ_MAX_LEN  256
+
+// Returns an error if the request did more than one of its arguments alone
+static const char *check_alone(const AsyncWebServerRequest &request)
+{
+    static AsyncWebServerRequest alone;
+    StationData all = wdata;
+    bool accepted = false;
+    for (size_t i = 0; i < request.args.size(); i++)
+    {
+        // request_arg() sees only the first argument of a name
+        bool first = true;
+        for (size_t j = 0; j < i; j++)
+            first = first && strcmp(request.args[j].name().c_str(), request.args[i].name().c_str());
+        if (!first)
+            continue;
+        set_reset();
+        alone.set_query("", 0);
+        alone.args.push_back(request.args[i]);
+        handleSet(&alone);
+        if ((alone.code == 200) && !memcmp(&all, &wdata, sizeof(StationData)))
+            return nullptr;
+        accepted = accepted || (alone.code == 200);
+    }
+    return accepted ? "the request did not do what any of its arguments does alone" : "accepted without a valid argument";
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static AsyncWebServerRequest request;
+    if (size > FUZZ_MAX_LEN)
+        return 0;
+    set_reset();
+    StationData before = wdata;
+    set_run(request, (const char *)data, size);
+    const char *error = set_check(request, before);
+    if (!error && (request.code == 200))
+        error = check_alone(request);
+    if (error)
+    {
+        fprintf(stderr, "%s: /set?", error);
+        for (size_t i = 0; i < size; i++)
+            fprintf(stderr, isprint(data[i]) ? "%c" : "\\x%02x", data[i]);
+        fprintf(stderr, "\n");
+        abort();
+    }
+    return 0;
+}
+
+#ifndef LIBFUZZER
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define COV_SIZE  (1 << 16)
+
+static uint8_t cov[COV_SIZE];        // Hits of every edge by the current input
+static uint8_t seen[COV_SIZE];       // Hit count classes of every edge seen so far, one bit per class
+static uintptr_t cov_prev;
+
+// Called by the code built with -fsanitize-coverage=trace-pc at every basic block; an edge is the pair of the
+// previous and the current block
+extern "C" void __sanitizer_cov_trace_pc()
+{
+    uintptr_t pc = uintptr_t(__builtin_return_address(0));
+    uint8_t &hits = cov[(pc ^ cov_prev) & (COV_SIZE - 1)];
+    hits += (hits != 255);
+    cov_prev = pc >> 1;
+}
+
+// Hit counts are told apart by class only: 1, 2, 3, 4-7, 8-15, 16-31, 32-127 and 128 or more
+static uint8_t hit_class(uint8_t hits)
+{
+    return (hits < 4) ? (1 << (hits - 1)) : (hits < 8) ? 8 : (hits < 16) ? 16 : (hits < 32) ? 32 : (hits < 128) ? 64 : 128;
+}
+
+static uint64_t rng_state = 1;
+static uint32_t rnd(uint32_t n)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return uint32_t(rng_state >> 32) % n;
+}
+
+// Keys of /set and the values at the edges of what the parsers accept
+static const char *const tokens[]
+{
+    "id=", "tag=", "ext_server=", "api_key=", "probe_return=", "probe_supply=", "probe_outdoor=", "ntp_server=",
+    "mqtt_server=", "mqtt_topic=", "mqtt_user=", "mqtt_pass=", "ext_read_sec=", "units=", "equipment=", "filter_sec=",
+    "cool_sec=", "heat_sec=", "filter_life_h=", "power_save=", "fan_w=", "cool_w=", "cool2_w=", "heat_w=", "heat2_w=",
+    "tariff_base=", "tariff_peak=", "peak_start=", "peak_end=", "utc_offset=", "ac_eval_sec=", "fusion=", "fan_mode=", "fan_sec=",
+    "ac_mode=", "filter_reset=", "cool_to=", "heat_to=", "hyst_trigger=", "hyst_release=", "temp_min=", "temp_max=",
+    "status=", "timestamp=", "key=",
+    "&", "=", "%", "%00", "%20", "%22", "+", "-", "0x", "0X", "0", "07", "08", "1e", "e-", ".", "-0", "nan", "inf",
+    "255", "256", "4294967295", "4294967296", "18446744073709551616", "1e39", "-1e39", "1e-50", "150", "150.01", "-50",
+    "-50.01", "10", "10.0001", "1577836800", "28ff4a1b63160342", "-720", "840", "32768", "-32769", "--1",
+};
+
+static void mutate(std::string &s, const std::vector<std::string> &corpus)
+{
+    static const char chars[] = "0123456789.-+eExX%&= abcdefABCDEF_\"\t\xff";
+    for (int n = 1 + rnd(4); n; n--)
+    {
+        size_t at = rnd(s.size() + 1);
+        switch (rnd(6))
+        {
+            case 0: // Replace a byte
+                if (!s.empty())
+                    s[rnd(s.size())] = chars[rnd(sizeof(chars) - 1)];
+                break;
+            case 1: // Insert a byte
+                s.insert(at, 1, chars[rnd(sizeof(chars) - 1)]);
+                break;
+            case 2: // Delete a few bytes
+                if (!s.empty())
+                    s.erase(rnd(s.size()), 1 + rnd(8));
+                break;
+            case 3: // Insert a token
+                s.insert(at, tokens[rnd(sizeof(tokens) / sizeof(tokens[0]))]);
+                break;
+            case 4: // Append the query of another input
+                s += "&" + corpus[rnd(corpus.size())];
+                break;
+            case 5: // Take the head of this one and the tail of another one
+            {
+                const std::string &o = corpus[rnd(corpus.size())];
+                s = s.substr(0, at) + o.substr(rnd(o.size() + 1));
+                break;
+            }
+        }
+    }
+    if (s.size() > FUZZ_MAX_LEN)
+        s.resize(FUZZ_MAX_LEN);
+}
+
+// Runs an input and returns the number of new edges or hit count classes it reached
+static int run(const std::string &s)
+{
+    memset(cov, 0, sizeof(cov));
+    cov_prev = 0;
+    LLVMFuzzerTestOneInput((const uint8_t *)s.data(), s.size());
+    int found = 0;
+    for (int w = 0; w < COV_SIZE; w += 8)
+    {
+        uint64_t word;
+        memcpy(&word, cov + w, 8);
+        if (!word) // Most of the map is never hit, skip it a word at a time
+            continue;
+        for (int i = w; i < w + 8; i++)
+        {
+            if (cov[i] && !(seen[i] & hit_class(cov[i])))
+            {
+                seen[i] |= hit_class(cov[i]);
+                found++;
+            }
+        }
+    }
+    return found;
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = 10;
+    uint64_t runs = UINT64_MAX;
+    std::vector<std::string> corpus { "cool_to=75", "fan_mode=1", "id=x" };
+    for (int a = 1; a < argc; a++)
+    {
+        if (!strcmp(argv[a], "-t") && (a + 1 < argc))
+            seconds = atof(argv[++a]);
+        else if (!strcmp(argv[a], "-r") && (a + 1 < argc))
+            runs = strtoull(argv[++a], nullptr, 10);
+        else if (!strcmp(argv[a], "-s") && (a + 1 < argc))
+            rng_state = max(strtoull(argv[++a], nullptr, 10), 1ULL);
+        else
+        {
+            FILE *f = fopen(argv[a], "r");
+            if (!f)
+            {
+                printf("Usage: %s [-t seconds] [-r runs] [-s seed] [traffic.txt ...]\n", argv[0]);
+                return 2;
+            }
+            char line[1024];
+            while (fgets(line, sizeof(line), f))
+            {
+                const char *q = strstr(line, "/set?");
+                if (q && (line[0] != '#'))
+                    corpus.push_back(std::string(q + 5, strcspn(q + 5, " \t\r\n\"'")));
+            }
+            fclose(f);
+        }
+    }
+
+    for (const std::string &s : corpus)
+        run(s);
+    size_t seeds = corpus.size();
+    auto start = std::chrono::steady_clock::now();
+    double wall = 0;
+    uint64_t n = 0;
+    for (; (n < runs) && (wall < seconds); n++)
+    {
+        std::string s = corpus[rnd(corpus.size())];
+        mutate(s, corpus);
+        if (run(s))
+            corpus.push_back(s);
+        if ((n & 1023) == 0)
+            wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int edges = 0;
+    for (int i = 0; i < COV_SIZE; i++)
+        edges += (seen[i] != 0);
+    printf("%llu runs in %.1f s: %.0f runs/s, %d edges of set.cpp, %zu inputs kept (%zu seeds), no violation\n",
+        (unsigned long long)n, wall, n / max(wall, 1e-6), edges, corpus.size(), seeds);
+    return 0;
+}
+#endif
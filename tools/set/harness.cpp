@@ -0,0 +1,94 @@
+// The rest of the firmware as set.cpp sees it: authentication always passes, NV writes and the profiler do nothing,
+// and a probe is assigned if its ROM code is well formed
+
+#include "harness.h"
+
+HeapStat heap_set;
+Histogram prof_set;
+
+void Histogram::add(uint32_t) {}
+uint32_t heap_mark() { return 0; }
+void heap_account(HeapStat &, uint32_t) {}
+bool auth_request(AsyncWebServerRequest *, bool) { return true; }
+void setup_power() {}
+void clock_set(uint32_t) {}
+
+bool probe_assign(int, const char *hex)
+{
+    for (int i = 0; i < 16; i++)
+        if (!isxdigit(hex[i]))
+            return false;
+    return hex[16] == 0;
+}
+
+void set_reset()
+{
+    wdata = StationData();
+    strcpy(wdata.id, "Thermostat");
+    strcpy(wdata.tag, "Smart Thermostat station");
+    strcpy(wdata.ext_server, "_sensor._tcp");
+    wdata.units = UNITS_F;
+    wdata.cool_to = TEMP_FROM_F(90);
+    wdata.heat_to = TEMP_FROM_F(60);
+    wdata.hyst_trigger = temp_delta_from_f(1.5);
+    wdata.hyst_release = temp_delta_from_f(0.5);
+    wdata.ac_eval_sec = 30;
+    wdata.fusion = 1;
+    wdata.temp_min = TEMP_FROM_F(60);
+    wdata.temp_max = TEMP_FROM_F(90);
+    wdata.filter_life_h = 720;
+    control.set_fan_mode(FAN_MODE_OFF);
+    control.set_ac_mode(AC_MODE_OFF);
+}
+
+void set_run(AsyncWebServerRequest &request, const char *query, size_t len)
+{
+    request.set_query(query, len);
+    handleSet(&request);
+}
+
+template <size_t N>
+static bool string_ok(const char (&s)[N])
+{
+    size_t len = strnlen(s, N);
+    return (len < N) && !memchr(s, '"', len);
+}
+
+const char *set_check(const AsyncWebServerRequest &request, const StationData &before)
+{
+    if (request.responses != 1)
+        return "not exactly one response";
+    if ((request.code != 200) && (request.code != 400))
+        return "unexpected response code";
+    if ((request.code == 200) && strncmp(request.content.c_str(), "OK", 2))
+        return "200 response without OK";
+    if ((request.code == 400) && memcmp(&before, &wdata, sizeof(StationData)))
+        return "rejected request changed wdata";
+
+#define CHECK(cond) if (!(cond)) return "out of range: " #cond
+    CHECK(string_ok(wdata.id) && string_ok(wdata.tag) && string_ok(wdata.ext_server) && string_ok(wdata.api_key));
+    CHECK(string_ok(wdata.ntp_server) && string_ok(wdata.mqtt_server) && string_ok(wdata.mqtt_topic));
+    CHECK(string_ok(wdata.mqtt_user) && string_ok(wdata.mqtt_pass));
+    CHECK(wdata.fan_mode <= FAN_MODE_LAST);
+    CHECK(wdata.ac_mode <= AC_MODE_LAST);
+    CHECK(wdata.units <= UNITS_C);
+    CHECK(wdata.equipment <= EQUIP_HP_B);
+    CHECK(wdata.power_save <= 1);
+    CHECK(wdata.fusion <= 1);
+    CHECK((wdata.ac_eval_sec >= AC_EVAL_SEC_MIN) && (wdata.ac_eval_sec <= AC_EVAL_SEC_MAX));
+    CHECK(wdata.ext_read_sec <= 24 * 3600);
+    CHECK(wdata.fan_sec <= 24 * 3600);
+    CHECK((wdata.filter_life_h >= 1) && (wdata.filter_life_h <= 100000));
+    CHECK((wdata.peak_start <= 24) && (wdata.peak_end <= 24));
+    CHECK((wdata.utc_offset_min >= -12 * 60) && (wdata.utc_offset_min <= 14 * 60));
+    CHECK((wdata.status & ~STATUS_MASK) == 0);
+    CHECK((wdata.cool_to >= SETPOINT_MIN) && (wdata.cool_to <= SETPOINT_MAX));
+    CHECK((wdata.heat_to >= SETPOINT_MIN) && (wdata.heat_to <= SETPOINT_MAX));
+    CHECK((wdata.hyst_trigger >= 0) && (wdata.hyst_trigger <= TEMP_DELTA_FROM_F(10)));
+    CHECK((wdata.hyst_release >= 0) && (wdata.hyst_release <= TEMP_DELTA_FROM_F(10)));
+    // -50..150 in either units, -50 C to 150 C at the widest; the conversion must not have wrapped around
+    CHECK((wdata.temp_min >= temp_from_c(-50)) && (wdata.temp_min <= temp_from_c(150)));
+    CHECK((wdata.temp_max >= temp_from_c(-50)) && (wdata.temp_max <= temp_from_c(150)));
+#undef CHECK
+    return nullptr;
+}
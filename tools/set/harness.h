@@ -0,0 +1,14 @@
+// Host harness of the /set handler: set.cpp and the controller, run against a stand-in request
+#pragma once
+#include "host.h"
+#include <ESPAsyncWebServer.h>
+
+// Resets wdata and the controller to the settings of a freshly flashed unit
+void set_reset();
+
+// Runs one request through handleSet, the query is what follows "/set?" and is not NUL-terminated
+void set_run(AsyncWebServerRequest &request, const char *query, size_t len);
+
+// Checks what a request must never do, whatever it holds: it sends exactly one response, a rejected request leaves
+// wdata as it was, and every setting stays in its range. Returns a description of the first violation, or nullptr.
+const char *set_check(const AsyncWebServerRequest &request, const StationData &before);
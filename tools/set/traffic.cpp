@@ -0,0 +1,106 @@
+// Replays recorded /set traffic through the real handler on the host, checks every response and measures the
+// requests per second
+//
+// Build from the repository root and run:
+//   g++ -O2 -I tools/host -I . -o set_traffic tools/set/traffic.cpp tools/set/harness.cpp set.cpp tools/host/host.cpp control.cpp sensor.cpp
+//   ./set_traffic tools/set/traffic.txt [-v] [-s seconds]
+//
+// The traffic is any text with one request per line: a web server or proxy access log, the URLs copied from the
+// browser, or a curl script; everything from "/set?" to the next space or quote is taken as the query of a request,
+// and the lines without one are skipped. The requests run in their order from a freshly flashed unit, and each is
+// checked as in set_check(); in an access log, the response code the unit recorded (after "HTTP/1.1\" ") has to
+// come out again. With -v, every response is printed. The traffic is then run again and again for a few
+// seconds (-s) to measure the throughput of the handler alone, without the network and the HTTP parsing.
+
+#include "harness.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+    bool verbose = false;
+    double seconds = 2;
+    const char *path = nullptr;
+    for (int a = 1; a < argc; a++)
+    {
+        if (!strcmp(argv[a], "-v"))
+            verbose = true;
+        else if (!strcmp(argv[a], "-s") && (a + 1 < argc))
+            seconds = atof(argv[++a]);
+        else if (!path)
+            path = argv[a];
+        else
+            path = nullptr, a = argc;
+    }
+    FILE *f = path ? fopen(path, "r") : nullptr;
+    if (!f)
+    {
+        printf("Usage: %s traffic.txt [-v] [-s seconds]\n", argv[0]);
+        return 2;
+    }
+    std::vector<std::string> queries;
+    std::vector<int> lines;
+    std::vector<int> codes;     // Recorded response codes, 0 if the line has none
+    char line[1024];
+    for (int n = 1; fgets(line, sizeof(line), f); n++)
+    {
+        const char *q = strstr(line, "/set?");
+        if (!q || (line[0] == '#'))
+            continue;
+        q += 5;
+        size_t len = strcspn(q, " \t\r\n\"'");
+        queries.push_back(std::string(q, len));
+        lines.push_back(n);
+        const char *code = strstr(q + len, "\" ");
+        codes.push_back(code ? atoi(code + 2) : 0);
+    }
+    fclose(f);
+    if (queries.empty())
+    {
+        printf("No /set requests in %s\n", path);
+        return 2;
+    }
+
+    set_reset();
+    AsyncWebServerRequest request;
+    int failed = 0, rejected = 0, mismatched = 0;
+    for (size_t i = 0; i < queries.size(); i++)
+    {
+        StationData before = wdata;
+        set_run(request, queries[i].c_str(), queries[i].size());
+        const char *error = set_check(request, before);
+        rejected += (request.code != 200);
+        if (error)
+        {
+            failed++;
+            printf("line %d: %s: /set?%s\n", lines[i], error, queries[i].c_str());
+        }
+        else if (codes[i] && (codes[i] != request.code))
+        {
+            mismatched++;
+            printf("line %d: recorded %d, replay %d %s: /set?%s\n", lines[i], codes[i], request.code,
+                request.content.c_str(), queries[i].c_str());
+        }
+        else if (verbose)
+            printf("line %d: %d %s  /set?%s\n", lines[i], request.code, request.content.c_str(), queries[i].c_str());
+    }
+    printf("%zu requests, %d rejected, %d failed the checks, %d responses differ from the recorded ones\n",
+        queries.size(), rejected, failed, mismatched);
+
+    // Throughput, in rounds of the whole traffic
+    uint64_t count = 0;
+    auto start = std::chrono::steady_clock::now();
+    double wall = 0;
+    while (wall < seconds)
+    {
+        set_reset();
+        for (const std::string &q : queries)
+            set_run(request, q.c_str(), q.size());
+        count += queries.size();
+        wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    printf("%llu requests in %.2f s: %.0f requests/s, %.2f us per request\n", (unsigned long long)count, wall,
+        count / wall, wall * 1e6 / count);
+    return (failed || mismatched) ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+// Drives the staging of a two stage system, CControl::stage(), through escalation and de-escalation on the host
+//
+// Build from the repository root and run:
+//   g++ -O2 -I tools/host -I . -o stage tools/stage/stage.cpp tools/host/host.cpp control.cpp sensor.cpp
+//   ./stage [-v]
+//
+// Each case starts a heating or cooling call from a known controller state and moves the room temperature as a
+// function of the time and of the stage, read every 30 sec as the probes are on the device. The stage changes the
+// controller makes are checked against the times they are due: escalation once the first stage has run
+// STAGE_MIN_SEC and its progress projects to more than STAGE_UP_SEC to the setpoint, and the drop back once the
+// projection is under STAGE_DOWN_SEC. With -v, every stage change is printed.
+
+#include "host.h"
+#include <functional>
+#include <vector>
+
+#define READ_SEC   30   // The probes are read every 30 sec
+#define COOL_TO    2300
+#define HEAT_TO    2000
+#define TRIGGER    83   // 1.5 F
+#define RELEASE    28   // 0.5 F
+
+static bool verbose = false;
+static int failed = 0;
+
+// Temperature of the room at the given second of a case, and the stage running
+typedef std::function<temp_t(uint32_t sec, uint8_t stage)> Room;
+
+struct Change
+{
+    uint32_t sec;
+    uint8_t call;
+    uint8_t stage;
+};
+
+// Restores the controller to an idle two stage system in the given mode, with the call and the stage given; the
+// call starts (or goes on) at the first evaluation, ac_eval_sec later
+static void reset(uint8_t ac_mode, uint8_t call = CALL_NONE, uint8_t stage = 0, temp_t stage_temp = 0, uint32_t stage_sec = 0)
+{
+    wdata = StationData();
+    wdata.equipment = EQUIP_TWO_STAGE;
+    wdata.ac_eval_sec = 30;
+    wdata.fusion = 0;
+    const uint32_t state[][2]
+    {
+        { TRACE_F_FAN_MODE, FAN_MODE_OFF }, { TRACE_F_AC_MODE, ac_mode }, { TRACE_F_COOL_TO, COOL_TO },
+        { TRACE_F_HEAT_TO, HEAT_TO }, { TRACE_F_HYST_TRIGGER, TRIGGER }, { TRACE_F_HYST_RELEASE, RELEASE },
+        { TRACE_F_EQUIPMENT, EQUIP_TWO_STAGE }, { TRACE_F_RELAYS, 0xFF }, { TRACE_F_CALL, call },
+        { TRACE_F_STAGE, stage }, { TRACE_F_STAGE_TEMP, uint16_t(stage_temp) }, { TRACE_F_STAGE_SEC, stage_sec },
+        { TRACE_F_CALL_SEC, 0 }, { TRACE_F_FAN_COUNTER, 0 }, { TRACE_F_AC_COUNTER, wdata.ac_eval_sec },
+    };
+    for (const auto &s : state)
+        control.set_state(s[0], s[1]);
+}
+
+// Runs the controller for the given seconds and returns its changes of the call and of the stage
+static std::vector<Change> run(const char *name, uint32_t seconds, const Room &room)
+{
+    std::vector<Change> changes;
+    uint8_t call = wdata.call, stage = wdata.stage;
+    if (verbose)
+        printf("%s\n", name);
+    for (uint32_t sec = 0; sec < seconds; sec++)
+    {
+        if ((sec % READ_SEC) == 0)
+        {
+            wdata.temp = room(sec, wdata.stage);
+            wdata.temp_valid = true;
+        }
+        control.tick();
+        wdata.control_ticks++;
+        if ((wdata.call != call) || (wdata.stage != stage))
+        {
+            call = wdata.call;
+            stage = wdata.stage;
+            changes.push_back(Change { sec, call, stage });
+            if (verbose)
+                printf("%8u s  %.2f C  call %d stage %d\n", sec, temp_to_c(wdata.temp), call, stage);
+        }
+    }
+    return changes;
+}
+
+// Finds the first change to the given call and stage (-1 for any) at or after a second, returns its second or
+// UINT32_MAX
+static uint32_t find(const std::vector<Change> &changes, uint8_t call, int stage, uint32_t from = 0)
+{
+    for (const Change &c : changes)
+        if ((c.sec >= from) && (c.call == call) && ((stage < 0) || (c.stage == stage)))
+            return c.sec;
+    return UINT32_MAX;
+}
+
+static void check(const char *name, bool ok, const char *what)
+{
+    printf("%-52s %s%s\n", name, ok ? "ok" : "FAILED: ", ok ? "" : what);
+    failed += !ok;
+}
+
+// A room which moves from a temperature at a rate per stage, in 1/100 C per minute, towards the setpoint
+static Room ramp(temp_t from, int rate1, int rate2, int dir)
+{
+    // The rate of the stage running is integrated, so that the room stays continuous over a stage change
+    return [temp = int32_t(from) * 60, last = 0u, rate1, rate2, dir](uint32_t sec, uint8_t stage) mutable
+    {
+        temp += dir * int32_t(sec - last) * ((stage == 2) ? rate2 : (stage == 1) ? rate1 : 0);
+        last = sec;
+        return temp_t(temp / 60);
+    };
+}
+
+int main(int argc, char *argv[])
+{
+    verbose = (argc > 1) && !strcmp(argv[1], "-v");
+    const uint32_t start = 29; // The call starts at the first evaluation, the 30th tick
+
+    {
+        // The first stage cools by 0.5 C in 15 min: far slower than reaching the release point in 15 min
+        const char *name = "cooling, slow first stage escalates";
+        reset(AC_MODE_COOL);
+        std::vector<Change> c = run(name, 3600, ramp(COOL_TO + 200, 3, 20, -1));
+        uint32_t up = find(c, CALL_COOL, 2);
+        check(name, (find(c, CALL_COOL, 1) == start) && (up >= start + STAGE_MIN_SEC) && (up <= start + STAGE_MIN_SEC + 60),
+            "no escalation right after STAGE_MIN_SEC");
+        name = "cooling, second stage drops back near the setpoint";
+        uint32_t down = find(c, CALL_COOL, 1, up);
+        check(name, (down != UINT32_MAX) && (down < find(c, CALL_NONE, -1, up)), "no drop back before the call ended");
+        name = "cooling, call ends at the release point";
+        check(name, find(c, CALL_NONE, -1, up) != UINT32_MAX, "the call did not end");
+    }
+    {
+        // The first stage reaches the release point in about 7 min
+        const char *name = "cooling, fast first stage stays";
+        reset(AC_MODE_COOL);
+        std::vector<Change> c = run(name, 3600, ramp(COOL_TO + 200, 35, 60, -1));
+        check(name, (find(c, CALL_COOL, 2) == UINT32_MAX) && (find(c, CALL_NONE, -1) != UINT32_MAX),
+            "escalated, or did not end the call");
+    }
+    {
+        const char *name = "cooling, no progress escalates";
+        reset(AC_MODE_COOL);
+        std::vector<Change> c = run(name, 1800, [](uint32_t, uint8_t) { return temp_t(COOL_TO + 200); });
+        uint32_t up = find(c, CALL_COOL, 2);
+        check(name, (up >= start + STAGE_MIN_SEC) && (up <= start + STAGE_MIN_SEC + 60), "no escalation");
+    }
+    {
+        const char *name = "heating, slow first stage escalates";
+        reset(AC_MODE_HEAT);
+        std::vector<Change> c = run(name, 3600, ramp(HEAT_TO - 200, 3, 20, 1));
+        uint32_t up = find(c, CALL_HEAT, 2);
+        check(name, (find(c, CALL_HEAT, 1) == start) && (up >= start + STAGE_MIN_SEC) && (up <= start + STAGE_MIN_SEC + 60),
+            "no escalation right after STAGE_MIN_SEC");
+        name = "heating, second stage drops back near the setpoint";
+        uint32_t down = find(c, CALL_HEAT, 1, up);
+        check(name, (down != UINT32_MAX) && (down < find(c, CALL_NONE, -1, up)), "no drop back before the call ended");
+    }
+    {
+        // A first stage which has run for 50 days, 10 C from the release point, and made 0.01 C of progress: the
+        // projection is 50000 days, which escalates. Its product of the distance and the seconds does not fit in
+        // 32 bits, and wraps around to a few minutes.
+        const char *name = "cooling, projection of a long stage";
+        temp_t temp = COOL_TO - RELEASE + 1000;
+        uint32_t stage_sec = 4294968 - 30; // 1000 * 4294968 = 2^32 + 704
+        reset(AC_MODE_COOL, CALL_COOL, 1, temp + 1, stage_sec);
+        std::vector<Change> c = run(name, 40, [=](uint32_t, uint8_t) { return temp; });
+        check(name, find(c, CALL_COOL, 2) != UINT32_MAX, "did not escalate");
+    }
+    printf("%s\n", failed ? "FAILED" : "all passed");
+    return failed ? 1 : 0;
+}
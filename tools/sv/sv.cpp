@@ -0,0 +1,131 @@
+// Runs the checks of the task supervisor on the host, against tasks which stall, idle or wait on their queue
+//
+// Build from the repository root and run:
+//   g++ -O2 -I tools/host -I . -o sv tools/sv/sv.cpp
+//   ./sv
+//
+// supervisor.cpp is built into this file, for its static check(), and run one check per simulated second as its
+// task does. The tasks never run: their heartbeats and the events in their queues are set by each case, and the
+// recoveries (a restart, the I2C bus clear, a reboot) are counted instead of done.
+
+#include "supervisor.cpp"
+
+StationData wdata;
+TwoWire Wire;
+
+static int created, reboots, bus_clears;
+static UBaseType_t queued; // Events waiting in the input queue of the button task
+static int failed = 0;
+
+uint32_t millis() { return 0; }
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) { return *(UBaseType_t *)queue; }
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *handle, BaseType_t)
+{
+    created++;
+    *handle = nullptr;
+    return pdPASS;
+}
+void vTaskDelete(TaskHandle_t) {}
+void vTaskDelay(TickType_t) {}
+void pinMode(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return HIGH; }
+void digitalWrite(uint8_t, uint8_t) {}
+void delayMicroseconds(uint32_t) {}
+bool TwoWire::begin() { bus_clears++; return true; }
+void esp_restart() { reboots++; }
+esp_err_t esp_task_wdt_init(uint32_t, bool) { return 0; }
+esp_err_t esp_task_wdt_add(TaskHandle_t) { return 0; }
+esp_err_t esp_task_wdt_reset() { return 0; }
+esp_reset_reason_t esp_reset_reason() { return ESP_RST_POWERON; }
+void pref_set(const char *, uint32_t) {}
+void pref_set(const char *, const char *) {}
+bool ota_rollback(const char *) { return false; }
+void log_write(uint8_t, uint8_t, const char *, uintptr_t, uintptr_t, uintptr_t, uintptr_t) {}
+
+static void task_fn(void *) {}
+
+// Supervises the button task alone, waiting on its queue, with its last heartbeat at the given time
+static void reset(uint32_t beat)
+{
+    memset(tasks, 0, sizeof(tasks));
+    wdata = StationData();
+    queued = 0;
+    supervise(TASK_GPIO, task_fn, "task_gpio", 2048, nullptr, 0, 0, &queued);
+    task_beat_ms[TASK_GPIO] = beat;
+    created = reboots = bus_clears = 0;
+}
+
+// Runs a check every second from one time to another, excluded
+static void run(uint32_t from, uint32_t to)
+{
+    for (uint32_t now = from; now < to; now += SV_PERIOD_MS)
+        check(TASK_GPIO, now);
+}
+
+static void expect(const char *name, bool ok, const char *what)
+{
+    printf("%-60s %s%s\n", name, ok ? "ok" : "FAILED: ", ok ? "" : what);
+    failed += !ok;
+}
+
+int main()
+{
+    const uint32_t hour = 3600000, deadline = deadline_ms[TASK_GPIO];
+    {
+        const char *name = "idle for hours with an empty queue";
+        reset(1000);
+        run(2000, 3 * hour);
+        expect(name, !created && !reboots && !tasks[TASK_GPIO].stall_at, "recovered an idle task");
+    }
+    {
+        const char *name = "event queued after hours idle, taken within the deadline";
+        reset(1000);
+        run(2000, 3 * hour);
+        queued = 1;
+        run(3 * hour, 3 * hour + deadline);
+        expect(name, !created && !reboots && !tasks[TASK_GPIO].stall_at, "recovered before the deadline");
+        name = "event taken, the task is idle again";
+        task_beat_ms[TASK_GPIO] = 3 * hour + deadline - 500;
+        queued = 0;
+        run(3 * hour + deadline, 4 * hour);
+        expect(name, !created && !reboots && !tasks[TASK_GPIO].stall_at, "recovered an idle task");
+    }
+    {
+        // The task never takes its event: a staged recovery from the first check which saw the event
+        const char *name = "event never taken after hours idle, restarted at the deadline";
+        reset(1000);
+        queued = 1;
+        uint32_t start = 3 * hour;
+        run(start, start + deadline);
+        bool none = !created;
+        run(start + deadline, start + deadline + SV_PERIOD_MS);
+        expect(name, none && (created == 1) && !reboots, "not restarted right at the deadline");
+        name = "event never taken, restarted again at twice the deadline";
+        run(start + deadline + SV_PERIOD_MS, start + 2 * deadline + SV_PERIOD_MS);
+        expect(name, (created == 2) && !reboots, "not restarted again at twice the deadline");
+        name = "event never taken, rebooted at four times the deadline";
+        run(start + 2 * deadline + SV_PERIOD_MS, start + 4 * deadline);
+        bool up = !reboots;
+        run(start + 4 * deadline, start + 4 * deadline + SV_PERIOD_MS);
+        expect(name, up && (reboots == 1) && !bus_clears, "not rebooted right at four times the deadline");
+    }
+    {
+        // A stream of events, the task takes them and then stops with more waiting
+        const char *name = "busy task stops with events waiting, restarted at the deadline";
+        reset(1000);
+        queued = 3;
+        uint32_t now = 2000;
+        for (; now < 60000; now += SV_PERIOD_MS)
+        {
+            task_beat_ms[TASK_GPIO] = now - 200;
+            check(TASK_GPIO, now);
+        }
+        // The last heartbeat was at 58.8 s, the first check past its deadline at 64 s
+        run(now, 64000);
+        bool none = !created;
+        run(64000, 65000);
+        expect(name, none && (created == 1) && !reboots, "not restarted at the deadline of its last heartbeat");
+    }
+    printf("%s\n", failed ? "FAILED" : "all passed");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+#include "main.h"
+#include <ESPAsyncWebServer.h>
+
+// Input capture for field debugging
+//
+// Every input the controller sees is recorded into a bounded ring in RAM: the thermostat and the external sensor
+// temperatures (only when they change), the button presses, the settings changed by /set, MQTT or the buttons,
+// the relay outputs and, once every TRACE_TIME_TICKS, the wall clock time. Each record is tagged with the number
+// of control ticks that ran before it, so the order of the inputs and the ticks is kept exactly without a record
+// per tick. Every TRACE_CHECKPOINT_TICKS, the controller writes a checkpoint of its whole state, which is where
+// a replay starts from once older records were overwritten.
+// The ring is downloaded from /trace as raw records, oldest first, behind a TRACE_HEADER record. The host tool
+// in tools/replay/ runs a trace through the real CControl code and compares the relay sequence it makes with the
+// one recorded.
+
+#define TRACE_RECORDS        2048 // 16 KB, about ten hours of a typical trace
+
+static TraceRecord ring[TRACE_RECORDS];
+static uint32_t ring_next = 0;    // Total number of records written, the next one goes to ring_next % TRACE_RECORDS
+static int32_t last_input[2] { -1, -1 }; // Last TRACE_TEMP and TRACE_EXT, packed as arg << 16 | value
+static portMUX_TYPE ring_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static inline void put(uint32_t tick, uint8_t type, uint8_t arg, int16_t value)
+{
+    ring[ring_next++ % TRACE_RECORDS] = TraceRecord { tick, type, arg, value };
+}
+
+void trace(uint8_t type, uint8_t arg, int16_t value)
+{
+    portENTER_CRITICAL(&ring_mux);
+    put(wdata.control_ticks, type, arg, value);
+    portEXIT_CRITICAL(&ring_mux);
+}
+
+// Records a 32-bit value as two records, with the low and the high 16 bits
+void trace32(uint8_t type, uint8_t arg, uint32_t value)
+{
+    portENTER_CRITICAL(&ring_mux);
+    put(wdata.control_ticks, type, arg, value & 0xFFFF);
+    put(wdata.control_ticks, type, arg | TRACE_HI, value >> 16);
+    portEXIT_CRITICAL(&ring_mux);
+}
+
+// Records a sensor reading (TRACE_TEMP or TRACE_EXT) if it differs from the last one recorded
+void trace_input(uint8_t type, bool valid, temp_t temp)
+{
+    int32_t packed = (int32_t(valid) << 16) | uint16_t(temp);
+    portENTER_CRITICAL(&ring_mux);
+    if (last_input[type - TRACE_TEMP] != packed)
+    {
+        last_input[type - TRACE_TEMP] = packed;
+        put(wdata.control_ticks, type, valid, temp);
+    }
+    portEXIT_CRITICAL(&ring_mux);
+}
+
+// Records a checkpoint without any other record in between: the fields of the controller state as { TRACE_F_*,
+// value } pairs, each value as its low and high 16 bits, then the sensor readings. The records are written straight
+// into the ring, a checkpoint of some 50 records would take a good part of the stack of the control task.
+void trace_checkpoint(const uint32_t (*state)[2], int fields)
+{
+    uint32_t tick = wdata.control_ticks;
+    portENTER_CRITICAL(&ring_mux);
+    put(tick, TRACE_CHECKPOINT, 0, 0);
+    for (int i = 0; i < fields; i++)
+    {
+        put(tick, TRACE_STATE, uint8_t(state[i][0]), int16_t(state[i][1]));
+        put(tick, TRACE_STATE, uint8_t(state[i][0] | TRACE_HI), int16_t(state[i][1] >> 16));
+    }
+    put(tick, TRACE_TEMP, wdata.temp_valid, wdata.temp);
+    put(tick, TRACE_EXT, wdata.ext_valid, wdata.ext_temp);
+    // A checkpoint holds the sensor readings too, the next change is recorded against them
+    last_input[0] = last_input[1] = -1;
+    portEXIT_CRITICAL(&ring_mux);
+}
+
+void handleTrace(AsyncWebServerRequest *request)
+{
+    // Snapshot of the ring position, kept by each download in its own callback so that downloads at the same time
+    // do not disturb each other; records overwritten while the download runs are sent as they are then
+    uint32_t first, count;
+    portENTER_CRITICAL(&ring_mux);
+    count = min(ring_next, uint32_t(TRACE_RECORDS));
+    first = ring_next - count;
+    portEXIT_CRITICAL(&ring_mux);
+
+    size_t size = (count + 1) * sizeof(TraceRecord);
+    AsyncWebServerResponse *response = request->beginResponse("application/octet-stream", size,
+        [first, count](uint8_t *buf, size_t max_len, size_t index) -> size_t
+    {
+        // Copies whole records only, the response asks again for the rest
+        size_t n = 0;
+        for (uint32_t i = index / sizeof(TraceRecord); (n + sizeof(TraceRecord) <= max_len) && (i <= count); i++)
+        {
+            TraceRecord r { wdata.control_ticks, TRACE_HEADER, sizeof(TraceRecord), TRACE_VERSION };
+            portENTER_CRITICAL(&ring_mux);
+            if (i)
+                r = ring[(first + i - 1) % TRACE_RECORDS];
+            portEXIT_CRITICAL(&ring_mux);
+            memcpy(buf + n, &r, sizeof(r));
+            n += sizeof(r);
+        }
+        return n;
+    });
+    response->addHeader("Content-Disposition", "attachment; filename=trace.bin");
+    request->send(response);
+}
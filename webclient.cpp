@@ -5,6 +5,7 @@
 // Reading a temperature from an external sensor
 // This is normally one of my other WiFi sensors that publish its data via json http response
 // Needs ArduinoJson library by Benoit Blanchon
+// The sensor is found by its address, or by mDNS as a host name or a service type (see mdns.cpp)
 
 static StaticJsonDocument<512> doc;
 
@@ -13,10 +14,18 @@ static bool get_external_temp()
 {
     // Use WiFiClient class to create TCP connections
     WiFiClient client;
+    IPAddress ip;
+    uint16_t port;
 
-    if (!client.connect(wdata.ext_server.c_str(), 80))
+    if (!mdns_resolve(wdata.ext_server, ip, port))
     {
-        Serial.println("Unable to connect");
+        log_write(LOG_WARN, LOG_EXT, "Unable to resolve the sensor");
+        return false;
+    }
+    if (!client.connect(ip, port))
+    {
+        mdns_forget(wdata.ext_server); // The sensor may have moved to another address
+        log_write(LOG_WARN, LOG_EXT, "Unable to connect to %d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
         return false;
     }
 
@@ -28,18 +37,26 @@ static bool get_external_temp()
     {
         if (millis() - timeout > 5000)
         {
-            Serial.println("Client timed out");
+            log_write(LOG_WARN, LOG_EXT, "Sensor timed out");
             client.stop();
             return false;
         }
+        task_alive(TASK_EXT);
+        vTaskDelay(10 / portTICK_PERIOD_MS); // Do not starve the idle task on this core (task watchdog)
     }
 
     // Read a line of the reply from server which should be a line of json data
     while(client.available())
     {
-        String line = client.readStringUntil('\n');
-        line.trim();
-        const char *json = line.c_str();
+        // Read a line into a fixed buffer, a longer line is cut and fails to parse
+        static char line[512];
+        size_t len = client.readBytesUntil('\n', line, sizeof(line) - 1);
+        while (len && isspace(line[len - 1]))
+            len--;
+        line[len] = 0;
+        const char *json = line;
+        while (isspace(*json))
+            json++;
         if (json[0] != '{')
             continue; // Parse only JSON lines
         DeserializationError error = deserializeJson(doc, json);
@@ -50,12 +67,17 @@ static bool get_external_temp()
         }
         else
         {
-            float temp_f = doc["temp_f"];
-            if ((temp_f >= 60.0) && (temp_f <= 90.0))
+            // Prefer the "C" value, sensors running our own firmware report both. The value is range checked while it
+            // is a float, a reading far out of range would wrap around in temp_t; a missing one is NaN, which fails
+            // both comparisons.
+            JsonVariant temp_c = doc["temp_c"];
+            JsonVariant temp_f = doc["temp_f"];
+            float c = !temp_c.isNull() ? temp_c.as<float>() : !temp_f.isNull() ? (temp_f.as<float>() - 32) * 5 / 9 : NAN;
+            if ((c >= temp_to_c(wdata.temp_min)) && (c <= temp_to_c(wdata.temp_max)))
             {
-                wdata.ext_temp_f = temp_f;
-                wdata.ext_temp_c = (temp_f - 32.0) * 5.0 / 9.0;
+                wdata.ext_temp = temp_from_c(c);
                 wdata.ext_valid = true;
+                wdata.status &= ~(STATUS_EXT_GET_ERROR | STATUS_EXT_JSON_ERROR | STATUS_EXT_TEMP_ERROR);
             }
             else
             {
@@ -71,20 +93,28 @@ void vTask_ext_temp(void *p)
 {
     while(true)
     {
+        task_alive(TASK_EXT);
         // Read external temperature sensor only if it is enabled (ext_read_sec > 0)
-        if (wdata.ext_read_sec)
+        // While the WiFi is down, do not spend time on connection retries; the internal sensor takes over
+        if (wdata.ext_read_sec && (WiFi.status() != WL_CONNECTED))
+            wdata.ext_valid = false;
+        else if (wdata.ext_read_sec)
         {
             int retries = 5; // Retry connecting to the external server several times before giving up
+            uint32_t mark = heap_mark();
             while (retries && (get_external_temp() == false))
             {
                 vTaskDelay(5 * 1000 / portTICK_PERIOD_MS); // Delay 5 seconds before retrying the request
+                task_alive(TASK_EXT);
                 retries--;
             }
+            heap_account(heap_ext, mark);
             if (retries == 0)
                 wdata.ext_valid = false;
         }
         else
             wdata.ext_valid = false;
+        trace_input(TRACE_EXT, wdata.ext_valid, wdata.ext_temp);
 
         // Wait for the next time we need to read the external sensor
         // Either wait for 1 sec (if the ext_read_sec is 0) or up to a minute
@@ -1,8 +1,6 @@
 #include "main.h"
 #include <WiFi.h>
 #include <ESPAsyncWebServer.h>
-#include <ESPmDNS.h>
-#include <Update.h>
 #include "control.h"
 
 // Async web server needs these two additional libraries:
@@ -17,12 +15,49 @@ extern "C" uint8_t temprature_sens_read(); // Very imprecise internal ESP32 temp
 // #define MY_PASS "your-password"
 static const char* ssid = MY_SSID;
 static const char* password = MY_PASS;
-static char webtext_root[1024];
-static char webtext_json[1024];
+static char webtext_root[3072];
+static char webtext_json[2048];
+// Current and the last pushed UI state: the id and the tag, and at most 256 bytes of the fixed part and the numbers
+#define UI_STATE_SIZE  (sizeof(wdata.id) + sizeof(wdata.tag) + 256)
+static char webtext_event[2][UI_STATE_SIZE];
+static char webtext_prof[3072];
+static char webtext_energy[3072];
 static uint32_t reconnects = 0; // Count how many times WiFi had to reconnect (for stats)
 
+// WiFi connection is driven by the system events and never blocks the caller
+#define WIFI_BACKOFF_MIN_MS    1000 // Delay before the first retry after a failed connection attempt
+#define WIFI_BACKOFF_MAX_MS   60000 // Retry delay doubles on each failure up to this value
+#define WIFI_ATTEMPT_MS       10000 // Give up on an attempt that did not get an IP address in this time
+static volatile bool wifi_connected = false; // Set when we got the IP address
+static volatile bool wifi_attempting = false;// Set while a connection attempt is in progress
+static volatile bool wifi_use_cache = true;  // Try the cached BSSID and channel first, cleared when that fails
+static volatile bool wifi_cache_dirty = false;// Access point changed and the cache should be written to NV
+static volatile uint32_t wifi_backoff_ms = WIFI_BACKOFF_MIN_MS;
+static volatile uint32_t wifi_retry_at = 0;  // millis() time of the next connection attempt
+static volatile uint32_t wifi_attempt_at = 0;// millis() time when the current attempt started
+static volatile uint32_t wifi_lost_at = 0;   // millis() time when the connection was lost (or the boot time)
+static bool mdns_started = false;
+
 AsyncWebServer server(80);
 
+// The web UI is a single page stored gzipped in flash (webui.h, generated by tools/embed_assets.py from ui/).
+// The browser keeps it in its cache and revalidates it by the ETag, so after the first visit it loads with an
+// empty 304 response. The page then gets a compact state with only the fields it shows pushed as "state" events on
+// /events, whenever it changes and at least every UI_PUSH_SEC; it polls /json if the push stream is not available.
+#define UI_PUSH_SEC  60
+struct WebAsset
+{
+    const char *path;
+    const char *type;
+    const char *etag;
+    const uint8_t *data;
+    uint32_t size;
+};
+#include "webui.h"
+static AsyncEventSource events("/events");
+static uint32_t events_at = 0; // wdata.seconds of the last pushed state
+static uint32_t events_second = 0;
+
 static char *get_time_str(uint32_t sec, bool also_days)
 {
     static char buf[32];
@@ -45,41 +80,83 @@ void get_webserver_response_html()
     // Make this web page auto-refresh every 5 sec
     p += sprintf(p, "<!DOCTYPE html><html><head><meta http-equiv=\"refresh\" content=\"5\"></head><body><pre>");
     p += sprintf(p, "\nVER = " FIRMWARE_VERSION);
-    p += sprintf(p, "\nID = %s", wdata.id.c_str());
-    p += sprintf(p, "\nTAG = %s", wdata.tag.c_str());
+    p += sprintf(p, "\nID = %s", wdata.id);
+    p += sprintf(p, "\nTAG = %s", wdata.tag);
     p += sprintf(p, "\nstatus = %d", wdata.status);
     p += sprintf(p, "\nuptime = %s", get_time_str(wdata.seconds, true));
     p += sprintf(p, "\ntimestamp = %s", ctime(&timestamp));
+    p += sprintf(p, "\nntp_server = %s", wdata.ntp_server);
+    p += sprintf(p, "\nclock = %d syncs, %d fails, %d steps, offset %d ms, rtt %d ms", wdata.clock_syncs, wdata.clock_fails,
+        wdata.clock_steps, wdata.clock_offset_ms, wdata.clock_rtt_ms);
     p += sprintf(p, "\nreconnects = %d", reconnects);
+    p += sprintf(p, "\nlog_dropped = %d", wdata.log_dropped);
+    p += sprintf(p, "\nwifi_connect_ms = %d", wdata.wifi_connect_ms);
+    p += sprintf(p, "\nfirst_decision_ms = %d", wdata.first_decision_ms);
+    p += sprintf(p, "\nwarm_boot = %d", wdata.warm_boot);
+    p += sprintf(p, "\nresume_ms = %d", wdata.resume_ms);
+    p += sprintf(p, "\nota = %d,%d,%d,%d", wdata.ota_pending, wdata.ota_kbps, wdata.ota_downtime_ms, wdata.ota_rollbacks);
+    p += sprintf(p, "\npower_save = %d", wdata.power_save);
+    p += sprintf(p, "\nlight_sleep = %d", wdata.light_sleep);
+    p += sprintf(p, "\ncpu_mhz = %d", wdata.cpu_mhz);
+    p += sprintf(p, "\nidle_pct = %d,%d", wdata.idle_pct[PRO_CPU], wdata.idle_pct[APP_CPU]);
+    p += sprintf(p, "\nwakeups = %d,%d,%d", wdata.wake_timer, wdata.wake_gpio, wdata.wake_other);
     p += sprintf(p, "\nRSSI = %d", WiFi.RSSI()); // Signal strength
     p += sprintf(p, "\nGPIO23 = %d", wdata.gpio23);
     p += sprintf(p, "\nINT_C = %4.1f", (temprature_sens_read() - 32) / 1.8);
     p += sprintf(p, "\ntemp_valid = %d", wdata.temp_valid);
-    p += sprintf(p, "\ntemp_c = %4.1f", wdata.temp_c);
-    p += sprintf(p, "\ntemp_f = %4.1f", wdata.temp_f);
-    p += sprintf(p, "\next_server = %s", wdata.ext_server.c_str());;
+    p += sprintf(p, "\ntemp_c = %4.1f", temp_to_c(wdata.temp));
+    p += sprintf(p, "\ntemp_f = %4.1f", temp_to_f(wdata.temp));
+    p += sprintf(p, "\next_server = %s", wdata.ext_server);;
+    p += sprintf(p, "\nmdns = %d queries, %d hits, %d fails, %d ms last, %d ms max", wdata.mdns_queries, wdata.mdns_hits,
+        wdata.mdns_fails, wdata.mdns_query_ms, wdata.mdns_query_max_ms);
     p += sprintf(p, "\next_read_sec = %d", wdata.ext_read_sec);
     p += sprintf(p, "\next_valid = %d", wdata.ext_valid);
-    p += sprintf(p, "\next_temp_c = %4.1f", wdata.ext_temp_c);
-    p += sprintf(p, "\next_temp_f = %4.1f", wdata.ext_temp_f);
+    p += sprintf(p, "\next_temp_c = %4.1f", temp_to_c(wdata.ext_temp));
+    p += sprintf(p, "\next_temp_f = %4.1f", temp_to_f(wdata.ext_temp));
+    p += sprintf(p, "\nfusion = %d", wdata.fusion);
+    p += sprintf(p, "\nfused_valid = %d", wdata.fused_valid);
+    p += sprintf(p, "\nfused_temp_c = %4.2f", temp_to_c(wdata.fused_temp));
+    p += sprintf(p, "\nfused_source = %s", fused_source_str());
+    p += sprintf(p, "\nfused_confidence = %d", wdata.fused_confidence);
+    p += sprintf(p, "\nsensor_health = %d,%d", wdata.sensor_health[SENSOR_INT], wdata.sensor_health[SENSOR_EXT]);
+    p += sprintf(p, "\next_weight = %d", wdata.ext_weight);
+    p += sprintf(p, "\nint_offset_c = %4.2f", temp_to_c(wdata.int_offset / 65536));
     p += sprintf(p, "\nrelays = %d", wdata.relays);
     p += sprintf(p, "\nfan_on = %d", !!(~wdata.relays & PIN_FAN));
     p += sprintf(p, "\ncool_on = %d", !!(~wdata.relays & PIN_COOL));
     p += sprintf(p, "\nheat_on = %d", !!(~wdata.relays & PIN_HEAT));
     p += sprintf(p, "\nmaster_on = %d", !!(~wdata.relays & PIN_MASTER));
+    p += sprintf(p, "\ncool2_on = %d", !!(~wdata.relays & PIN_COOL2));
+    p += sprintf(p, "\nheat2_on = %d", !!(~wdata.relays & PIN_HEAT2));
+    p += sprintf(p, "\nob_on = %d", !!(~wdata.relays & PIN_OB));
+    p += sprintf(p, "\nequipment = %d", wdata.equipment);
+    p += sprintf(p, "\ncall = %d", wdata.call);
+    p += sprintf(p, "\nstage = %d", wdata.stage);
     p += sprintf(p, "\nfan_mode = %d", wdata.fan_mode);
     p += sprintf(p, "\nfan_sec = %d", wdata.fan_sec);
     p += sprintf(p, "\nac_mode = %d", wdata.ac_mode);
-    p += sprintf(p, "\ncool_to = %d", wdata.cool_to);
-    p += sprintf(p, "\nheat_to = %d", wdata.heat_to);
-    p += sprintf(p, "\nhyst_trigger = %4.1f", wdata.hyst_trigger);
-    p += sprintf(p, "\nhyst_release = %4.1f", wdata.hyst_release);
+    p += sprintf(p, "\nunits = %s", units_str());
+    p += sprintf(p, "\ncool_to = %4.1f", temp_to_units(wdata.cool_to));
+    p += sprintf(p, "\nheat_to = %4.1f", temp_to_units(wdata.heat_to));
+    p += sprintf(p, "\nhyst_trigger = %4.1f", temp_delta_to_units(wdata.hyst_trigger));
+    p += sprintf(p, "\nhyst_release = %4.1f", temp_delta_to_units(wdata.hyst_release));
+    p += sprintf(p, "\nac_eval_sec = %d", wdata.ac_eval_sec);
+    p += sprintf(p, "\ntemp_min = %4.1f", temp_to_units(wdata.temp_min));
+    p += sprintf(p, "\ntemp_max = %4.1f", temp_to_units(wdata.temp_max));
     p += sprintf(p, "\nfilter_sec = %d", wdata.filter_sec);
     p += sprintf(p, "\ncool_sec = %d", wdata.cool_sec);
     p += sprintf(p, "\nheat_sec = %d", wdata.heat_sec);
+    p += sprintf(p, "\nfilter_wear = %d", wdata.filter_wear);
+    p += sprintf(p, "\nfilter_life_h = %d", wdata.filter_life_h);
+    p += sprintf(p, "\nfilter_pct = %d", control.filter_pct());
     p += sprintf(p, "\nfilter_hms = %s", get_time_str(wdata.filter_sec, false));
     p += sprintf(p, "\ncool_hms = %s", get_time_str(wdata.cool_sec, false));
     p += sprintf(p, "\nheat_hms = %s", get_time_str(wdata.heat_sec, false));
+    p += sprintf(p, "\nsv_recoveries = %d,%d,%d,%d,%d", wdata.sv_recoveries[TASK_CONTROL], wdata.sv_recoveries[TASK_TICK],
+        wdata.sv_recoveries[TASK_I2C], wdata.sv_recoveries[TASK_GPIO], wdata.sv_recoveries[TASK_EXT]);
+    p += sprintf(p, "\nsv_stall_ms = %d,%d,%d,%d,%d", wdata.sv_stall_ms[TASK_CONTROL], wdata.sv_stall_ms[TASK_TICK],
+        wdata.sv_stall_ms[TASK_I2C], wdata.sv_stall_ms[TASK_GPIO], wdata.sv_stall_ms[TASK_EXT]);
+    p += sprintf(p, "\nsv_reboots = %d (%s)", wdata.sv_reboots, wdata.sv_reason);
     p += sprintf(p, "\nstack_watermarks = %d,%d,%d,%d,%d", wdata.task_1s, wdata.task_i2c, wdata.task_control, wdata.task_gpio, wdata.task_ext);
     p += sprintf(p, "</pre></body></html>\n");
 
@@ -87,43 +164,107 @@ void get_webserver_response_html()
         wdata.status |= STATUS_BUF_OVERFLOW;
 }
 
-void get_webserver_response_json()
+void get_webserver_response_json(char *buf, size_t size)
 {
-    webtext_json[sizeof(webtext_json) - 1] = 0xFF;
-    char *p = webtext_json;
+    buf[size - 1] = 0xFF;
+    char *p = buf;
 
     p += sprintf(p, "{");
-    p += sprintf(p, " \"id\":\"%s\"", wdata.id.c_str());
-    p += sprintf(p, ", \"tag\":\"%s\"", wdata.tag.c_str());
+    p += sprintf(p, " \"id\":\"%s\"", wdata.id);
+    p += sprintf(p, ", \"tag\":\"%s\"", wdata.tag);
     p += sprintf(p, ", \"uptime\":%d", wdata.seconds);
+    p += sprintf(p, ", \"timestamp\":%d", wdata.timestamp);
+    p += sprintf(p, ", \"clock_sync_at\":%d", wdata.clock_sync_at);
     p += sprintf(p, ", \"status\":%d", wdata.status);
     // Json returns only the effective temperature (internal or external sensor)
     p += sprintf(p, ", \"temp_valid\":%d", wdata.get_temp_valid());
     if (wdata.get_temp_valid()) // Add the temperature valid only if it is valid
     {
-        p += sprintf(p, ", \"temp_c\":%4.1f", wdata.get_temp_c());
-        p += sprintf(p, ", \"temp_f\":%4.1f", wdata.get_temp_f());
+        p += sprintf(p, ", \"temp_c\":%4.1f", temp_to_c(wdata.get_temp()));
+        p += sprintf(p, ", \"temp_f\":%4.1f", temp_to_f(wdata.get_temp()));
+    }
+    p += sprintf(p, ", \"temp_source\":\"%s\"", fused_source_str());
+    p += sprintf(p, ", \"temp_confidence\":%d", wdata.fused_confidence);
+    static const char *probe_names[PROBES] { "return", "supply", "outdoor" };
+    for (int role = 0; role < PROBES; role++)
+    {
+        char rom[17];
+        probe_hex(rom, role);
+        p += sprintf(p, "%s\"%s\":{ \"rom\":\"%s\", \"valid\":%d", role ? ", " : ", \"probes\":{ ", probe_names[role], rom, wdata.probe_valid[role]);
+        if (wdata.probe_valid[role])
+            p += sprintf(p, ", \"temp_c\":%.2f", temp_to_c(wdata.probe_temp[role]));
+        p += sprintf(p, " }");
     }
+    p += sprintf(p, " }, \"supply_delta_c\":%.2f, \"probe_read_us\":%d", temp_to_c(wdata.supply_delta), wdata.probe_read_us);
     p += sprintf(p, ", \"relays\":%d", wdata.relays);
     p += sprintf(p, ", \"fan_on\":%d", !!(~wdata.relays & PIN_FAN));
     p += sprintf(p, ", \"cool_on\":%d", !!(~wdata.relays & PIN_COOL));
     p += sprintf(p, ", \"heat_on\":%d", !!(~wdata.relays & PIN_HEAT));
     p += sprintf(p, ", \"master_on\":%d", !!(~wdata.relays & PIN_MASTER));
+    p += sprintf(p, ", \"call\":%d", wdata.call);
+    p += sprintf(p, ", \"stage\":%d", wdata.stage);
     p += sprintf(p, ", \"fan_mode\":%d", wdata.fan_mode);
     p += sprintf(p, ", \"fan_sec\":%d", wdata.fan_sec);
     p += sprintf(p, ", \"ac_mode\":%d", wdata.ac_mode);
-    p += sprintf(p, ", \"cool_to\":%d", wdata.cool_to);
-    p += sprintf(p, ", \"heat_to\":%d", wdata.heat_to);
+    p += sprintf(p, ", \"units\":\"%s\"", units_str());
+    p += sprintf(p, ", \"cool_to\":%.1f", temp_to_units(wdata.cool_to));
+    p += sprintf(p, ", \"heat_to\":%.1f", temp_to_units(wdata.heat_to));
     p += sprintf(p, ", \"filter_sec\":%d", wdata.filter_sec);
     p += sprintf(p, ", \"cool_sec\":%d", wdata.cool_sec);
     p += sprintf(p, ", \"heat_sec\":%d", wdata.heat_sec);
+    p += sprintf(p, ", \"filter_pct\":%d", control.filter_pct());
+    p += sprintf(p, ", \"wifi_connect_ms\":%d", wdata.wifi_connect_ms);
+    p += sprintf(p, ", \"first_decision_ms\":%d", wdata.first_decision_ms);
+    p += sprintf(p, ", \"idle_pct\":[%d,%d]", wdata.idle_pct[PRO_CPU], wdata.idle_pct[APP_CPU]);
+    p += sprintf(p, ", \"auth_rejected\":%d", wdata.auth_rejected);
+    p += sprintf(p, ", \"auth_throttled\":%d", wdata.auth_throttled);
+    p += sprintf(p, ", \"mqtt_queued\":%d", wdata.mqtt_queued);
+    p += sprintf(p, ", \"mqtt_dropped\":%d", wdata.mqtt_dropped);
+    p += sprintf(p, ", \"log_dropped\":%d", wdata.log_dropped);
+    p += sprintf(p, ", \"mdns\":[%d,%d,%d,%d,%d]", wdata.mdns_queries, wdata.mdns_hits, wdata.mdns_fails, wdata.mdns_query_ms,
+        wdata.mdns_query_max_ms);
+    p += sprintf(p, ", \"sv_recoveries\":[%d,%d,%d,%d,%d]", wdata.sv_recoveries[TASK_CONTROL], wdata.sv_recoveries[TASK_TICK],
+        wdata.sv_recoveries[TASK_I2C], wdata.sv_recoveries[TASK_GPIO], wdata.sv_recoveries[TASK_EXT]);
+    p += sprintf(p, ", \"sv_stall_ms\":[%d,%d,%d,%d,%d]", wdata.sv_stall_ms[TASK_CONTROL], wdata.sv_stall_ms[TASK_TICK],
+        wdata.sv_stall_ms[TASK_I2C], wdata.sv_stall_ms[TASK_GPIO], wdata.sv_stall_ms[TASK_EXT]);
+    p += sprintf(p, ", \"sv_reboots\":%d, \"sv_reason\":\"%s\"", wdata.sv_reboots, wdata.sv_reason);
     p += sprintf(p, " }");
 
-    if (webtext_json[sizeof(webtext_json) - 1] != 0xFF)
+    if (buf[size - 1] != 0xFF)
         wdata.status |= STATUS_BUF_OVERFLOW;
 }
 
-void handleRoot(AsyncWebServerRequest *request)
+// Returns the value of the request header, or nullptr if there is no such header
+const char *request_header(AsyncWebServerRequest *request, const char *name)
+{
+    for (size_t i = 0; i < request->headers(); i++)
+    {
+        AsyncWebHeader *header = request->getHeader(i);
+        if (!strcasecmp(header->name().c_str(), name))
+            return header->value().c_str();
+    }
+    return nullptr;
+}
+
+// Sends a gzipped page from flash, or an empty 304 response if the browser already has it cached
+static void send_asset(AsyncWebServerRequest *request, const WebAsset *asset)
+{
+    AsyncWebServerResponse *response;
+    const char *etag = request_header(request, "If-None-Match");
+    if (etag && !strcmp(etag, asset->etag))
+        response = request->beginResponse(304);
+    else
+    {
+        response = request->beginResponse_P(200, asset->type, asset->data, asset->size);
+        response->addHeader("Content-Encoding", "gzip");
+    }
+    // Cached for good, but revalidated on each load, so that a firmware update brings its own version of the UI
+    response->addHeader("Cache-Control", "no-cache");
+    response->addHeader("ETag", asset->etag);
+    request->send(response);
+}
+
+void handleStatus(AsyncWebServerRequest *request)
 {
     get_webserver_response_html();
     request->send(200, "text/html", webtext_root);
@@ -131,171 +272,92 @@ void handleRoot(AsyncWebServerRequest *request)
 
 void handleJson(AsyncWebServerRequest *request)
 {
-    get_webserver_response_json();
+    uint32_t mark = heap_mark();
+    get_webserver_response_json(webtext_json, sizeof(webtext_json));
+    heap_account(heap_json, mark); // Not the response, it is freed once it has been sent
     request->send(200, "application/json", webtext_json);
 }
 
-template<class T> T parse(String value, char **p_next);
-template<> inline uint8_t parse<uint8_t>(String value, char **p_next) { return strtoul(value.c_str(), p_next, 0); }
-template<> inline uint32_t parse<uint32_t>(String value, char **p_next) { return strtoul(value.c_str(), p_next, 0); }
-template<> inline float parse<float>(String value, char **p_next) { return strtof(value.c_str(), p_next); }
-template<> inline String parse<String>(String value, char **p_next)
+void handleProf(AsyncWebServerRequest *request)
 {
-    value.trim();
-    value.replace("\"", "'"); // Disallow the quotation character to ensure valid JSON output when printed
-    return value;
+    // A cut short profile is no valid json, nothing is sent then
+    if (!get_profile_json(webtext_prof, sizeof(webtext_prof)))
+    {
+        wdata.status |= STATUS_BUF_OVERFLOW;
+        request->send(500, "text/html", "Buffer overflow");
+        return;
+    }
+    request->send(200, "application/json", webtext_prof);
 }
 
-// Parses the GET method ?name=value argument and returns false if the key or its value are not valid
-// When the key name is matched, and the value is correct, it updates the wdata reference variable and its NV value
-template <class T>
-static bool get_parse_value(AsyncWebServerRequest *request, String key_name, T& dest, bool save_nv)
+void handleEnergy(AsyncWebServerRequest *request)
 {
-    String value = request->arg(key_name);
-    if (value.length())
-    {
-        char *p_next;
-        T n = parse<T>(value, &p_next);
-
-        // Check for validity of int and float types since we read them using strto* functions
-        bool is_string = sizeof(T) == sizeof(String); // Little trick to tell String type apart without having the RTTI support
-        if (is_string || ((p_next != value.c_str()) && (*p_next == 0) && (errno != ERANGE)))
-        {
-            dest = n; // Set the wdata.<key_name> member
-            if (save_nv)
-                pref_set(key_name.c_str(), n); // Set the new value into an NV variable
-            request->send(200, "text/html", "OK " + String(n));
-            return true;
-        }
-    }
-    return false;
+    webtext_energy[sizeof(webtext_energy) - 1] = 0xFF;
+    get_energy_json(webtext_energy);
+    if (webtext_energy[sizeof(webtext_energy) - 1] != 0xFF)
+        wdata.status |= STATUS_BUF_OVERFLOW;
+    request->send(200, "application/json", webtext_energy);
 }
 
-// Set a variable from the client side. The key/value pairs are passed using an HTTP GET method.
-void handleSet(AsyncWebServerRequest *request)
+// Starts a single connection attempt without waiting for it to complete
+static void wifi_connect()
 {
-    uint8_t u8;
-    // Updating one at a time will respond with "OK" followed by the new value
-    bool ok = false;
-    ok |= get_parse_value(request, "id", wdata.id, true);
-    ok |= get_parse_value(request, "tag", wdata.tag, true);
-    ok |= get_parse_value(request, "ext_server", wdata.ext_server, true);
-    ok |= get_parse_value(request, "ext_read_sec", wdata.ext_read_sec, true);
-    ok |= get_parse_value(request, "hyst_trigger", wdata.hyst_trigger, true);
-    ok |= get_parse_value(request, "hyst_release", wdata.hyst_release, true);
-    ok |= get_parse_value(request, "filter_sec", wdata.filter_sec, true);
-    ok |= get_parse_value(request, "cool_sec", wdata.cool_sec, true);
-    ok |= get_parse_value(request, "heat_sec", wdata.heat_sec, true);
-    // The following set of variables do not store their new value in NV
-    ok |= get_parse_value(request, "fan_mode", u8, false);
-    ok |= get_parse_value(request, "fan_sec", wdata.fan_sec, false);
-    ok |= get_parse_value(request, "ac_mode", u8, false);
-    ok |= get_parse_value(request, "cool_to", u8, false);
-    ok |= get_parse_value(request, "heat_to", u8, false);
-    ok |= get_parse_value(request, "status", wdata.status, false);
-    ok |= get_parse_value(request, "timestamp", wdata.timestamp, false);
-    if (!ok)
-        request->send(400, "text/html", "Invalid request");
-    else
-    {
-        if (request->arg("fan_mode").length())
-            control.set_fan_mode(u8);
-        else if (request->arg("ac_mode").length())
-            control.set_ac_mode(u8);
-        else if (request->arg("cool_to").length())
-            control.set_cool_to(u8);
-        else if (request->arg("heat_to").length())
-            control.set_heat_to(u8);
+    wifi_attempting = true;
+    wifi_attempt_at = millis();
 
-        xI2CMessage xMessage;
-        xMessage.xMessageType = I2C_PRINT_STATUS;
-        xQueueSend(xI2CQueue, &xMessage, portMAX_DELAY);
-    }
+    // A fast reconnect to the known access point skips the full channel scan
+    if (wifi_use_cache && wdata.wifi_channel)
+        WiFi.begin(ssid, password, wdata.wifi_channel, wdata.wifi_bssid);
+    else
+        WiFi.begin(ssid, password);
 }
 
-const char* uploadHtml = " \
-<script src='https://ajax.googleapis.com/ajax/libs/jquery/3.2.1/jquery.min.js'></script> \
-<form method='POST' action='#' enctype='multipart/form-data' id='upload_form'> \
- <input type='file' name='update'> \
-  <input type='submit' value='Update'> \
- </form> \
-<div id='prg'>Progress: 0%</div> \
-<script> \
- $('form').submit(function(e) \
- { \
-  e.preventDefault(); \
-  var form = $('#upload_form')[0]; \
-  var data = new FormData(form); \
-  $.ajax({ \
-   url: '/flash', \
-   type: 'POST', \
-   data: data, \
-   contentType: false, \
-   processData:false, \
-   xhr: function() \
-   { \
-    var xhr = new window.XMLHttpRequest(); \
-    xhr.upload.addEventListener('progress', function(evt) \
-    { \
-     if (evt.lengthComputable) \
-     { \
-      var per = evt.loaded / evt.total; \
-      $('#prg').html('progress: ' + Math.round(per*100) + '%'); \
-     } \
-    }, false); \
-    return xhr; \
-   }, \
-   success:function(d, s) \
-   { \
-       console.log('success!') \
-   }, \
-   error: function (a, b, c) { } \
-  }); \
- }); \
-</script> \
-";
+// Schedules the next connection attempt with an exponential backoff
+static void wifi_schedule_retry()
+{
+    wifi_attempting = false;
+    wifi_retry_at = millis() + wifi_backoff_ms;
+    wifi_backoff_ms = wifi_backoff_ms * 2;
+    if (wifi_backoff_ms > WIFI_BACKOFF_MAX_MS)
+        wifi_backoff_ms = WIFI_BACKOFF_MAX_MS;
+    wifi_use_cache = false; // The cached access point did not work, scan on the next try
+}
 
-void setup_ota()
+// Called from the WiFi system event task
+static void wifi_event(WiFiEvent_t event, WiFiEventInfo_t info)
 {
-    server.on("/upload", HTTP_GET, [](AsyncWebServerRequest *request)
-    {
-        AsyncWebServerResponse *response = request->beginResponse(200, "text/html", uploadHtml);
-        response->addHeader("Connection", "close");
-        request->send(response);
-    });
-    server.on("/flash", HTTP_POST, [](AsyncWebServerRequest *request)
+    if (event == SYSTEM_EVENT_STA_CONNECTED)
     {
-        AsyncWebServerResponse *response = request->beginResponse(200, "text/plain", (Update.hasError()) ? "FAIL" : "OK");
-        response->addHeader("Connection", "close");
-        request->send(response);
-    }, [](AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final)
-    {
-        // Stop the web client during the OTA
-        wdata.ext_read_sec = 0;
-
-        // Serial.printf("Uploading: index=%d len=%d final=%d\n", index, len, final);
-        if (index == 0)
+        // Remember the access point we associated with for the next fast reconnect
+        if ((wdata.wifi_channel != info.connected.channel) || memcmp(wdata.wifi_bssid, info.connected.bssid, sizeof(wdata.wifi_bssid)))
         {
-            Serial.printf("Uploading: %s\n", filename.c_str());
-            if (!Update.begin(UPDATE_SIZE_UNKNOWN)) // start with max available size
-                Update.printError(Serial);
+            memcpy(wdata.wifi_bssid, info.connected.bssid, sizeof(wdata.wifi_bssid));
+            wdata.wifi_channel = info.connected.channel;
+            wifi_cache_dirty = true;
         }
-        if (!Update.hasError())
-        {
-            if (Update.write(data, len) != len) // flashing firmware to ESP
-                Update.printError(Serial);
-        }
-        if (final)
+    }
+    else if (event == SYSTEM_EVENT_STA_GOT_IP)
+    {
+        wdata.wifi_connect_ms = millis() - wifi_lost_at;
+        wifi_connected = true;
+        wifi_attempting = false;
+        wifi_use_cache = true;
+        wifi_backoff_ms = WIFI_BACKOFF_MIN_MS;
+        reconnects++;
+    }
+    else if (event == SYSTEM_EVENT_STA_DISCONNECTED)
+    {
+        if (wifi_connected)
         {
-            if (Update.end(true)) // true to set the size to the current progress
-            {
-                Serial.println("Flash OK, rebooting...\n");
-                ESP.restart();
-            }
-            else
-                Update.printError(Serial);
+            // Lost an established connection: start timing the reconnect and retry right away
+            wifi_connected = false;
+            wifi_lost_at = millis();
+            wifi_attempting = false;
+            wifi_retry_at = millis();
         }
-    });
+        else if (wifi_attempting)
+            wifi_schedule_retry();
+    }
 }
 
 void setup_wifi()
@@ -314,8 +376,9 @@ void setup_wifi()
     wdata.gpio23 = gpio_get_level(gpio_num_t(GPIO_NUM_23));
 
     WiFi.disconnect(true);
+    WiFi.onEvent(wifi_event);
+    WiFi.setAutoReconnect(false); // We do our own reconnects with a backoff
     WiFi.mode(WIFI_STA);
-    WiFi.begin(ssid, password);
     IPAddress ip(192,168,1,40);
     IPAddress gateway(192,168,1,1);
     IPAddress subnet(255,255,255,0);
@@ -323,36 +386,99 @@ void setup_wifi()
         ip[3] = 41; // Assign 192.168.1.41 to the "development" board via strap
     WiFi.config(ip, gateway, subnet);
 
-    // Wait for connection
-    while (WiFi.status() != WL_CONNECTED)
-    {
-        Serial.print(".");
-        delay(500);
-    }
-    Serial.printf("\nConnected to %s\nIP address: ", ssid);
-    Serial.println(WiFi.localIP());
-    reconnects++;
-
-    if (MDNS.begin("esp32"));
-        Serial.println("MDNS responder started");
+    wifi_lost_at = millis();
+    wifi_connect();
 }
 
 void setup_webserver()
 {
-    server.on("/", handleRoot);
+    for (const WebAsset &asset : webui_assets)
+    {
+        const WebAsset *p = &asset;
+        server.on(asset.path, HTTP_GET, [p](AsyncWebServerRequest *request) { send_asset(request, p); });
+    }
+    server.addHandler(&events);
+    server.on("/status", handleStatus);
     server.on("/json", handleJson);
     server.on("/set", handleSet);
+    server.on("/prof", handleProf);
+    server.on("/energy", handleEnergy);
+    server.on("/trace", handleTrace);
+    server.on("/log", handleLog);
     setup_ota();
     server.begin();
 }
 
+// Prints the fields the web UI shows; the page gets the rest from /json when it loads
+// Returns false if the state did not fit, which is flagged as a buffer overflow
+static bool get_ui_state_json(char *buf, size_t size)
+{
+    char temp[48] = "";
+    if (wdata.get_temp_valid())
+        snprintf(temp, sizeof(temp), ",\"temp_c\":%.1f,\"temp_f\":%.1f", temp_to_c(wdata.get_temp()), temp_to_f(wdata.get_temp()));
+    int n = snprintf(buf, size, "{\"id\":\"%s\",\"tag\":\"%s\",\"status\":%d,\"temp_valid\":%d%s"
+        ",\"units\":\"%s\",\"cool_to\":%.1f,\"heat_to\":%.1f,\"ac_mode\":%d,\"fan_mode\":%d"
+        ",\"fan_on\":%d,\"cool_on\":%d,\"heat_on\":%d,\"stage\":%d,\"filter_pct\":%d}",
+        wdata.id, wdata.tag, wdata.status, wdata.get_temp_valid(), temp,
+        units_str(), temp_to_units(wdata.cool_to), temp_to_units(wdata.heat_to), wdata.ac_mode, wdata.fan_mode,
+        !!(~wdata.relays & PIN_FAN), !!(~wdata.relays & PIN_COOL), !!(~wdata.relays & PIN_HEAT), wdata.stage, control.filter_pct());
+    if ((n < 0) || (size_t(n) >= size))
+    {
+        wdata.status |= STATUS_BUF_OVERFLOW;
+        return false;
+    }
+    return true;
+}
+
+// Pushes the UI state to the open pages when it changed, once a tick at most; called from the network task
+void events_loop()
+{
+    if (!events.count() || (wdata.seconds == events_second))
+        return;
+    events_second = wdata.seconds;
+    if (!get_ui_state_json(webtext_event[0], sizeof(webtext_event[0])))
+        return;
+    if (strcmp(webtext_event[0], webtext_event[1]) || (wdata.seconds - events_at >= UI_PUSH_SEC))
+    {
+        events_at = wdata.seconds;
+        strcpy(webtext_event[1], webtext_event[0]);
+        events.send(webtext_event[0], "state");
+    }
+}
+
+// Called from the network task, never blocks for longer than a fraction of a second
 void wifi_check_loop()
 {
-    delay(1000);
+    delay(100);
 
-    if (WiFi.status() != WL_CONNECTED)
+    if (wifi_connected)
+    {
+        if (!mdns_started)
+        {
+            IPAddress ip = WiFi.localIP();
+            log_write(LOG_INFO, LOG_WIFI, "Connected, IP address %d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
+            setup_mdns();
+            mdns_started = true;
+        }
+        if (wifi_cache_dirty)
+        {
+            wifi_cache_dirty = false;
+            pref_set("wifi_bssid", wdata.wifi_bssid, sizeof(wdata.wifi_bssid));
+            pref_set("wifi_channel", wdata.wifi_channel);
+        }
+    }
+    else if (wifi_attempting)
+    {
+        // The attempt may also end without any event, so time it out here
+        if ((millis() - wifi_attempt_at) > WIFI_ATTEMPT_MS)
+        {
+            wifi_schedule_retry();
+            WiFi.disconnect();
+        }
+    }
+    else if (int32_t(millis() - wifi_retry_at) >= 0)
     {
-        Serial.println("Server disconnected! Reconnecting...");
-        setup_wifi();
+        log_write(LOG_INFO, LOG_WIFI, "Reconnecting, %d reconnects so far", reconnects);
+        wifi_connect();
     }
 }
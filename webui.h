@@ -0,0 +1,122 @@
+// Generated by tools/embed_assets.py from the files in ui/, do not edit
+#pragma once
+
+static const uint8_t webui_index_html[] PROGMEM = {
+    0x1f,0x8b,0x08,0x00,0x00,0x00,0x00,0x00,0x02,0x03,0x9d,0x58,0xe1,0x72,0xd3,0x46,0x10,0xfe,0xef,0xa7,0x38,0x04,0x1d,0xc9,
+    0x25,0x96,0xed,0x00,0x99,0x4c,0x2c,0x9b,0x29,0x69,0x28,0xb4,0x40,0x3a,0x21,0x9d,0x69,0x87,0x61,0x32,0x17,0x69,0x65,0x1d,
+    0xc8,0x77,0xea,0xe9,0x64,0xc7,0x40,0xde,0xa9,0xcf,0xd0,0x27,0xeb,0xee,0x9d,0xa4,0xc8,0x4e,0x48,0x03,0x7f,0x62,0xe9,0x76,
+    0xf7,0xbb,0xfd,0x76,0xf7,0x76,0x4f,0x89,0xee,0xfd,0x7c,0x7c,0x78,0xfa,0xd7,0xef,0x47,0x2c,0x33,0x8b,0x7c,0xd6,0x8b,0x9a,
+    0x1f,0xe0,0x09,0xfe,0x2c,0xc0,0x70,0x16,0x67,0x5c,0x97,0x60,0xa6,0x5e,0x65,0xd2,0xc1,0xbe,0xd7,0x2c,0x4b,0xbe,0x80,0xa9,
+    0xb7,0x14,0xb0,0x2a,0x94,0x36,0x1e,0x8b,0x95,0x34,0x20,0x51,0x6d,0x25,0x12,0x93,0x4d,0x13,0x58,0x8a,0x18,0x06,0xf6,0x65,
+    0x87,0x09,0x29,0x8c,0xe0,0xf9,0xa0,0x8c,0x79,0x0e,0xd3,0x31,0x81,0x18,0x61,0x72,0x98,0x9d,0x66,0xa0,0x17,0xaa,0x34,0xdc,
+    0x44,0x43,0xb7,0xd2,0x8b,0x4a,0xb3,0xa6,0xdf,0x73,0x95,0xac,0xd9,0x67,0x96,0x22,0xee,0x20,0xe5,0x0b,0x91,0xaf,0x0f,0x58,
+    0xc9,0x65,0x39,0x28,0x41,0x8b,0x74,0xc2,0x16,0x5c,0xcf,0x85,0x3c,0x60,0x23,0xc6,0x2b,0xa3,0xe8,0xfd,0xc2,0x6d,0x77,0xc0,
+    0x76,0xf7,0x61,0x31,0x61,0x05,0x4f,0x12,0x21,0xe7,0x07,0x6c,0x4c,0x6f,0x97,0xbd,0x6c,0xdc,0xc0,0x95,0xe2,0x13,0xe0,0x72,
+    0xb8,0x4b,0x82,0x16,0x87,0x74,0xee,0x1b,0x58,0x14,0x9b,0x6a,0x8f,0x49,0xc9,0xc0,0x85,0x19,0xf0,0x5c,0xcc,0x51,0x31,0x46,
+    0x9a,0xa0,0xaf,0x0c,0x09,0xc6,0x59,0x87,0x5a,0xad,0xd0,0x38,0x11,0x65,0x91,0x73,0x74,0x37,0xcd,0xe1,0x62,0xc2,0x3e,0x54,
+    0xa5,0x11,0xe9,0x7a,0x50,0x47,0x08,0x59,0x14,0x1c,0x43,0x73,0x0e,0x66,0x05,0x20,0x27,0xcc,0xc2,0x0e,0x04,0xee,0x5c,0xde,
+    0x00,0xbe,0xd7,0x82,0x63,0x12,0xb6,0x09,0xec,0x59,0x02,0x42,0x36,0xc4,0x1f,0x7d,0xcd,0xd7,0xd6,0x25,0x21,0x73,0x21,0x71,
+    0xf3,0x5c,0xc5,0x1f,0x09,0xf5,0xbc,0x32,0x46,0xc9,0x6d,0xdc,0xf1,0x16,0xee,0x6e,0xf8,0x78,0x23,0xa2,0xe1,0x23,0x17,0xd2,
+    0x12,0x72,0x88,0x0d,0xe5,0xb7,0xa8,0xb6,0x9d,0x73,0x1a,0xa1,0x05,0x8f,0x55,0xae,0xf4,0x01,0xbb,0x1f,0x8f,0x90,0x8a,0x55,
+    0x5a,0x81,0x98,0x67,0x18,0x8b,0x73,0x95,0x27,0x56,0x2f,0x11,0x8b,0x8e,0xe2,0xfe,0xfe,0xfe,0xa4,0x8b,0x16,0xee,0x3f,0x71,
+    0x78,0xf7,0x41,0xeb,0x6d,0xc0,0xcb,0x5e,0x34,0xac,0x8b,0x26,0x1a,0xd6,0xa5,0x4b,0xd5,0x43,0x85,0x3c,0x66,0x22,0x99,0x7a,
+    0xb6,0xb4,0xbc,0x8d,0x6a,0xcb,0xc6,0x28,0x4e,0xc4,0xd2,0xc9,0x31,0xeb,0xde,0x6c,0x30,0x88,0x86,0xb8,0x52,0xaf,0xc7,0x39,
+    0x2f,0xcb,0xa9,0x87,0x29,0xf5,0x66,0x11,0xa6,0x4c,0xce,0x5e,0xab,0x04,0x70,0x27,0x7a,0xec,0xb1,0xc8,0x71,0xb7,0xe6,0x3c,
+    0x3e,0x5b,0xa0,0xcc,0x63,0x4a,0xe2,0x69,0x91,0x73,0x3c,0x18,0x98,0xac,0xc0,0xaf,0xd7,0xfd,0x1d,0x66,0x32,0x51,0x86,0x4b,
+    0x9e,0x57,0xd0,0xc7,0xe2,0x67,0x2c,0x52,0x85,0x11,0x18,0x1a,0xbb,0x34,0xf5,0x46,0xde,0xec,0x38,0x4d,0xa3,0xa1,0x5b,0x9d,
+    0x6d,0x49,0xf1,0xbc,0x1c,0x2a,0x95,0x7f,0x4d,0xbc,0xeb,0xcd,0x5e,0x00,0x51,0xaa,0xc5,0xe8,0xdb,0xd0,0x39,0x37,0xbb,0x9d,
+    0xcf,0x73,0x2e,0x6f,0xa4,0x93,0x72,0x79,0x33,0x9f,0x46,0x70,0x27,0x42,0x3f,0xe1,0xa9,0xbc,0x85,0xd1,0xb1,0xbc,0x85,0xcf,
+    0xe1,0x3a,0xce,0xe1,0x6b,0xf2,0x47,0x98,0x48,0xb1,0x80,0xe4,0xdb,0x09,0x53,0x14,0x19,0x79,0x65,0xdf,0xdc,0x5a,0x54,0x9f,
+    0x00,0xa4,0x9a,0x8b,0xf8,0x23,0x32,0x35,0x50,0x04,0x7e,0x8c,0xaa,0x67,0x46,0x21,0xd3,0xc1,0x18,0x19,0x62,0x65,0x38,0x3d,
+    0x1b,0x2a,0xb4,0x6b,0xd0,0x31,0x2e,0x9e,0x0d,0x5a,0x6d,0xe0,0xaa,0xe8,0x6e,0xc8,0x04,0xfc,0xb0,0x05,0x6e,0xac,0x6e,0x65,
+    0x40,0x89,0xbe,0x23,0x03,0x3c,0x08,0xe6,0x9b,0x18,0xd4,0x06,0xff,0xcf,0xe0,0x0a,0xf9,0x3b,0x18,0x9c,0x54,0x52,0x62,0x0f,
+    0xe9,0x32,0xb0,0xbb,0x6b,0xb7,0xde,0xdd,0xfd,0xf6,0xe2,0x15,0x39,0x76,0xb6,0xcd,0x40,0xb4,0x60,0xa9,0x15,0x76,0xb0,0xd8,
+    0x75,0x2a,0xb6,0xa0,0xad,0xde,0x99,0x06,0x7c,0xab,0xe9,0x9c,0xd0,0xf3,0xb7,0x51,0xfa,0x0d,0xd6,0x8d,0x9e,0x6b,0x84,0x66,
+    0x5d,0x60,0x9d,0x16,0xa8,0xb7,0x52,0x3a,0x71,0xd1,0xfd,0x08,0x6b,0x8f,0x51,0x33,0xc3,0xea,0xdf,0xeb,0x9e,0x2c,0xec,0xc4,
+    0x3c,0x7f,0x6b,0x94,0xe6,0x73,0xa0,0x1e,0xff,0x12,0x9b,0x11,0xb6,0x8e,0x42,0x9c,0xa1,0xc9,0xf6,0x49,0xeb,0x3a,0x42,0xa8,
+    0xd8,0x0d,0xaf,0x16,0x8b,0xc6,0x37,0xec,0xa5,0x5e,0x27,0x1a,0x42,0xa6,0xca,0x9b,0xb5,0x91,0x68,0xd7,0xa9,0x11,0x56,0x65,
+    0x2b,0x89,0xce,0xf5,0x2c,0xe2,0x2c,0xd3,0x90,0x4e,0xbd,0x61,0x23,0x74,0xbf,0xd1,0x90,0xa3,0x65,0x2b,0x04,0x09,0x7a,0xbe,
+    0xf6,0x66,0xee,0x77,0x4b,0x58,0x68,0x95,0x7a,0x33,0xfa,0x2b,0xe8,0x10,0x6f,0xc8,0xaa,0x22,0x57,0x3c,0xf1,0x66,0x55,0x91,
+    0x70,0x63,0x85,0xd1,0xb0,0xa0,0x99,0x1f,0x6b,0x51,0x98,0x59,0x6f,0x38,0x64,0xd8,0xa4,0x71,0xd0,0xcc,0x81,0x89,0x92,0x91,
+    0x32,0x24,0x14,0x2c,0x60,0x5c,0x26,0x2c,0xe6,0x71,0x06,0x38,0x2f,0x84,0x61,0x73,0x30,0x25,0xc6,0x06,0x58,0x2e,0x96,0xc0,
+    0xc8,0x4b,0x34,0xab,0xca,0xcc,0xaa,0xb3,0x21,0x2c,0x71,0xf2,0x95,0x3b,0x4c,0x69,0x56,0xa8,0x3c,0x2f,0xd9,0xf0,0x43,0x89,
+    0xeb,0xab,0x0c,0x24,0x5a,0xe1,0x21,0x4a,0xb9,0xc8,0xcb,0xde,0x92,0xeb,0xda,0x76,0xca,0x3e,0x5f,0xee,0x58,0x5d,0x7c,0x94,
+    0x55,0x9e,0x4f,0x7a,0x69,0x25,0x63,0xdb,0x78,0x1e,0x04,0x22,0xe9,0xe3,0xd4,0xd1,0x60,0x2a,0x2d,0x59,0xa2,0xe2,0x6a,0x81,
+    0xf0,0x21,0xfa,0x70,0x94,0x03,0x3d,0x3e,0x5b,0xbf,0x4c,0x48,0x89,0x86,0x51,0x6b,0x56,0x66,0x6a,0x15,0x94,0xfd,0xde,0xe7,
+    0x5e,0xbb,0x47,0x39,0xe9,0x31,0xda,0xb3,0xa2,0xe7,0xb0,0xc2,0x6b,0x11,0xfa,0x68,0xf0,0x05,0x17,0xa6,0xcc,0x3f,0xf4,0xd9,
+    0x53,0x5c,0xa7,0x71,0x74,0x16,0xb3,0x83,0xe6,0x31,0x45,0xab,0x07,0x81,0x6f,0xa7,0x98,0xdf,0x0f,0x69,0xc0,0x1f,0xba,0xcb,
+    0x84,0x85,0x31,0x7c,0xce,0xbe,0x7c,0xc1,0x07,0x91,0xd4,0x8a,0x68,0x74,0x93,0x1e,0x61,0x61,0x25,0x89,0x04,0x77,0x31,0xa1,
+    0x51,0xcf,0xc5,0x05,0x24,0xc1,0xb8,0xcf,0x1e,0x32,0xff,0xdf,0x7f,0x7c,0xfc,0xa9,0x70,0x53,0x7f,0x30,0xf0,0x1d,0x4e,0xd3,
+    0xaa,0xae,0x43,0xd5,0x12,0xa7,0xd6,0xf4,0x83,0xeb,0x6a,0xb5,0x04,0xd5,0x44,0xca,0x82,0x36,0x6e,0x1c,0xe3,0xb3,0x84,0x3a,
+    0x74,0xec,0xde,0x94,0x40,0x9a,0x59,0xd9,0xef,0x6f,0xbc,0xb9,0xca,0xb7,0x60,0xf5,0xda,0x5d,0xc0,0xda,0x41,0xe5,0xd0,0xae,
+    0x5e,0x3b,0x70,0xcd,0x62,0x9d,0x11,0x8d,0x8b,0xef,0xde,0xd7,0xe0,0x4e,0xaa,0x64,0x9f,0xe9,0x90,0x8a,0xca,0x42,0xf8,0xfd,
+    0x56,0x6a,0xe9,0x77,0xc5,0xb4,0xd0,0x91,0x5b,0xde,0x5d,0x39,0x2d,0x74,0xe4,0x58,0x0e,0x58,0xe0,0x33,0x6c,0x38,0xad,0x86,
+    0x5b,0xa2,0x1c,0xd4,0xe2,0xbe,0x0b,0x6e,0xdd,0x17,0xaf,0x05,0x57,0x87,0x39,0xc8,0xb9,0xc9,0x30,0x95,0x3a,0xfc,0xa0,0x84,
+    0x0c,0xb0,0x57,0xf8,0x7d,0xca,0x9f,0x48,0xb0,0x4c,0xb6,0xad,0x6d,0x6b,0x78,0x83,0x97,0xf6,0x4d,0x5b,0x5f,0x49,0x9f,0x6c,
+    0x6a,0x7d,0xd7,0x10,0x6f,0xc8,0x64,0xdd,0x29,0x0b,0xbc,0x22,0x60,0xb1,0xfc,0xe0,0xb7,0x54,0x2a,0x9c,0xc1,0x0b,0xb0,0x61,
+    0xa6,0x3e,0x73,0xcd,0xd4,0xaf,0x0a,0xcb,0xea,0x35,0x37,0x59,0x98,0xe6,0x4a,0xe9,0xd6,0x88,0x0d,0xd9,0xa3,0xbd,0xd1,0xc8,
+    0x96,0x1f,0xcb,0x6a,0x0f,0x5c,0xbf,0xb9,0xc1,0x03,0x27,0x20,0x97,0xeb,0xa7,0x36,0x56,0xf4,0xe2,0x28,0x74,0x0f,0x1f,0xf6,
+    0x77,0xfa,0x46,0xd9,0x71,0xd7,0x06,0x7b,0x0a,0x29,0xcf,0x17,0x19,0x65,0x5a,0xc2,0x8a,0xfd,0xf9,0xfa,0xd5,0x0b,0x63,0x8a,
+    0x13,0xf8,0xbb,0x82,0xd2,0x04,0x14,0x6f,0x14,0x86,0xaa,0x00,0x8c,0xe5,0x2f,0x47,0xa7,0x14,0x4f,0xbc,0x57,0x98,0xa7,0xb4,
+    0x11,0x41,0x91,0x9f,0x53,0x7a,0x01,0x19,0x63,0xe1,0xfc,0x71,0xf2,0xf2,0x50,0x2d,0x0a,0x25,0xd1,0xc3,0xc0,0x6d,0xd2,0x60,
+    0xa0,0x55,0x0d,0x8b,0x03,0x3b,0x01,0x1d,0xf8,0x78,0x1b,0xca,0x94,0x16,0x9f,0x38,0x39,0x47,0xc8,0xcf,0x80,0x6b,0xd0,0x96,
+    0x04,0xb2,0xa6,0x56,0x5f,0x17,0x67,0xeb,0x87,0xa4,0xee,0x87,0xbe,0x36,0x94,0x02,0x6a,0x41,0xa8,0x8b,0x3d,0xff,0x5a,0x78,
+    0xec,0xa6,0x2e,0x12,0xd8,0x47,0x76,0x47,0x23,0x8a,0x13,0x25,0x96,0x04,0x38,0xde,0xd0,0xcb,0x12,0x4e,0xd1,0x04,0x1b,0x54,
+    0xeb,0xa3,0x4c,0x88,0x74,0x37,0x66,0x34,0xde,0x5d,0xd0,0x12,0xa1,0xdb,0x90,0x2d,0x29,0xfe,0xd4,0xc0,0xde,0x91,0xec,0x3d,
+    0x7a,0x8c,0x52,0xf6,0x23,0x66,0x9f,0x16,0x5d,0x17,0xbb,0x6a,0x5f,0xa3,0xf0,0x09,0xee,0x3b,0x76,0xe5,0x4b,0x06,0xdb,0xbe,
+    0x2e,0x51,0xd2,0xc9,0xce,0xa6,0x0b,0x29,0x98,0x38,0x3b,0xa3,0x5e,0x1d,0x7c,0x6f,0xca,0xc8,0xd8,0xbf,0x3d,0x8a,0x46,0xd3,
+    0xa7,0xa5,0xed,0xcf,0xbf,0xbe,0x3d,0x7e,0x13,0x16,0xf4,0x89,0x1b,0x6c,0xc7,0xaa,0x4f,0xed,0x1c,0x67,0x0e,0x7a,0xc4,0x02,
+    0x2c,0xf1,0xcf,0x97,0x37,0x04,0x6f,0x33,0x79,0xb8,0xd1,0xc6,0x3c,0x9f,0x6f,0xcf,0xf3,0x3e,0x75,0x6a,0x2a,0xd5,0x2e,0xd1,
+    0x49,0x8f,0xce,0xd2,0x4a,0xc8,0x44,0xad,0xc2,0x23,0x9a,0x5c,0x6f,0x55,0xa5,0xe3,0xab,0xa2,0x85,0xb2,0x0e,0x40,0x47,0x18,
+    0xf8,0xf5,0x90,0xb3,0x5c,0x01,0xfb,0x63,0x92,0x58,0xf1,0x2b,0x81,0x79,0x94,0x54,0x74,0x36,0x3f,0x18,0x93,0x96,0x3b,0x91,
+    0xb8,0x46,0x1b,0x42,0x9c,0xc5,0xdc,0x92,0xad,0x91,0xb0,0xa4,0xb5,0x56,0x7a,0x3b,0x6a,0xe4,0xe4,0x3d,0x9a,0x90,0xfd,0x66,
+    0x4e,0xd2,0x75,0x85,0x3e,0x30,0x91,0x7b,0x70,0x45,0x68,0x87,0x3d,0x19,0xe1,0xb1,0x76,0xa5,0x66,0xe1,0x28,0x41,0xdb,0x68,
+    0x78,0xc3,0xe7,0xba,0xb5,0xb6,0xb0,0x93,0x8d,0xf9,0x4b,0xe6,0x97,0x3d,0xc8,0x4b,0xe8,0xdd,0x6d,0x3f,0xfa,0x0c,0xac,0xef,
+    0x11,0x78,0x81,0x73,0x1f,0x80,0x43,0xf7,0x1f,0x8d,0xff,0x00,0x5a,0xe4,0x4b,0x16,0xe9,0x10,0x00,0x00,
+};
+
+static const uint8_t webui_upload_html[] PROGMEM = {
+    0x1f,0x8b,0x08,0x00,0x00,0x00,0x00,0x00,0x02,0x03,0x8d,0x55,0x5d,0x6f,0xdb,0x36,0x14,0x7d,0xd7,0xaf,0xb8,0x15,0xd0,0x48,
+    0x5a,0x1d,0xcb,0xeb,0x96,0x60,0x68,0x6c,0x17,0x4d,0x96,0xce,0x5b,0x92,0x26,0x68,0x9c,0x61,0xc3,0xb0,0x07,0x5a,0xba,0x8a,
+    0x88,0xc8,0xa2,0x42,0x52,0x76,0xdd,0xc2,0xff,0x7d,0xf7,0x8a,0x92,0xbf,0xb0,0x0c,0x7b,0xb1,0xe8,0xcb,0x73,0x3f,0xce,0xe1,
+    0xa1,0x34,0x7c,0xf5,0xf3,0xed,0xc5,0xf4,0xcf,0xbb,0x4b,0xc8,0xed,0xbc,0x18,0x7b,0xc3,0xee,0x81,0x22,0x1d,0x0f,0xe7,0x68,
+    0x05,0x24,0xb9,0xd0,0x06,0xed,0xc8,0xaf,0x6d,0x76,0xfc,0x93,0x3f,0x1e,0x5a,0x69,0x0b,0x1c,0x7f,0x94,0x7a,0xbe,0x14,0x1a,
+    0xa1,0xae,0x52,0x61,0x71,0x18,0xbb,0xf0,0x30,0x6e,0x52,0xbd,0xe1,0x4c,0xa5,0x2b,0x7a,0xc8,0xb2,0xaa,0x2d,0xd8,0x55,0x85,
+    0x23,0x3f,0x93,0x05,0xfa,0x20,0xd3,0x76,0x35,0x86,0xfb,0xc9,0x87,0xe3,0xb7,0x27,0xa7,0xb0,0x87,0xb2,0xf8,0xc5,0x3a,0x54,
+    0x2e,0x4c,0xee,0x83,0x91,0x5f,0x29,0x7a,0xfa,0xa3,0x3f,0xf6,0xae,0x70,0xb5,0x8f,0xad,0x84,0x31,0x4b,0xa5,0x53,0x87,0x7f,
+    0xc2,0x95,0xcf,0x9d,0x6b,0x6b,0x55,0x09,0xaa,0x4c,0x0a,0x99,0x3c,0x8d,0x7c,0x63,0x85,0xb6,0x61,0xe4,0x8f,0x1f,0xda,0x49,
+    0x1d,0x80,0x90,0xa9,0x5c,0x34,0x89,0x95,0x7e,0xf4,0xc7,0x77,0x5a,0x3d,0x6a,0x34,0xe6,0x1d,0x0c,0x5e,0x0f,0x63,0xda,0x22,
+    0x80,0x49,0xb4,0xac,0xec,0xd8,0x8b,0x63,0xb8,0xc7,0x32,0x35,0x60,0x73,0x04,0x1e,0x1e,0x64,0x09,0x86,0xca,0xa3,0x01,0x51,
+    0xa6,0x40,0x79,0xf5,0x9c,0xd7,0x99,0x45,0x0d,0x02,0x32,0x21,0x8b,0x5a,0xa3,0xb7,0x10,0x1a,0x2e,0x26,0x0f,0x9f,0xae,0x60,
+    0x04,0xa7,0x27,0x27,0x3f,0x9c,0xf6,0x08,0x6a,0xb5,0x44,0x73,0xe6,0x65,0x75,0x99,0x58,0x49,0x83,0x9a,0x5c,0x2d,0x43,0x1b,
+    0xc1,0x37,0x48,0x55,0x42,0x65,0x4a,0xdb,0x7f,0x44,0x7b,0x59,0x20,0x2f,0xcf,0x57,0xbf,0xa6,0x61,0x40,0x03,0x06,0x51,0x5f,
+    0x96,0x25,0xea,0xc9,0xf4,0xe6,0x9a,0xaa,0xd9,0x33,0x58,0x6f,0x4b,0x68,0x7c,0x0e,0xe9,0xb0,0x72,0x95,0xf6,0xa0,0xd6,0x45,
+    0x0f,0x88,0xa8,0xe8,0x41,0x32,0x8b,0xbc,0x6f,0x1e,0xf0,0x14,0x5f,0x72,0x4d,0x59,0x25,0x2e,0xe1,0x8f,0x9b,0xeb,0x89,0xb5,
+    0xd5,0x67,0x7c,0xae,0xd1,0x90,0x2e,0x67,0x1e,0x6f,0xf6,0x55,0x85,0xe5,0x6e,0x8d,0x2e,0x4e,0x47,0xdf,0x42,0x27,0x74,0xb0,
+    0xa8,0xc3,0xe0,0x43,0x4d,0x20,0x2d,0xbf,0x0a,0x6e,0x1d,0xf4,0x20,0x38,0x47,0xf2,0x81,0x86,0x00,0xde,0xbc,0xcc,0x80,0xce,
+    0x86,0x18,0x2c,0x44,0x51,0xe3,0xa6,0x63,0x59,0x28,0x91,0xd2,0x54,0x1d,0x8d,0x90,0x35,0xb0,0x7a,0x45,0xbf,0xc9,0x2c,0xfc,
+    0xed,0xfe,0xf6,0x53,0xbf,0x62,0xef,0x85,0x8c,0x26,0x89,0x2b,0x55,0x1a,0x9c,0x92,0x3d,0xa2,0x88,0xd8,0x43,0x22,0x6c,0x92,
+    0x43,0x88,0x91,0xc3,0x97,0x75,0x51,0x34,0xf1,0xf5,0xa6,0x3e,0x6a,0xad,0xf4,0x61,0x83,0x1d,0xe8,0x86,0x62,0x99,0x86,0xac,
+    0x18,0x4d,0xb6,0x23,0x6a,0xeb,0x9b,0x4e,0xc1,0x8c,0x0a,0xbd,0x48,0x8f,0x3d,0x41,0xfc,0xf8,0x61,0xfe,0x1a,0xfc,0x7d,0xe6,
+    0x52,0xf2,0xff,0x4a,0x61,0x77,0x77,0x92,0xf4,0xc9,0x13,0xf3,0x30,0xea,0x5b,0x75,0xad,0x96,0xa8,0x2f,0x04,0x91,0x66,0x99,
+    0x5a,0xb3,0x50,0x99,0x93,0xe6,0xdf,0x73,0x18,0xfc,0x72,0x39,0x65,0xcd,0x63,0x65,0x05,0x3d,0x99,0x49,0x6f,0xcb,0xcf,0x44,
+    0x1e,0xd0,0xb8,0x4d,0x73,0xe7,0x49,0x4a,0x35,0x70,0x74,0x04,0xa6,0x4f,0x74,0x2c,0xfd,0x1d,0x41,0xa0,0x31,0x41,0xb9,0x90,
+    0xe5,0x63,0xd0,0xee,0xd0,0x0d,0xe3,0x8d,0xcc,0xad,0x5c,0x2c,0x17,0x7c,0x33,0x29,0x9a,0x53,0x67,0x68,0x24,0xca,0x7a,0x90,
+    0xf7,0xba,0xba,0xef,0x09,0xa4,0xb2,0x8c,0xec,0x01,0x74,0x63,0x78,0xd8,0xf5,0x81,0x7c,0xdb,0x14,0x87,0xdb,0x28,0x49,0xee,
+    0xa2,0xb1,0x1a,0x0a,0xef,0x9b,0xdb,0xcd,0xce,0x69,0x9b,0xbf,0x81,0xe0,0xc8,0xf5,0x6e,0xa2,0x79,0x13,0x70,0xf9,0x4d,0xc0,
+    0x2d,0x3b,0x31,0xee,0x6e,0xef,0x59,0x8d,0xc6,0xf2,0x54,0x80,0x2f,0x64,0xe8,0x10,0x5d,0x53,0x4a,0x69,0x2e,0x60,0xf4,0x2f,
+    0x2a,0xc9,0x0c,0x42,0xc3,0x14,0x1b,0x3f,0x50,0x80,0x83,0x4d,0xb4,0xd5,0xfd,0xf8,0x98,0x77,0x07,0xec,0x9a,0xe6,0x92,0x06,
+    0x0f,0x55,0x63,0x59,0xbe,0xde,0x98,0x06,0x64,0x21,0x02,0xd6,0xba,0xe4,0xbb,0x48,0x99,0x0e,0xf3,0x99,0x72,0x57,0x24,0x2e,
+    0x08,0x0b,0xdb,0x89,0x59,0x20,0x96,0xd1,0x4e,0xe5,0x1c,0x55,0x6d,0xc3,0x3d,0x4f,0xfe,0x9f,0x93,0xe5,0x21,0xb6,0x92,0x9a,
+    0xfd,0x03,0xe8,0x9a,0xf0,0x21,0xc0,0xba,0x07,0x6f,0x07,0x83,0x81,0x6b,0xd9,0x4e,0x48,0xcb,0x75,0x47,0x79,0xc7,0x0a,0x0b,
+    0xd4,0x32,0x93,0xcc,0x65,0xc3,0xf1,0xf7,0x36,0xd4,0xcd,0x6f,0xfa,0x4f,0xb3,0xca,0xf0,0x39,0xc0,0xd5,0x79,0x6c,0xd8,0x00,
+    0x33,0xa5,0x2c,0xdb,0xe7,0x40,0x80,0xdd,0xe2,0xaf,0xf6,0x7c,0xb6,0xad,0xfe,0xb1,0x91,0xee,0x5d,0x5b,0xb9,0xb9,0xa0,0x07,
+    0x55,0x1c,0x6e,0xfb,0x36,0x66,0xe4,0x8d,0xb0,0x79,0x5f,0xab,0x9a,0xe8,0x6f,0x48,0x7f,0x07,0xdf,0x0f,0x06,0x10,0xb7,0xc6,
+    0x89,0x78,0xc0,0xd7,0x2f,0xcc,0x1c,0x44,0x07,0x1e,0xee,0x8a,0x6c,0x6d,0x3b,0x8c,0xbb,0x77,0x3d,0x7d,0x1f,0xdc,0xa7,0x2b,
+    0x76,0xdf,0xc2,0x7f,0x00,0x9b,0xa1,0x34,0x57,0x23,0x07,0x00,0x00,
+};
+
+static const WebAsset webui_assets[] = {
+    { "/", "text/html", "\"dc0bd66b87c86659\"", webui_index_html, sizeof(webui_index_html) }, // 4329 bytes uncompressed
+    { "/upload", "text/html", "\"040591937641141e\"", webui_upload_html, sizeof(webui_upload_html) }, // 1827 bytes uncompressed
+};